@@ -0,0 +1,142 @@
+/*
+ * Access Stats
+ * Copyright (C) 2025, Shyamal Suhana Chandra
+ * All rights reserved.
+ */
+
+#ifndef ACCESS_STATS_H
+#define ACCESS_STATS_H
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <type_traits>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+#include "BinaryIO.h"
+
+// The adaptive state of a splay tree, so that it survives a restart:
+// accessStats() exports it, saveAccessStats / loadAccessStats persist it,
+// and applyAccessStats() on a tree holding the same keys again restores
+// the counts and rebuilds the shape around them, hot keys near the root,
+// instead of waiting for traffic to splay them back up.
+template<typename Key>
+struct AccessStat {
+    Key key;
+    int accessCount;
+    int maxChildren;  // NSplayTree's branching for the key's node; 0 elsewhere
+};
+
+// Weighted median of sorted[lo, hi) given prefix sums of the weights
+// (prefix[i] is the weight of the first i entries): the first entry at
+// which the running weight passes half, so neither side outweighs half
+// of the range. Choosing it as the root at every level keeps an entry of
+// weight w within about log2(W / w) levels of the top.
+inline size_t weightedMedian(const std::vector<uint64_t>& prefix, size_t lo, size_t hi) {
+    uint64_t half = prefix[lo] + (prefix[hi] - prefix[lo]) / 2;
+    size_t at = static_cast<size_t>(std::upper_bound(prefix.begin() + lo + 1, prefix.begin() + hi + 1, half)
+                                    - prefix.begin()) - 1;
+    return std::min(at, hi - 1);
+}
+
+// File format: "MGRA", a version byte, three reserved bytes, the record
+// count as a little-endian uint64, then per record the key, the access
+// count and maxChildren as varints. Keys are std::string (varint length
+// and bytes) or trivially copyable types written as raw bytes, which are
+// only read back on a machine with the same layout.
+namespace access_stats_detail {
+
+constexpr char kMagic[4] = {'M', 'G', 'R', 'A'};
+constexpr unsigned char kVersion = 1;
+constexpr size_t kHeaderSize = 16;
+
+using binary_io::putVarint;
+using binary_io::getVarint;
+
+template<typename Key>
+void putKey(std::vector<unsigned char>& out, const Key& key) {
+    static_assert(std::is_trivially_copyable<Key>::value,
+                  "access stats keys must be std::string or trivially copyable");
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&key);
+    out.insert(out.end(), bytes, bytes + sizeof(Key));
+}
+
+inline void putKey(std::vector<unsigned char>& out, const std::string& key) {
+    putVarint(out, key.size());
+    out.insert(out.end(), key.begin(), key.end());
+}
+
+template<typename Key>
+bool getKey(const std::vector<unsigned char>& data, size_t& offset, Key& key) {
+    if (data.size() - offset < sizeof(Key)) return false;
+    std::memcpy(&key, data.data() + offset, sizeof(Key));
+    offset += sizeof(Key);
+    return true;
+}
+
+inline bool getKey(const std::vector<unsigned char>& data, size_t& offset, std::string& key) {
+    uint64_t length;
+    if (!getVarint(data, offset, length) || data.size() - offset < length) return false;
+    key.assign(reinterpret_cast<const char*>(data.data() + offset), static_cast<size_t>(length));
+    offset += static_cast<size_t>(length);
+    return true;
+}
+
+} // namespace access_stats_detail
+
+template<typename Key>
+bool saveAccessStats(const std::string& path, const std::vector<AccessStat<Key>>& stats) {
+    using namespace access_stats_detail;
+    std::vector<unsigned char> buffer(kMagic, kMagic + 4);
+    buffer.push_back(kVersion);
+    buffer.insert(buffer.end(), 3, 0);
+    for (int i = 0; i < 8; i++) {
+        buffer.push_back(static_cast<unsigned char>(static_cast<uint64_t>(stats.size()) >> (8 * i)));
+    }
+    for (const AccessStat<Key>& stat : stats) {
+        putKey(buffer, stat.key);
+        putVarint(buffer, static_cast<uint64_t>(std::max(stat.accessCount, 0)));
+        putVarint(buffer, static_cast<uint64_t>(std::max(stat.maxChildren, 0)));
+    }
+
+    std::FILE* file = std::fopen(path.c_str(), "wb");
+    if (!file) return false;
+    bool written = std::fwrite(buffer.data(), 1, buffer.size(), file) == buffer.size();
+    return std::fclose(file) == 0 && written;
+}
+
+// False, with stats left empty, if path cannot be read or is not a
+// complete access stats file of this version
+template<typename Key>
+bool loadAccessStats(const std::string& path, std::vector<AccessStat<Key>>& stats) {
+    using namespace access_stats_detail;
+    stats.clear();
+    std::vector<unsigned char> data;
+    if (!binary_io::readFile(path, data) || data.size() < kHeaderSize ||
+        std::memcmp(data.data(), kMagic, 4) != 0 || data[4] != kVersion) {
+        return false;
+    }
+    uint64_t count = 0;
+    for (int i = 0; i < 8; i++) {
+        count |= static_cast<uint64_t>(data[8 + i]) << (8 * i);
+    }
+
+    size_t offset = kHeaderSize;
+    for (uint64_t i = 0; i < count; i++) {
+        AccessStat<Key> stat;
+        uint64_t accessCount, maxChildren;
+        if (!getKey(data, offset, stat.key) || !getVarint(data, offset, accessCount) ||
+            !getVarint(data, offset, maxChildren)) {
+            stats.clear();
+            return false;
+        }
+        stat.accessCount = static_cast<int>(std::min<uint64_t>(accessCount, INT32_MAX));
+        stat.maxChildren = static_cast<int>(std::min<uint64_t>(maxChildren, INT32_MAX));
+        stats.push_back(std::move(stat));
+    }
+    return true;
+}
+
+#endif // ACCESS_STATS_H
@@ -10,27 +10,37 @@
 #include <memory>
 #include <mutex>
 #include <atomic>
-#include <thread>
 #include <functional>
-#include <queue>
-#include <condition_variable>
+#include <optional>
+#include "TreeExecutor.h"
+#include "TreeFuture.h"
+#include "FlatCombiner.h"
+#include "SnapshotJournal.h"
+#include "NodeKeys.h"
+#include "TreeStats.h"
+#include "FrozenIndex.h"
+#include "ParallelExport.h"
 
 template<typename Key, typename Value>
 class BTree {
 public:
     struct Node {
-        std::vector<Key> keys;
+        NodeKeys<Key> keys;  // Prefix-compressed for std::string (NodeKeys.h)
         std::vector<Value> values;
+        std::vector<uint8_t> dead;  // Per key: tombstoned by lazy deletion
         std::vector<std::shared_ptr<Node>> children;
-        std::shared_ptr<Node> parent;
         bool isLeaf;
         std::atomic<int> accessCount;
         std::mutex nodeMutex;
+        uint64_t id;       // Stable for the node's lifetime (see SnapshotJournal)
+        uint64_t version;  // Tree version of its last change
+        uint64_t epoch;    // Write epoch it was created in (see openSnapshot)
         
         Node(int maxKeys, bool leaf = true) 
-            : isLeaf(leaf), accessCount(0) {
+            : isLeaf(leaf), accessCount(0), id(0), version(0), epoch(0) {
             keys.reserve(maxKeys);
             values.reserve(maxKeys);
+            dead.reserve(maxKeys);
             if (!leaf) {
                 children.reserve(maxKeys + 1);
             }
@@ -46,16 +56,64 @@ public:
     Value* search(const Key& key);
     std::vector<std::pair<Key, Value>> sort();
     
-    // Real-time operations with callbacks
-    void insertAsync(const Key& key, const Value& value, 
+    // Same result, written by the shared executor's workers: the tree is
+    // cut into subtrees at the first level with a few per thread, their
+    // sizes are counted and then each is exported concurrently at its
+    // offset into an output sized once. Scans a snapshot in MVCC mode,
+    // like sort().
+    std::vector<std::pair<Key, Value>> sortParallel();
+    
+    // Batch operations, each under a single acquisition of the tree lock.
+    // searchBatch calls visit(i, const Value*) for every key in order,
+    // with nullptr for a miss; the pointer is only valid inside visit.
+    // insertBatch inserts (keys[i], valueAt(i)) for i = 0..count-1 in
+    // order, sets results[i] (if given; bool or any integer type) to
+    // whether the key was new, and returns how many were.
+    template<typename Visit>
+    void searchBatch(const Key* keys, size_t count, Visit visit);
+    template<typename ValueAt, typename Result = bool>
+    size_t insertBatch(const Key* keys, size_t count, ValueAt valueAt, Result* results = nullptr);
+    
+    // Read-only phases: freeze() copies the current contents into an
+    // immutable FrozenIndex whose search and range need no locks; thaw()
+    // inserts a frozen index's entries back, as insertBatch would, and
+    // returns how many were new (all of them for an empty tree).
+    std::shared_ptr<const FrozenIndex<Key, Value>> freeze();
+    size_t thaw(const FrozenIndex<Key, Value>& frozen);
+    
+    // Real-time operations with callbacks, run on the shared
+    // TreeExecutor. Each returns false if the executor rejected the task
+    // (the callback is then not invoked).
+    bool insertAsync(const Key& key, const Value& value, 
                      std::function<void(bool)> callback = nullptr);
-    void deleteAsync(const Key& key, 
+    bool deleteAsync(const Key& key, 
                     std::function<void(bool)> callback = nullptr);
-    void searchAsync(const Key& key, 
+    bool searchAsync(const Key& key, 
                     std::function<void(Value*)> callback = nullptr);
-    void sortAsync(std::function<void(std::vector<std::pair<Key, Value>>)> callback = nullptr);
+    bool sortAsync(std::function<void(std::vector<std::pair<Key, Value>>)> callback = nullptr);
+    
+    // Future / co_await variants. Results are copied out under the tree
+    // lock, so unlike searchAsync's Value* they stay valid whatever later
+    // tasks do to the tree. Called from an executor worker (e.g. inside an
+    // awaiting coroutine) they run inline.
+    TreeFuture<bool> insertFuture(const Key& key, const Value& value);
+    TreeFuture<bool> deleteFuture(const Key& key);
+    TreeFuture<std::optional<Value>> searchFuture(const Key& key);
+    TreeFuture<std::vector<std::pair<Key, Value>>> sortFuture();
     
-    // Thread management
+    // Flat combining: insert, remove and search (and so every async and
+    // future variant) publish into per-thread slots instead of queuing on
+    // the tree lock; whichever thread gets the lock applies all published
+    // operations in one pass, sorted by key. Enable before the tree is
+    // shared between threads; it cannot be turned off again.
+    void enableFlatCombining(size_t maxThreads = 64);
+    bool flatCombiningEnabled() const { return combiner_ != nullptr; }
+    size_t combinedBatches() const { return combiner_ ? combiner_->batches() : 0; }
+    size_t combinedOperations() const { return combiner_ ? combiner_->combinedRequests() : 0; }
+    
+    // Thread management. Trees no longer own threads: startWorkerThreads
+    // attaches to the shared executor (numThreads sizes it if this is its
+    // first use) and stopWorkerThreads waits for this tree's queued tasks.
     void startWorkerThreads(int numThreads = 4);
     void stopWorkerThreads();
     
@@ -65,20 +123,103 @@ public:
     int getMinDegree() const { return minDegree_; }
     void setMinDegree(int degree);
     
-    // For visualization
+    // Hot-path counters (TreeStats.h); zero unless built with
+    // TREE_ENABLE_STATS. Splits and merges are splitChild/mergeChildren,
+    // rotations are borrows through the parent. The queue gauges are
+    // filled in either way.
+    TreeStatsReport getStats() const;
+    void resetStats() { stats_.reset(); }
+    void enableStatsHistograms(bool on = true) { stats_.enableHistograms(on); }
+    
+    // For visualization. Nodes are listed in level order, root first, with
+    // their live keys only: a node holding tombstones lists fewer keys than
+    // it has children until compaction removes them.
     struct TreeSnapshot {
         struct NodeInfo {
+            uint64_t id;
             std::vector<Key> keys;
             std::vector<Value> values;
-            std::vector<size_t> childIndices;
+            std::vector<size_t> childIndices;  // Into nodes (full snapshots only)
+            std::vector<uint64_t> childIds;
             bool isLeaf;
             int accessCount;
         };
         std::vector<NodeInfo> nodes;
         std::vector<std::pair<size_t, size_t>> edges;
+        uint64_t version;
+    };
+    
+    // Changes between two versions: nodes added or modified since
+    // fromVersion (a node's childIds replace its previous edges) and ids of
+    // nodes that left the tree. When the tree can no longer tell what
+    // changed since fromVersion, full is set and nodes lists every node.
+    struct SnapshotDelta {
+        uint64_t fromVersion;
+        uint64_t version;
+        bool full;
+        uint64_t rootId;  // 0 when empty
+        std::vector<typename TreeSnapshot::NodeInfo> nodes;
+        std::vector<uint64_t> removedIds;
     };
     
     TreeSnapshot getSnapshot() const;
+    SnapshotDelta getSnapshotSince(uint64_t version) const;
+    uint64_t version() const;
+    
+    // MVCC read view. Opening one pins the current root in O(1); the
+    // nodes it reaches are never modified again, so it is read without
+    // any lock while writers go on. Writers copy a node from before the
+    // newest snapshot (and so the path above it) instead of changing it
+    // while any snapshot is open. Superseded nodes are freed when the
+    // last snapshot that reaches them is dropped.
+    class Snapshot {
+    public:
+        Snapshot() = default;
+        
+        bool valid() const { return root_ != nullptr; }
+        uint64_t version() const { return version_; }  // Tree version it shows
+        
+        // The pointer stays valid as long as this snapshot
+        const Value* search(const Key& key) const;
+        std::vector<std::pair<Key, Value>> sort() const;
+        size_t size() const;
+        
+    private:
+        friend class BTree;
+        Snapshot(std::shared_ptr<void> pin, std::shared_ptr<const Node> root, uint64_t version)
+            : pin_(std::move(pin)), root_(std::move(root)), version_(version) {}
+        
+        std::shared_ptr<void> pin_;  // Counts as an open snapshot while held
+        std::shared_ptr<const Node> root_;
+        uint64_t version_ = 0;
+    };
+    
+    Snapshot openSnapshot() const;
+    size_t openSnapshots() const { return liveSnapshots_->load(); }
+    
+    // MVCC mode: sort() (and sortAsync/sortFuture) scan a fresh snapshot
+    // instead of holding the tree lock for the whole traversal
+    void enableMVCC() { mvcc_ = true; }
+    bool mvccEnabled() const { return mvcc_; }
+    
+    // Lazy deletion: remove() (and deleteAsync/deleteFuture) only marks
+    // the entry as a tombstone in place, so a burst of deletes never
+    // splits, borrows or merges under the tree lock. Searches, scans and
+    // size() skip tombstones, and inserting the key again revives its
+    // entry. Once tombstones make up tombstoneRatio of the entries, a
+    // compaction task on the shared executor erases them, a batch per
+    // lock acquisition, rebalancing underfull nodes as it goes; values
+    // are destroyed then, and like any other writer a compaction can move
+    // the value a search() pointer refers to (searchFuture and
+    // searchBatch copy under the lock). Enable before the tree is shared
+    // between threads; it cannot be turned off again.
+    void enableLazyDeletion(double tombstoneRatio = 0.25);
+    bool lazyDeletionEnabled() const { return lazyDelete_; }
+    size_t tombstones() const { return tombstones_.load(); }
+    
+    // Erases every pending tombstone now, on the calling thread (still a
+    // batch per lock acquisition); returns how many
+    size_t compact();
     
 private:
     int minDegree_;
@@ -86,12 +227,43 @@ private:
     std::shared_ptr<Node> root_;
     mutable std::mutex treeMutex_;
     
-    // Thread pool for async operations
-    std::vector<std::thread> workerThreads_;
-    std::queue<std::function<void()>> taskQueue_;
-    std::mutex queueMutex_;
-    std::condition_variable queueCondition_;
-    std::atomic<bool> running_;
+    // This tree's tasks on the shared executor, created on first use
+    std::unique_ptr<TreeExecutor::TaskGroup> tasks_;
+    mutable std::mutex tasksMutex_;
+    
+    // An operation published to the flat combiner; the publisher owns it
+    // and waits until the combiner has filled in the result
+    struct CombinedOp {
+        enum Kind { INSERT, REMOVE, SEARCH };
+        Kind kind;
+        const Key* key;
+        const Value* value;           // INSERT
+        bool result = false;          // INSERT, REMOVE
+        Value* found = nullptr;       // SEARCH
+        std::optional<Value>* copy = nullptr;  // SEARCH: also copy under the lock
+    };
+    std::unique_ptr<FlatCombiner<CombinedOp>> combiner_;
+    
+    mutable TreeStats stats_;
+    
+    // Change tracking for getSnapshotSince; started by the first snapshot
+    mutable SnapshotJournal<Node> journal_;
+    
+    // Copy-on-write state: nodes from an epoch before writeEpoch_ may be
+    // reachable from an open Snapshot
+    mutable uint64_t writeEpoch_;
+    std::shared_ptr<std::atomic<size_t>> liveSnapshots_;
+    bool mvcc_;
+    
+    // Lazy deletion. keyCount_ counts entries including tombstones;
+    // tombstoneKeys_ lists keys as they were tombstoned, so a key revived
+    // (or erased) since is skipped when its turn comes
+    bool lazyDelete_;
+    double tombstoneRatio_;
+    std::atomic<size_t> keyCount_;
+    std::atomic<size_t> tombstones_;
+    std::vector<Key> tombstoneKeys_;
+    std::atomic<bool> compactionScheduled_;
     
     // Splay optimization
     void splayNode(std::shared_ptr<Node> node);
@@ -101,21 +273,51 @@ private:
     void splitChild(std::shared_ptr<Node> parent, int index);
     void insertNonFull(std::shared_ptr<Node> node, const Key& key, const Value& value);
     void mergeChildren(std::shared_ptr<Node> parent, int index);
-    void borrowFromSibling(std::shared_ptr<Node> node, int index);
+    void borrowFromSibling(std::shared_ptr<Node> node, size_t index);
     bool removeFromNode(std::shared_ptr<Node> node, const Key& key);
-    Key getPredecessor(std::shared_ptr<Node> node, int index);
-    Key getSuccessor(std::shared_ptr<Node> node, int index);
+    struct Entry {
+        Key key;
+        Value value;
+        uint8_t dead;
+    };
+    Entry getPredecessor(std::shared_ptr<Node> node, int index);
+    Entry getSuccessor(std::shared_ptr<Node> node, int index);
+    
+    // Lazy deletion
+    const Node* findEntry(const Key& key, size_t& index) const;
+    Node* locateWritable(const Key& key, bool dead, size_t& index);
+    Node* writableEntry(Node* found, const Key& key);
+    bool markDeletedLocked(const Key& key);
+    void reviveLocked(Node* found, size_t index, const Key& key, const Value& value);
+    size_t compactBatch(bool& more);
+    void compactionStep();
+    void scheduleCompaction();
+    
+    // Copy-on-write
+    std::shared_ptr<Node> newNode(bool leaf);
+    std::shared_ptr<Node>& writable(std::shared_ptr<Node>& slot);
     
     // Helper functions
-    int findKeyIndex(const std::vector<Key>& keys, const Key& key) const;
+    bool insertLocked(const Key& key, const Value& value);
+    bool removeLocked(const Key& key);
+    bool eraseLocked(const Key& key);
+    Value* searchLocked(const Key& key);
+    Node* searchEntryLocked(const Key& key, size_t& index);
+    bool runCombined(CombinedOp& op);
+    void applyCombined(std::vector<CombinedOp*>& batch);
+    size_t findKeyIndex(const NodeKeys<Key>& keys, const Key& key) const;
     void inOrderTraversal(std::shared_ptr<Node> node, 
                          std::vector<std::pair<Key, Value>>& result) const;
+    template<typename Visit>
+    static void forEachInOrder(const Node* node, Visit visit);
+    static size_t countKeys(const Node* node);
+    static std::vector<std::pair<Key, Value>> exportParallel(const Node* root, TreeExecutor& executor);
     int calculateHeight(std::shared_ptr<Node> node) const;
-    size_t calculateSize(std::shared_ptr<Node> node) const;
+    typename TreeSnapshot::NodeInfo nodeInfo(const Node& node) const;
     
-    // Thread worker
-    void workerThread();
-    void enqueueTask(std::function<void()> task);
+    // Async dispatch
+    TreeExecutor::TaskGroup& taskGroup(int numThreads = 0);
+    bool enqueueTask(std::function<void()> task);
 };
 
 // Template implementation
@@ -4,12 +4,14 @@
 #include "BTree.h"
 #include <algorithm>
 #include <iostream>
-#include <map>
 
 template<typename Key, typename Value>
 BTree<Key, Value>::BTree(int minDegree) 
-    : minDegree_(minDegree), maxKeys_(2 * minDegree_ - 1), 
-      root_(std::make_shared<Node>(maxKeys_, true)), running_(false) {
+    : minDegree_(minDegree), maxKeys_(2 * minDegree_ - 1), writeEpoch_(0),
+      liveSnapshots_(std::make_shared<std::atomic<size_t>>(0)), mvcc_(false),
+      lazyDelete_(false), tombstoneRatio_(0.25), keyCount_(0), tombstones_(0),
+      compactionScheduled_(false) {
+    root_ = newNode(true);
 }
 
 template<typename Key, typename Value>
@@ -19,174 +21,227 @@ BTree<Key, Value>::~BTree() {
 
 template<typename Key, typename Value>
 bool BTree<Key, Value>::insert(const Key& key, const Value& value) {
-    std::lock_guard<std::mutex> lock(treeMutex_);
-    
-    // Check if key already exists
-    if (search(key) != nullptr) {
-        return false;
+    CombinedOp op{CombinedOp::INSERT, &key, &value};
+    if (runCombined(op)) {
+        return op.result;
+    }
+    TreeStats::Lock lock(treeMutex_, stats_);
+    return insertLocked(key, value);
+}
+
+template<typename Key, typename Value>
+bool BTree<Key, Value>::insertLocked(const Key& key, const Value& value) {
+    // Check if key already exists; a tombstone found on the way is
+    // revived instead of inserting the key again
+    size_t index;
+    Node* found = searchEntryLocked(key, index);
+    if (found != nullptr) {
+        if (!found->dead[index]) {
+            return false;
+        }
+        reviveLocked(found, index, key, value);
+        return true;
     }
     
     // If root is full, split it
-    if (root_->keys.size() == maxKeys_) {
-        auto newRoot = std::make_shared<Node>(maxKeys_, false);
+    if (root_->keys.size() == static_cast<size_t>(maxKeys_)) {
+        auto newRoot = newNode(false);
         newRoot->children.push_back(root_);
-        root_->parent = newRoot;
         root_ = newRoot;
         splitChild(root_, 0);
     }
     
-    insertNonFull(root_, key, value);
+    insertNonFull(writable(root_), key, value);
+    keyCount_++;
     return true;
 }
 
 template<typename Key, typename Value>
 void BTree<Key, Value>::insertNonFull(std::shared_ptr<Node> node, 
                                       const Key& key, const Value& value) {
-    int i = node->keys.size() - 1;
-    
     if (node->isLeaf) {
         // Insert into leaf
-        node->keys.push_back(Key());
-        node->values.push_back(Value());
-        
-        while (i >= 0 && node->keys[i] > key) {
-            node->keys[i + 1] = node->keys[i];
-            node->values[i + 1] = node->values[i];
-            i--;
-        }
-        
-        node->keys[i + 1] = key;
-        node->values[i + 1] = value;
+        size_t pos = node->keys.lowerBound(key);
+        node->keys.insert(pos, key);
+        node->values.insert(node->values.begin() + pos, value);
+        node->dead.insert(node->dead.begin() + pos, 0);
+        journal_.changed(*node);
     } else {
         // Find child to insert into
-        while (i >= 0 && node->keys[i] > key) {
-            i--;
-        }
-        i++;
+        int i = node->keys.lowerBound(key);
         
         // If child is full, split it
-        if (node->children[i]->keys.size() == maxKeys_) {
+        if (node->children[i]->keys.size() == static_cast<size_t>(maxKeys_)) {
             splitChild(node, i);
-            if (node->keys[i] < key) {
+            if (node->keys.less(i, key)) {
                 i++;
             }
         }
         
-        insertNonFull(node->children[i], key, value);
+        insertNonFull(writable(node->children[i]), key, value);
     }
 }
 
 template<typename Key, typename Value>
 void BTree<Key, Value>::splitChild(std::shared_ptr<Node> parent, int index) {
-    auto child = parent->children[index];
-    auto newChild = std::make_shared<Node>(maxKeys_, child->isLeaf);
+    auto child = writable(parent->children[index]);
+    auto newChild = newNode(child->isLeaf);
     
     // Move half of child's keys to new child
     int mid = minDegree_ - 1;
-    newChild->keys.assign(child->keys.begin() + mid + 1, child->keys.end());
+    Key midKey = child->keys.get(mid);
+    Value midValue = child->values[mid];
+    uint8_t midDead = child->dead[mid];
+    newChild->keys.append(child->keys, mid + 1, child->keys.size());
     newChild->values.assign(child->values.begin() + mid + 1, child->values.end());
-    child->keys.resize(mid);
+    newChild->dead.assign(child->dead.begin() + mid + 1, child->dead.end());
+    child->keys.truncate(mid);
     child->values.resize(mid);
+    child->dead.resize(mid);
     
     if (!child->isLeaf) {
         newChild->children.assign(child->children.begin() + mid + 1, 
                                   child->children.end());
         child->children.resize(mid + 1);
-        for (auto& c : newChild->children) {
-            c->parent = newChild;
-        }
     }
     
     // Move middle key to parent
-    parent->keys.insert(parent->keys.begin() + index, child->keys[mid]);
-    parent->values.insert(parent->values.begin() + index, child->values[mid]);
-    child->keys.erase(child->keys.begin() + mid);
-    child->values.erase(child->values.begin() + mid);
+    parent->keys.insert(index, midKey);
+    parent->values.insert(parent->values.begin() + index, midValue);
+    parent->dead.insert(parent->dead.begin() + index, midDead);
     
     parent->children.insert(parent->children.begin() + index + 1, newChild);
-    newChild->parent = parent;
+    journal_.changed(*child);
+    journal_.changed(*parent);
+    stats_.add(TreeCounter::SPLITS);
 }
 
 template<typename Key, typename Value>
 Value* BTree<Key, Value>::search(const Key& key) {
-    std::lock_guard<std::mutex> lock(treeMutex_);
+    CombinedOp op{CombinedOp::SEARCH, &key, nullptr};
+    if (runCombined(op)) {
+        return op.found;
+    }
+    TreeStats::Lock lock(treeMutex_, stats_);
+    return searchLocked(key);
+}
+
+template<typename Key, typename Value>
+Value* BTree<Key, Value>::searchLocked(const Key& key) {
+    size_t index;
+    Node* node = searchEntryLocked(key, index);
+    return node == nullptr || node->dead[index] ? nullptr : &node->values[index];
+}
+
+template<typename Key, typename Value>
+typename BTree<Key, Value>::Node* BTree<Key, Value>::searchEntryLocked(const Key& key, size_t& index) {
+    // The node holding key, tombstoned or not
     auto node = root_;
+    size_t visited = 0;
     
     while (node != nullptr) {
+        visited++;
         node->accessCount++;
+        journal_.changed(*node);
         splayNode(node);
         
-        int i = findKeyIndex(node->keys, key);
+        size_t i = findKeyIndex(node->keys, key);
         
-        if (i < node->keys.size() && node->keys[i] == key) {
-            return &node->values[i];
+        if (i < node->keys.size() && node->keys.equals(i, key)) {
+            stats_.recordLookup(visited);
+            index = i;
+            return node.get();
         }
         
         if (node->isLeaf) {
+            stats_.recordLookup(visited);
             return nullptr;
         }
         
-        if (i < node->keys.size() && node->keys[i] > key) {
-            node = node->children[i];
-        } else {
-            node = node->children[i];
-        }
+        node = node->children[i];
     }
     
     return nullptr;
 }
 
 template<typename Key, typename Value>
-int BTree<Key, Value>::findKeyIndex(const std::vector<Key>& keys, const Key& key) const {
-    int i = 0;
-    while (i < keys.size() && keys[i] < key) {
-        i++;
-    }
-    return i;
+size_t BTree<Key, Value>::findKeyIndex(const NodeKeys<Key>& keys, const Key& key) const {
+    return keys.lowerBound(key);
 }
 
 template<typename Key, typename Value>
 bool BTree<Key, Value>::remove(const Key& key) {
-    std::lock_guard<std::mutex> lock(treeMutex_);
-    
+    CombinedOp op{CombinedOp::REMOVE, &key, nullptr};
+    bool removed;
+    if (runCombined(op)) {
+        removed = op.result;
+    } else {
+        TreeStats::Lock lock(treeMutex_, stats_);
+        removed = removeLocked(key);
+    }
+    // Outside the lock: a blocking submit must not hold up the workers
+    if (removed && lazyDelete_) {
+        scheduleCompaction();
+    }
+    return removed;
+}
+
+template<typename Key, typename Value>
+bool BTree<Key, Value>::removeLocked(const Key& key) {
+    return lazyDelete_ ? markDeletedLocked(key) : eraseLocked(key);
+}
+
+template<typename Key, typename Value>
+bool BTree<Key, Value>::eraseLocked(const Key& key) {
     if (root_->keys.empty()) {
         return false;
     }
     
-    bool result = removeFromNode(root_, key);
+    bool result = removeFromNode(writable(root_), key);
     
     // If root becomes empty and has a child, make child the new root
     if (root_->keys.empty() && !root_->isLeaf) {
+        journal_.removed(*root_);
         root_ = root_->children[0];
-        root_->parent = nullptr;
     }
     
+    if (result) {
+        keyCount_--;
+    }
     return result;
 }
 
 template<typename Key, typename Value>
 bool BTree<Key, Value>::removeFromNode(std::shared_ptr<Node> node, const Key& key) {
-    int idx = findKeyIndex(node->keys, key);
+    size_t idx = findKeyIndex(node->keys, key);
     
     // Key found in this node
-    if (idx < node->keys.size() && node->keys[idx] == key) {
+    if (idx < node->keys.size() && node->keys.equals(idx, key)) {
         if (node->isLeaf) {
             // Simple removal from leaf
-            node->keys.erase(node->keys.begin() + idx);
+            node->keys.erase(idx);
             node->values.erase(node->values.begin() + idx);
+            node->dead.erase(node->dead.begin() + idx);
+            journal_.changed(*node);
             return true;
         } else {
             // Key is in internal node
-            if (node->children[idx]->keys.size() >= minDegree_) {
+            if (node->children[idx]->keys.size() >= static_cast<size_t>(minDegree_)) {
                 // Replace with predecessor
-                Key predKey = getPredecessor(node, idx);
-                node->keys[idx] = predKey;
-                return removeFromNode(node->children[idx], predKey);
-            } else if (node->children[idx + 1]->keys.size() >= minDegree_) {
+                Entry pred = getPredecessor(node, idx);
+                node->keys.set(idx, pred.key);
+                node->values[idx] = pred.value;
+                node->dead[idx] = pred.dead;
+                journal_.changed(*node);
+                return removeFromNode(writable(node->children[idx]), pred.key);
+            } else if (node->children[idx + 1]->keys.size() >= static_cast<size_t>(minDegree_)) {
                 // Replace with successor
-                Key succKey = getSuccessor(node, idx);
-                node->keys[idx] = succKey;
-                return removeFromNode(node->children[idx + 1], succKey);
+                Entry succ = getSuccessor(node, idx);
+                node->keys.set(idx, succ.key);
+                node->values[idx] = succ.value;
+                node->dead[idx] = succ.dead;
+                journal_.changed(*node);
+                return removeFromNode(writable(node->children[idx + 1]), succ.key);
             } else {
                 // Merge children
                 mergeChildren(node, idx);
@@ -201,124 +256,342 @@ bool BTree<Key, Value>::removeFromNode(std::shared_ptr<Node> node, const Key& ke
         
         bool flag = (idx == node->keys.size());
         
-        if (node->children[idx]->keys.size() < minDegree_) {
+        if (node->children[idx]->keys.size() < static_cast<size_t>(minDegree_)) {
             borrowFromSibling(node, idx);
         }
         
         if (flag && idx > node->keys.size()) {
-            return removeFromNode(node->children[idx - 1], key);
+            return removeFromNode(writable(node->children[idx - 1]), key);
         } else {
-            return removeFromNode(node->children[idx], key);
+            return removeFromNode(writable(node->children[idx]), key);
         }
     }
 }
 
 template<typename Key, typename Value>
-Key BTree<Key, Value>::getPredecessor(std::shared_ptr<Node> node, int index) {
+typename BTree<Key, Value>::Entry BTree<Key, Value>::getPredecessor(std::shared_ptr<Node> node, int index) {
     auto curr = node->children[index];
     while (!curr->isLeaf) {
         curr = curr->children[curr->children.size() - 1];
     }
-    return curr->keys[curr->keys.size() - 1];
+    return {curr->keys.get(curr->keys.size() - 1), curr->values.back(), curr->dead.back()};
 }
 
 template<typename Key, typename Value>
-Key BTree<Key, Value>::getSuccessor(std::shared_ptr<Node> node, int index) {
+typename BTree<Key, Value>::Entry BTree<Key, Value>::getSuccessor(std::shared_ptr<Node> node, int index) {
     auto curr = node->children[index + 1];
     while (!curr->isLeaf) {
         curr = curr->children[0];
     }
-    return curr->keys[0];
+    return {curr->keys.get(0), curr->values.front(), curr->dead.front()};
 }
 
 template<typename Key, typename Value>
 void BTree<Key, Value>::mergeChildren(std::shared_ptr<Node> parent, int index) {
-    auto child = parent->children[index];
+    // sibling is only read and then dropped, so it need not be copied
+    auto child = writable(parent->children[index]);
     auto sibling = parent->children[index + 1];
     
     // Move key from parent to child
-    child->keys.push_back(parent->keys[index]);
+    child->keys.insert(child->keys.size(), parent->keys.get(index));
     child->values.push_back(parent->values[index]);
+    child->dead.push_back(parent->dead[index]);
     
     // Copy keys and values from sibling
-    child->keys.insert(child->keys.end(), sibling->keys.begin(), sibling->keys.end());
+    child->keys.append(sibling->keys, 0, sibling->keys.size());
     child->values.insert(child->values.end(), sibling->values.begin(), sibling->values.end());
+    child->dead.insert(child->dead.end(), sibling->dead.begin(), sibling->dead.end());
     
     // Copy children if not leaf
     if (!child->isLeaf) {
         child->children.insert(child->children.end(), 
                               sibling->children.begin(), sibling->children.end());
-        for (auto& c : sibling->children) {
-            c->parent = child;
-        }
     }
     
     // Remove key and sibling from parent
-    parent->keys.erase(parent->keys.begin() + index);
+    parent->keys.erase(index);
     parent->values.erase(parent->values.begin() + index);
+    parent->dead.erase(parent->dead.begin() + index);
     parent->children.erase(parent->children.begin() + index + 1);
+    journal_.changed(*child);
+    journal_.changed(*parent);
+    journal_.removed(*sibling);
+    stats_.add(TreeCounter::MERGES);
 }
 
 template<typename Key, typename Value>
-void BTree<Key, Value>::borrowFromSibling(std::shared_ptr<Node> parent, int index) {
-    auto node = parent->children[index];
+void BTree<Key, Value>::borrowFromSibling(std::shared_ptr<Node> parent, size_t index) {
+    auto node = writable(parent->children[index]);
     
     // Try to borrow from left sibling
-    if (index != 0 && parent->children[index - 1]->keys.size() >= minDegree_) {
-        auto sibling = parent->children[index - 1];
+    if (index != 0 && parent->children[index - 1]->keys.size() >= static_cast<size_t>(minDegree_)) {
+        auto sibling = writable(parent->children[index - 1]);
         
-        node->keys.insert(node->keys.begin(), parent->keys[index - 1]);
+        node->keys.insert(0, parent->keys.get(index - 1));
         node->values.insert(node->values.begin(), parent->values[index - 1]);
-        parent->keys[index - 1] = sibling->keys[sibling->keys.size() - 1];
+        parent->keys.set(index - 1, sibling->keys.get(sibling->keys.size() - 1));
         parent->values[index - 1] = sibling->values[sibling->values.size() - 1];
-        sibling->keys.pop_back();
+        sibling->keys.truncate(sibling->keys.size() - 1);
         sibling->values.pop_back();
+        node->dead.insert(node->dead.begin(), parent->dead[index - 1]);
+        parent->dead[index - 1] = sibling->dead.back();
+        sibling->dead.pop_back();
         
         if (!node->isLeaf) {
             node->children.insert(node->children.begin(), 
                                  sibling->children[sibling->children.size() - 1]);
             sibling->children.pop_back();
-            node->children[0]->parent = node;
         }
+        journal_.changed(*node);
+        journal_.changed(*sibling);
+        journal_.changed(*parent);
+        stats_.add(TreeCounter::ROTATIONS);
         return;
     }
     
     // Try to borrow from right sibling
     if (index != parent->children.size() - 1 && 
-        parent->children[index + 1]->keys.size() >= minDegree_) {
-        auto sibling = parent->children[index + 1];
+        parent->children[index + 1]->keys.size() >= static_cast<size_t>(minDegree_)) {
+        auto sibling = writable(parent->children[index + 1]);
         
-        node->keys.push_back(parent->keys[index]);
+        node->keys.insert(node->keys.size(), parent->keys.get(index));
         node->values.push_back(parent->values[index]);
-        parent->keys[index] = sibling->keys[0];
+        parent->keys.set(index, sibling->keys.get(0));
         parent->values[index] = sibling->values[0];
-        sibling->keys.erase(sibling->keys.begin());
+        sibling->keys.erase(0);
         sibling->values.erase(sibling->values.begin());
+        node->dead.push_back(parent->dead[index]);
+        parent->dead[index] = sibling->dead[0];
+        sibling->dead.erase(sibling->dead.begin());
         
         if (!node->isLeaf) {
             node->children.push_back(sibling->children[0]);
             sibling->children.erase(sibling->children.begin());
-            node->children[node->children.size() - 1]->parent = node;
         }
+        journal_.changed(*node);
+        journal_.changed(*sibling);
+        journal_.changed(*parent);
+        stats_.add(TreeCounter::ROTATIONS);
         return;
     }
     
-    // Merge with sibling
-    if (index != 0) {
-        mergeChildren(parent, index - 1);
-    } else {
+    // Merge with sibling. Prefer the right one so the merged node stays at
+    // index, where removeFromNode continues; only the last child merges left.
+    if (index != parent->children.size() - 1) {
         mergeChildren(parent, index);
+    } else {
+        mergeChildren(parent, index - 1);
+    }
+}
+
+template<typename Key, typename Value>
+std::shared_ptr<typename BTree<Key, Value>::Node> BTree<Key, Value>::newNode(bool leaf) {
+    auto node = std::make_shared<Node>(maxKeys_, leaf);
+    node->epoch = writeEpoch_;
+    journal_.added(*node);
+    return node;
+}
+
+template<typename Key, typename Value>
+std::shared_ptr<typename BTree<Key, Value>::Node>&
+BTree<Key, Value>::writable(std::shared_ptr<Node>& slot) {
+    // slot is root_ or sits in a node that is already writable, so
+    // replacing it copies the path one level at a time. Nodes created
+    // since the newest snapshot are never visible to one; older ones are
+    // only safe to change in place once every snapshot is closed.
+    if (slot->epoch != writeEpoch_ &&
+        liveSnapshots_->load(std::memory_order_acquire) > 0) {
+        auto copy = std::make_shared<Node>(maxKeys_, slot->isLeaf);
+        copy->keys = slot->keys;
+        copy->values = slot->values;
+        copy->dead = slot->dead;
+        copy->children = slot->children;
+        copy->accessCount = slot->accessCount.load();
+        copy->epoch = writeEpoch_;
+        journal_.replaced(*slot, *copy);
+        slot = std::move(copy);
     }
+    return slot;
+}
+
+template<typename Key, typename Value>
+typename BTree<Key, Value>::Snapshot BTree<Key, Value>::openSnapshot() const {
+    TreeStats::Lock lock(treeMutex_, stats_);
+    
+    // Everything reachable now belongs to an older epoch from here on
+    writeEpoch_++;
+    liveSnapshots_->fetch_add(1);
+    auto counter = liveSnapshots_;
+    std::shared_ptr<void> pin(nullptr, [counter](void*) {
+        // Release: the reader is done with the nodes before a writer that
+        // sees the count drop may modify them in place
+        counter->fetch_sub(1, std::memory_order_release);
+    });
+    return Snapshot(std::move(pin), root_, journal_.version());
+}
+
+template<typename Key, typename Value>
+const Value* BTree<Key, Value>::Snapshot::search(const Key& key) const {
+    const Node* node = root_.get();
+    while (node != nullptr) {
+        size_t i = node->keys.lowerBound(key);
+        if (i < node->keys.size() && node->keys.equals(i, key)) {
+            return node->dead[i] ? nullptr : &node->values[i];
+        }
+        if (node->isLeaf) {
+            return nullptr;
+        }
+        node = node->children[i].get();
+    }
+    return nullptr;
+}
+
+template<typename Key, typename Value>
+std::vector<std::pair<Key, Value>> BTree<Key, Value>::Snapshot::sort() const {
+    std::vector<std::pair<Key, Value>> result;
+    forEachInOrder(root_.get(), [&result](const Node& node, size_t i) {
+        result.push_back({node.keys.get(i), node.values[i]});
+    });
+    return result;
+}
+
+template<typename Key, typename Value>
+size_t BTree<Key, Value>::Snapshot::size() const {
+    return countKeys(root_.get());
+}
+
+template<typename Key, typename Value>
+template<typename Visit>
+void BTree<Key, Value>::forEachInOrder(const Node* node, Visit visit) {
+    // In-order walk over the live entries with an explicit stack of
+    // (node, next key index)
+    std::vector<std::pair<const Node*, size_t>> stack;
+    if (node) stack.push_back({node, 0});
+    
+    while (!stack.empty()) {
+        // Step i visits key i - 1, then descends into child i
+        auto& [current, next] = stack.back();
+        if (next > current->keys.size()) {
+            stack.pop_back();
+            continue;
+        }
+        size_t i = next++;
+        if (i > 0 && !current->dead[i - 1]) {
+            visit(*current, i - 1);
+        }
+        if (!current->isLeaf && i < current->children.size()) {
+            stack.push_back({current->children[i].get(), 0});
+        }
+    }
+}
+
+template<typename Key, typename Value>
+size_t BTree<Key, Value>::countKeys(const Node* node) {
+    size_t count = 0;
+    std::vector<const Node*> stack;
+    if (node) stack.push_back(node);
+    while (!stack.empty()) {
+        const Node* current = stack.back();
+        stack.pop_back();
+        count += current->keys.size() -
+                 std::count(current->dead.begin(), current->dead.end(), 1);
+        for (auto& child : current->children) {
+            stack.push_back(child.get());
+        }
+    }
+    return count;
 }
 
 template<typename Key, typename Value>
 std::vector<std::pair<Key, Value>> BTree<Key, Value>::sort() {
-    std::lock_guard<std::mutex> lock(treeMutex_);
+    if (mvcc_) {
+        return openSnapshot().sort();
+    }
+    TreeStats::Lock lock(treeMutex_, stats_);
     std::vector<std::pair<Key, Value>> result;
     inOrderTraversal(root_, result);
     return result;
 }
 
+template<typename Key, typename Value>
+std::vector<std::pair<Key, Value>> BTree<Key, Value>::sortParallel() {
+    TreeExecutor& executor = taskGroup().executor();
+    if (mvcc_) {
+        Snapshot snapshot = openSnapshot();
+        return exportParallel(snapshot.root_.get(), executor);
+    }
+    TreeStats::Lock lock(treeMutex_, stats_);
+    return exportParallel(root_.get(), executor);
+}
+
+template<typename Key, typename Value>
+std::vector<std::pair<Key, Value>> BTree<Key, Value>::exportParallel(const Node* root,
+                                                                     TreeExecutor& executor) {
+    std::vector<std::pair<Key, Value>> result;
+    if (root == nullptr) return result;
+    
+    // Nodes keep no subtree sizes, so the pieces are the nodes of one
+    // level: the first with several per thread, or the leaves. Leaves all
+    // sit at the same depth, so everything above that level is internal,
+    // and a level lists its nodes in key order.
+    size_t target = (executor.workerCount() + 1) * 8;
+    size_t cutDepth = 0;
+    size_t upperKeys = 0;
+    std::vector<const Node*> level{root};
+    std::vector<const Node*> next;
+    while (level.size() < target && !level.front()->isLeaf) {
+        next.clear();
+        for (const Node* node : level) {
+            upperKeys += node->keys.size();
+            for (auto& child : node->children) {
+                next.push_back(child.get());
+            }
+        }
+        level.swap(next);
+        cutDepth++;
+    }
+    
+    std::vector<ExportPiece<const Node*>> pieces(level.size());
+    executor.parallelFor(level.size(), [&](size_t i) {
+        pieces[i].subtree = level[i];
+        pieces[i].size = countKeys(level[i]);
+    });
+    size_t total = upperKeys;
+    for (auto& piece : pieces) {
+        total += piece.size;
+    }
+    result.resize(total);
+    
+    // Place the upper levels' entries between the pieces
+    size_t position = 0;
+    size_t nextPiece = 0;
+    auto place = [&](auto& self, const Node* node, size_t depth) -> void {
+        if (depth == cutDepth) {
+            pieces[nextPiece].offset = position;
+            position += pieces[nextPiece++].size;
+            return;
+        }
+        for (size_t i = 0; i < node->keys.size(); i++) {
+            self(self, node->children[i].get(), depth + 1);
+            if (!node->dead[i]) {
+                result[position++] = {node->keys.get(i), node->values[i]};
+            }
+        }
+        self(self, node->children.back().get(), depth + 1);
+    };
+    place(place, root, 0);
+    
+    exportPieces(executor, result, position, pieces,
+        [](const Node* subtree, std::pair<Key, Value>* out) {
+            size_t written = 0;
+            forEachInOrder(subtree, [&](const Node& node, size_t i) {
+                out[written++] = {node.keys.get(i), node.values[i]};
+            });
+            return written;
+        });
+    return result;
+}
+
 template<typename Key, typename Value>
 void BTree<Key, Value>::inOrderTraversal(std::shared_ptr<Node> node,
                                          std::vector<std::pair<Key, Value>>& result) const {
@@ -328,7 +601,9 @@ void BTree<Key, Value>::inOrderTraversal(std::shared_ptr<Node> node,
         if (!node->isLeaf) {
             inOrderTraversal(node->children[i], result);
         }
-        result.push_back({node->keys[i], node->values[i]});
+        if (!node->dead[i]) {
+            result.push_back({node->keys.get(i), node->values[i]});
+        }
     }
     
     if (!node->isLeaf) {
@@ -341,7 +616,7 @@ void BTree<Key, Value>::splayNode(std::shared_ptr<Node> node) {
     // Splay-like optimization: promote frequently accessed nodes
     // In a B-Tree, we can't easily rotate, but we can promote keys
     // to parent nodes if they're accessed frequently
-    if (node->accessCount > 10 && node->parent != nullptr) {
+    if (node->accessCount > 10 && node != root_) {
         promoteNode(node);
     }
 }
@@ -355,67 +630,230 @@ void BTree<Key, Value>::promoteNode(std::shared_ptr<Node> node) {
 }
 
 template<typename Key, typename Value>
-void BTree<Key, Value>::startWorkerThreads(int numThreads) {
-    if (running_) {
-        return;
-    }
-    
-    running_ = true;
-    for (int i = 0; i < numThreads; i++) {
-        workerThreads_.emplace_back(&BTree::workerThread, this);
+template<typename Visit>
+void BTree<Key, Value>::searchBatch(const Key* keys, size_t count, Visit visit) {
+    TreeStats::Lock lock(treeMutex_, stats_);
+    for (size_t i = 0; i < count; i++) {
+        visit(i, static_cast<const Value*>(searchLocked(keys[i])));
     }
 }
 
 template<typename Key, typename Value>
-void BTree<Key, Value>::stopWorkerThreads() {
-    if (!running_) {
-        return;
+template<typename ValueAt, typename Result>
+size_t BTree<Key, Value>::insertBatch(const Key* keys, size_t count, ValueAt valueAt, Result* results) {
+    TreeStats::Lock lock(treeMutex_, stats_);
+    size_t inserted = 0;
+    for (size_t i = 0; i < count; i++) {
+        bool added = insertLocked(keys[i], valueAt(i));
+        if (results) results[i] = added;
+        if (added) inserted++;
     }
-    
-    running_ = false;
-    queueCondition_.notify_all();
-    
-    for (auto& thread : workerThreads_) {
-        if (thread.joinable()) {
-            thread.join();
+    return inserted;
+}
+
+template<typename Key, typename Value>
+std::shared_ptr<const FrozenIndex<Key, Value>> BTree<Key, Value>::freeze() {
+    return std::make_shared<const FrozenIndex<Key, Value>>(sort());
+}
+
+template<typename Key, typename Value>
+size_t BTree<Key, Value>::thaw(const FrozenIndex<Key, Value>& frozen) {
+    TreeStats::Lock lock(treeMutex_, stats_);
+    size_t inserted = 0;
+    frozen.forEach([&](const Key& key, const Value& value) {
+        if (insertLocked(key, value)) inserted++;
+    });
+    return inserted;
+}
+
+template<typename Key, typename Value>
+void BTree<Key, Value>::enableLazyDeletion(double tombstoneRatio) {
+    tombstoneRatio_ = std::min(std::max(tombstoneRatio, 0.0), 1.0);
+    lazyDelete_ = true;
+}
+
+template<typename Key, typename Value>
+const typename BTree<Key, Value>::Node* BTree<Key, Value>::findEntry(const Key& key, size_t& index) const {
+    // The node holding key, tombstoned or not; a plain descent that
+    // touches no access counts
+    const Node* node = root_.get();
+    while (true) {
+        size_t i = findKeyIndex(node->keys, key);
+        if (i < node->keys.size() && node->keys.equals(i, key)) {
+            index = i;
+            return node;
+        }
+        if (node->isLeaf) {
+            return nullptr;
         }
+        node = node->children[i].get();
     }
-    workerThreads_.clear();
 }
 
 template<typename Key, typename Value>
-void BTree<Key, Value>::workerThread() {
-    while (running_) {
-        std::unique_lock<std::mutex> lock(queueMutex_);
-        queueCondition_.wait(lock, [this] { 
-            return !taskQueue_.empty() || !running_; 
-        });
-        
-        if (!running_ && taskQueue_.empty()) {
-            break;
+typename BTree<Key, Value>::Node* BTree<Key, Value>::locateWritable(const Key& key, bool dead, size_t& index) {
+    const Node* found = findEntry(key, index);
+    if (found == nullptr || static_cast<bool>(found->dead[index]) != dead) {
+        return nullptr;
+    }
+    return writableEntry(const_cast<Node*>(found), key);
+}
+
+template<typename Key, typename Value>
+typename BTree<Key, Value>::Node* BTree<Key, Value>::writableEntry(Node* found, const Key& key) {
+    // found holds key. With a snapshot open, walk down again making the
+    // path writable, so only a hit ever copies nodes out from under it;
+    // the copy keeps found's keys, so indexes into it stay valid
+    if (liveSnapshots_->load(std::memory_order_acquire) == 0) {
+        return found;
+    }
+    std::shared_ptr<Node>* slot = &root_;
+    while (true) {
+        Node* node = writable(*slot).get();
+        size_t i = findKeyIndex(node->keys, key);
+        if (i < node->keys.size() && node->keys.equals(i, key)) {
+            return node;
         }
-        
-        if (!taskQueue_.empty()) {
-            auto task = taskQueue_.front();
-            taskQueue_.pop();
-            lock.unlock();
-            
-            task();
+        slot = &node->children[i];
+    }
+}
+
+template<typename Key, typename Value>
+bool BTree<Key, Value>::markDeletedLocked(const Key& key) {
+    size_t index;
+    Node* node = locateWritable(key, false, index);
+    if (node == nullptr) {
+        return false;
+    }
+    node->dead[index] = 1;
+    journal_.changed(*node);
+    tombstones_++;
+    tombstoneKeys_.push_back(key);
+    
+    // Keys revived since they were listed stay in tombstoneKeys_; once
+    // they could make up half of it, keep just one entry per tombstone
+    if (tombstoneKeys_.size() > 2 * tombstones_.load() + 64) {
+        std::sort(tombstoneKeys_.begin(), tombstoneKeys_.end());
+        tombstoneKeys_.erase(std::unique(tombstoneKeys_.begin(), tombstoneKeys_.end(),
+            [](const Key& a, const Key& b) { return !(a < b) && !(b < a); }),
+            tombstoneKeys_.end());
+        tombstoneKeys_.erase(std::remove_if(tombstoneKeys_.begin(), tombstoneKeys_.end(),
+            [this](const Key& listed) {
+                size_t i;
+                const Node* entry = findEntry(listed, i);
+                return entry == nullptr || !entry->dead[i];
+            }),
+            tombstoneKeys_.end());
+    }
+    return true;
+}
+
+template<typename Key, typename Value>
+void BTree<Key, Value>::reviveLocked(Node* found, size_t index, const Key& key, const Value& value) {
+    Node* node = writableEntry(found, key);
+    node->values[index] = value;
+    node->dead[index] = 0;
+    journal_.changed(*node);
+    tombstones_--;
+}
+
+template<typename Key, typename Value>
+size_t BTree<Key, Value>::compactBatch(bool& more) {
+    // Bounded, so that a compaction never holds the lock for long
+    constexpr size_t kBatch = 256;
+    TreeStats::Lock lock(treeMutex_, stats_);
+    size_t erased = 0;
+    for (size_t n = 0; n < kBatch && !tombstoneKeys_.empty(); n++) {
+        Key key = std::move(tombstoneKeys_.back());
+        tombstoneKeys_.pop_back();
+        size_t index;
+        const Node* node = findEntry(key, index);
+        if (node != nullptr && node->dead[index] && eraseLocked(key)) {
+            tombstones_--;
+            erased++;
         }
     }
+    more = !tombstoneKeys_.empty();
+    return erased;
+}
+
+template<typename Key, typename Value>
+void BTree<Key, Value>::compactionStep() {
+    // One batch per task, so readers and the tree's other tasks get the
+    // lock in between
+    bool more;
+    compactBatch(more);
+    if (more && enqueueTask([this]() { compactionStep(); })) {
+        return;
+    }
+    compactionScheduled_ = false;
+    // Tombstones left after the last batch looked are picked up here
+    scheduleCompaction();
+}
+
+template<typename Key, typename Value>
+void BTree<Key, Value>::scheduleCompaction() {
+    size_t dead = tombstones_.load();
+    if (dead == 0 || dead < tombstoneRatio_ * keyCount_.load()) {
+        return;
+    }
+    bool expected = false;
+    if (!compactionScheduled_.compare_exchange_strong(expected, true)) {
+        return;
+    }
+    if (!enqueueTask([this]() { compactionStep(); })) {
+        compactionScheduled_ = false;
+    }
+}
+
+template<typename Key, typename Value>
+size_t BTree<Key, Value>::compact() {
+    size_t erased = 0;
+    bool more = true;
+    while (more) {
+        erased += compactBatch(more);
+    }
+    return erased;
+}
+
+template<typename Key, typename Value>
+void BTree<Key, Value>::startWorkerThreads(int numThreads) {
+    taskGroup(numThreads);
+}
+
+template<typename Key, typename Value>
+void BTree<Key, Value>::stopWorkerThreads() {
+    // The group is never replaced, so wait outside the lock; queued tasks
+    // may still submit follow-up work through taskGroup()
+    TreeExecutor::TaskGroup* tasks;
+    {
+        std::lock_guard<std::mutex> lock(tasksMutex_);
+        tasks = tasks_.get();
+    }
+    if (tasks) {
+        tasks->wait();
+    }
+}
+
+template<typename Key, typename Value>
+TreeExecutor::TaskGroup& BTree<Key, Value>::taskGroup(int numThreads) {
+    std::lock_guard<std::mutex> lock(tasksMutex_);
+    if (!tasks_) {
+        tasks_ = std::make_unique<TreeExecutor::TaskGroup>(
+            TreeExecutor::shared(static_cast<size_t>(std::max(numThreads, 0))));
+    }
+    return *tasks_;
 }
 
 template<typename Key, typename Value>
-void BTree<Key, Value>::enqueueTask(std::function<void()> task) {
-    std::lock_guard<std::mutex> lock(queueMutex_);
-    taskQueue_.push(task);
-    queueCondition_.notify_one();
+bool BTree<Key, Value>::enqueueTask(std::function<void()> task) {
+    return taskGroup().submit(std::move(task));
 }
 
 template<typename Key, typename Value>
-void BTree<Key, Value>::insertAsync(const Key& key, const Value& value,
+bool BTree<Key, Value>::insertAsync(const Key& key, const Value& value,
                                     std::function<void(bool)> callback) {
-    enqueueTask([this, key, value, callback]() {
+    return enqueueTask([this, key, value, callback]() {
         bool result = insert(key, value);
         if (callback) {
             callback(result);
@@ -424,9 +862,9 @@ void BTree<Key, Value>::insertAsync(const Key& key, const Value& value,
 }
 
 template<typename Key, typename Value>
-void BTree<Key, Value>::deleteAsync(const Key& key,
+bool BTree<Key, Value>::deleteAsync(const Key& key,
                                    std::function<void(bool)> callback) {
-    enqueueTask([this, key, callback]() {
+    return enqueueTask([this, key, callback]() {
         bool result = remove(key);
         if (callback) {
             callback(result);
@@ -435,9 +873,9 @@ void BTree<Key, Value>::deleteAsync(const Key& key,
 }
 
 template<typename Key, typename Value>
-void BTree<Key, Value>::searchAsync(const Key& key,
+bool BTree<Key, Value>::searchAsync(const Key& key,
                                     std::function<void(Value*)> callback) {
-    enqueueTask([this, key, callback]() {
+    return enqueueTask([this, key, callback]() {
         Value* result = search(key);
         if (callback) {
             callback(result);
@@ -446,8 +884,8 @@ void BTree<Key, Value>::searchAsync(const Key& key,
 }
 
 template<typename Key, typename Value>
-void BTree<Key, Value>::sortAsync(std::function<void(std::vector<std::pair<Key, Value>>)> callback) {
-    enqueueTask([this, callback]() {
+bool BTree<Key, Value>::sortAsync(std::function<void(std::vector<std::pair<Key, Value>>)> callback) {
+    return enqueueTask([this, callback]() {
         auto result = sort();
         if (callback) {
             callback(result);
@@ -456,27 +894,91 @@ void BTree<Key, Value>::sortAsync(std::function<void(std::vector<std::pair<Key,
 }
 
 template<typename Key, typename Value>
-size_t BTree<Key, Value>::size() const {
-    std::lock_guard<std::mutex> lock(treeMutex_);
-    return calculateSize(root_);
+TreeFuture<bool> BTree<Key, Value>::insertFuture(const Key& key, const Value& value) {
+    return runAsFuture<bool>(taskGroup(), [this, key, value]() {
+        return insert(key, value);
+    });
 }
 
 template<typename Key, typename Value>
-size_t BTree<Key, Value>::calculateSize(std::shared_ptr<Node> node) const {
-    if (node == nullptr) return 0;
+TreeFuture<bool> BTree<Key, Value>::deleteFuture(const Key& key) {
+    return runAsFuture<bool>(taskGroup(), [this, key]() {
+        return remove(key);
+    });
+}
+
+template<typename Key, typename Value>
+TreeFuture<std::optional<Value>> BTree<Key, Value>::searchFuture(const Key& key) {
+    return runAsFuture<std::optional<Value>>(taskGroup(), [this, key]() {
+        std::optional<Value> copy;
+        CombinedOp op{CombinedOp::SEARCH, &key, nullptr};
+        op.copy = &copy;
+        if (runCombined(op)) {
+            return copy;
+        }
+        TreeStats::Lock lock(treeMutex_, stats_);
+        Value* value = searchLocked(key);
+        return value ? std::optional<Value>(*value) : std::nullopt;
+    });
+}
+
+template<typename Key, typename Value>
+TreeFuture<std::vector<std::pair<Key, Value>>> BTree<Key, Value>::sortFuture() {
+    return runAsFuture<std::vector<std::pair<Key, Value>>>(taskGroup(), [this]() {
+        return sort();
+    });
+}
+
+template<typename Key, typename Value>
+void BTree<Key, Value>::enableFlatCombining(size_t maxThreads) {
+    if (!combiner_) {
+        combiner_ = std::make_unique<FlatCombiner<CombinedOp>>(std::max<size_t>(maxThreads, 1));
+    }
+}
+
+template<typename Key, typename Value>
+bool BTree<Key, Value>::runCombined(CombinedOp& op) {
+    // false: combining is off or out of slots, caller takes the lock itself
+    return combiner_ && combiner_->execute(op, treeMutex_, stats_,
+        [this](std::vector<CombinedOp*>& batch) { applyCombined(batch); });
+}
+
+template<typename Key, typename Value>
+void BTree<Key, Value>::applyCombined(std::vector<CombinedOp*>& batch) {
+    // Visiting keys in order keeps consecutive operations on the same
+    // (freshly splayed) path. Operations in one batch are concurrent, so
+    // any order among equal keys is a valid one.
+    std::sort(batch.begin(), batch.end(), [](const CombinedOp* a, const CombinedOp* b) {
+        return *a->key < *b->key;
+    });
     
-    size_t count = node->keys.size();
-    if (!node->isLeaf) {
-        for (auto& child : node->children) {
-            count += calculateSize(child);
+    for (CombinedOp* op : batch) {
+        switch (op->kind) {
+            case CombinedOp::INSERT:
+                op->result = insertLocked(*op->key, *op->value);
+                break;
+            case CombinedOp::REMOVE:
+                op->result = removeLocked(*op->key);
+                break;
+            case CombinedOp::SEARCH:
+                op->found = searchLocked(*op->key);
+                if (op->copy && op->found) {
+                    *op->copy = *op->found;
+                }
+                break;
         }
     }
-    return count;
+}
+
+template<typename Key, typename Value>
+size_t BTree<Key, Value>::size() const {
+    TreeStats::Lock lock(treeMutex_, stats_);
+    return keyCount_.load() - tombstones_.load();
 }
 
 template<typename Key, typename Value>
 int BTree<Key, Value>::height() const {
-    std::lock_guard<std::mutex> lock(treeMutex_);
+    TreeStats::Lock lock(treeMutex_, stats_);
     return calculateHeight(root_);
 }
 
@@ -494,7 +996,7 @@ int BTree<Key, Value>::calculateHeight(std::shared_ptr<Node> node) const {
 
 template<typename Key, typename Value>
 void BTree<Key, Value>::setMinDegree(int degree) {
-    std::lock_guard<std::mutex> lock(treeMutex_);
+    TreeStats::Lock lock(treeMutex_, stats_);
     if (degree < 2) degree = 2;
     minDegree_ = degree;
     maxKeys_ = 2 * degree - 1;
@@ -502,54 +1004,95 @@ void BTree<Key, Value>::setMinDegree(int degree) {
     // For full restructuring, you'd need to rebuild the tree
 }
 
+template<typename Key, typename Value>
+TreeStatsReport BTree<Key, Value>::getStats() const {
+    TreeStatsReport report = stats_.report();
+    std::lock_guard<std::mutex> lock(tasksMutex_);
+    if (tasks_) {
+        report.queueDepth = tasks_->pending();
+        report.executorQueued = tasks_->executor().pendingTasks();
+    }
+    return report;
+}
+
+template<typename Key, typename Value>
+typename BTree<Key, Value>::TreeSnapshot::NodeInfo
+BTree<Key, Value>::nodeInfo(const Node& node) const {
+    typename TreeSnapshot::NodeInfo info;
+    info.id = node.id;
+    // Tombstones are left out, as search and sort leave them out
+    std::vector<Key> keys = node.keys.toVector();
+    for (size_t i = 0; i < keys.size(); i++) {
+        if (!node.dead[i]) {
+            info.keys.push_back(std::move(keys[i]));
+            info.values.push_back(node.values[i]);
+        }
+    }
+    info.isLeaf = node.isLeaf;
+    info.accessCount = node.accessCount.load();
+    info.childIds.reserve(node.children.size());
+    for (auto& child : node.children) {
+        info.childIds.push_back(child->id);
+    }
+    return info;
+}
+
 template<typename Key, typename Value>
 typename BTree<Key, Value>::TreeSnapshot BTree<Key, Value>::getSnapshot() const {
-    std::lock_guard<std::mutex> lock(treeMutex_);
+    TreeStats::Lock lock(treeMutex_, stats_);
     TreeSnapshot snapshot;
+    snapshot.version = journal_.version();
     
-    // First pass: assign indices to all nodes
-    std::map<std::shared_ptr<Node>, size_t> nodeToIndex;
-    std::function<void(std::shared_ptr<Node>)> assignIndices = 
-        [&](std::shared_ptr<Node> node) {
-            if (node == nullptr) return;
-            nodeToIndex[node] = snapshot.nodes.size();
-            typename TreeSnapshot::NodeInfo info;
-            info.keys = node->keys;
-            info.values = node->values;
-            info.isLeaf = node->isLeaf;
-            info.accessCount = node->accessCount.load();
-            snapshot.nodes.push_back(info);
-            
-            if (!node->isLeaf) {
-                for (auto& child : node->children) {
-                    assignIndices(child);
-                }
-            }
-        };
-    
-    assignIndices(root_);
-    
-    // Second pass: build edges and child indices
-    std::function<void(std::shared_ptr<Node>, size_t)> buildEdges = 
-        [&](std::shared_ptr<Node> node, size_t parentIndex) {
-            if (node == nullptr) return;
-            
-            size_t nodeIndex = nodeToIndex[node];
-            
-            if (parentIndex != SIZE_MAX) {
-                snapshot.edges.push_back({parentIndex, nodeIndex});
-            }
-            
-            if (!node->isLeaf) {
-                for (size_t i = 0; i < node->children.size(); i++) {
-                    snapshot.nodes[nodeIndex].childIndices.push_back(nodeToIndex[node->children[i]]);
-                    buildEdges(node->children[i], nodeIndex);
-                }
-            }
-        };
+    // Level order: a node's children get their indices as they are queued,
+    // so one pass fills in both nodes and edges
+    std::vector<Node*> order{root_.get()};
+    for (size_t i = 0; i < order.size(); i++) {
+        const Node& node = *order[i];
+        snapshot.nodes.push_back(nodeInfo(node));
+        for (auto& child : node.children) {
+            snapshot.nodes[i].childIndices.push_back(order.size());
+            snapshot.edges.push_back({i, order.size()});
+            order.push_back(child.get());
+        }
+    }
     
-    buildEdges(root_, SIZE_MAX);
+    // Later calls can ask for just the changes since this version
+    journal_.startTracking(order);
     return snapshot;
 }
 
+template<typename Key, typename Value>
+typename BTree<Key, Value>::SnapshotDelta BTree<Key, Value>::getSnapshotSince(uint64_t version) const {
+    SnapshotDelta delta;
+    std::vector<Node*> changed;
+    {
+        TreeStats::Lock lock(treeMutex_, stats_);
+        if (journal_.changesSince(version, changed, delta.removedIds)) {
+            delta.fromVersion = version;
+            delta.version = journal_.version();
+            delta.full = false;
+            delta.rootId = root_->id;
+            delta.nodes.reserve(changed.size());
+            for (Node* node : changed) {
+                delta.nodes.push_back(nodeInfo(*node));
+            }
+            return delta;
+        }
+    }
+    
+    TreeSnapshot snapshot = getSnapshot();
+    delta.fromVersion = version;
+    delta.version = snapshot.version;
+    delta.full = true;
+    delta.rootId = snapshot.nodes.front().id;
+    delta.nodes = std::move(snapshot.nodes);
+    return delta;
+}
+
+template<typename Key, typename Value>
+uint64_t BTree<Key, Value>::version() const {
+    TreeStats::Lock lock(treeMutex_, stats_);
+    return journal_.version();
+}
+
 #endif // BTREE_TPP
@@ -1,14 +1,16 @@
 #include "BTreeBridge.h"
 #include "BTree.h"
 #include <string>
-#include <map>
+#include "BridgeBatch.h"
+#include "TraceLog.h"
 #include <cstring>
+#include <algorithm>
 
 extern "C" {
 
 struct BTreeWrapper {
     BTree<int, std::string>* tree;
-    std::map<int, std::string> valueCache; // Cache for returned strings
+    TraceRecorder trace;
     
     BTreeWrapper(int minDegree) : tree(new BTree<int, std::string>(minDegree)) {}
     ~BTreeWrapper() {
@@ -32,13 +34,16 @@ void btree_destroy(BTreeHandle handle) {
 int btree_insert(BTreeHandle handle, int key, const char* value) {
     if (!handle) return 0;
     BTreeWrapper* wrapper = static_cast<BTreeWrapper*>(handle);
-    bool result = wrapper->tree->insert(key, std::string(value ? value : ""));
+    std::string stored(value ? value : "");
+    wrapper->trace.record(TraceOp::INSERT, key, static_cast<uint32_t>(stored.size()));
+    bool result = wrapper->tree->insert(key, stored);
     return result ? 1 : 0;
 }
 
 int btree_remove(BTreeHandle handle, int key) {
     if (!handle) return 0;
     BTreeWrapper* wrapper = static_cast<BTreeWrapper*>(handle);
+    wrapper->trace.record(TraceOp::REMOVE, key);
     bool result = wrapper->tree->remove(key);
     return result ? 1 : 0;
 }
@@ -46,12 +51,66 @@ int btree_remove(BTreeHandle handle, int key) {
 const char* btree_search(BTreeHandle handle, int key) {
     if (!handle) return nullptr;
     BTreeWrapper* wrapper = static_cast<BTreeWrapper*>(handle);
-    std::string* result = wrapper->tree->search(key);
-    if (result) {
-        wrapper->valueCache[key] = *result;
-        return wrapper->valueCache[key].c_str();
+    wrapper->trace.record(TraceOp::SEARCH, key);
+    // Copied under the tree lock into a per-thread buffer, so other
+    // threads searching or writing the handle cannot change it
+    thread_local std::string value;
+    bool found = false;
+    wrapper->tree->searchBatch(&key, 1, [&found](size_t, const std::string* result) {
+        if (result) {
+            value = *result;
+            found = true;
+        }
+    });
+    return found ? value.c_str() : nullptr;
+}
+
+int btree_search_batch(BTreeHandle handle, const int* keys, int count,
+                       void* out, size_t outCapacity, size_t* outSize) {
+    if (!handle || count < 0 || (count > 0 && !keys) || (outCapacity > 0 && !out) || !outSize) {
+        return BTREE_BATCH_INVALID_ARGUMENT;
     }
-    return nullptr;
+    BTreeWrapper* wrapper = static_cast<BTreeWrapper*>(handle);
+    
+    wrapper->trace.recordBatch(TraceOp::SEARCH, keys, static_cast<size_t>(count),
+                               [](size_t) { return 0u; });
+    
+    // Records are copied straight out of the tree while the lock is held
+    unsigned char* bytes = static_cast<unsigned char*>(out);
+    size_t used = 0;
+    bool overflow = false;
+    wrapper->tree->searchBatch(keys, static_cast<size_t>(count),
+        [&](size_t, const std::string* value) {
+            BatchRecords::put(bytes, outCapacity, used, overflow, value);
+        });
+    
+    *outSize = used;
+    return overflow ? BTREE_BATCH_BUFFER_TOO_SMALL : BTREE_BATCH_OK;
+}
+
+int btree_insert_batch(BTreeHandle handle, const int* keys, int count,
+                       const void* values, size_t valuesSize, int* results) {
+    if (!handle || count < 0 || (count > 0 && !keys) || (valuesSize > 0 && !values)) {
+        return BTREE_BATCH_INVALID_ARGUMENT;
+    }
+    BTreeWrapper* wrapper = static_cast<BTreeWrapper*>(handle);
+    
+    const unsigned char* bytes = static_cast<const unsigned char*>(values);
+    if (!BatchRecords::validate(bytes, valuesSize, static_cast<size_t>(count))) {
+        return BTREE_BATCH_INVALID_ARGUMENT;
+    }
+    if (wrapper->trace.active()) {
+        size_t cursor = 0;
+        wrapper->trace.recordBatch(TraceOp::INSERT, keys, static_cast<size_t>(count),
+                                   [&](size_t) { return BatchRecords::skip(bytes, cursor); });
+    }
+    
+    // valueAt is called for i = 0, 1, ... in turn, so one cursor walks the records
+    size_t offset = 0;
+    wrapper->tree->insertBatch(keys, static_cast<size_t>(count),
+        [&](size_t) { return BatchRecords::take(bytes, offset); },
+        results);
+    return BTREE_BATCH_OK;
 }
 
 void btree_start_threads(BTreeHandle handle, int numThreads) {
@@ -84,8 +143,58 @@ void btree_set_min_degree(BTreeHandle handle, int degree) {
     wrapper->tree->setMinDegree(degree);
 }
 
+static BTreeStats toBridgeStats(const TreeStatsReport& report) {
+    BTreeStats stats;
+    std::memset(&stats, 0, sizeof(stats));
+    stats.enabled = report.enabled ? 1 : 0;
+    stats.lookups = report[TreeCounter::LOOKUPS];
+    stats.nodesVisited = report[TreeCounter::NODES_VISITED];
+    stats.rotations = report[TreeCounter::ROTATIONS];
+    stats.splits = report[TreeCounter::SPLITS];
+    stats.merges = report[TreeCounter::MERGES];
+    stats.lockAcquisitions = report[TreeCounter::LOCK_ACQUISITIONS];
+    stats.lockContended = report[TreeCounter::LOCK_CONTENDED];
+    stats.lockWaitNs = report[TreeCounter::LOCK_WAIT_NS];
+    stats.queueDepth = report.queueDepth;
+    stats.executorQueued = report.executorQueued;
+    static_assert(TreeStatsReport::kBuckets == BTREE_STATS_BUCKETS, "bucket count mismatch");
+    std::copy(report.lockWaitNs, report.lockWaitNs + BTREE_STATS_BUCKETS, stats.lockWaitHistogram);
+    std::copy(report.nodesPerLookup, report.nodesPerLookup + BTREE_STATS_BUCKETS, stats.nodesPerLookupHistogram);
+    return stats;
+}
+
+int btree_trace_start(BTreeHandle handle, const char* path) {
+    if (!handle || !path) return 0;
+    BTreeWrapper* wrapper = static_cast<BTreeWrapper*>(handle);
+    return wrapper->trace.start(path, TraceSource::BTREE) ? 1 : 0;
+}
+
+int btree_trace_stop(BTreeHandle handle) {
+    if (!handle) return 0;
+    BTreeWrapper* wrapper = static_cast<BTreeWrapper*>(handle);
+    return wrapper->trace.stop() ? 1 : 0;
+}
+
+BTreeStats btree_get_stats(BTreeHandle handle) {
+    if (!handle) return toBridgeStats(TreeStatsReport());
+    BTreeWrapper* wrapper = static_cast<BTreeWrapper*>(handle);
+    return toBridgeStats(wrapper->tree->getStats());
+}
+
+void btree_reset_stats(BTreeHandle handle) {
+    if (!handle) return;
+    BTreeWrapper* wrapper = static_cast<BTreeWrapper*>(handle);
+    wrapper->tree->resetStats();
+}
+
+void btree_enable_stats_histograms(BTreeHandle handle, int enable) {
+    if (!handle) return;
+    BTreeWrapper* wrapper = static_cast<BTreeWrapper*>(handle);
+    wrapper->tree->enableStatsHistograms(enable != 0);
+}
+
 BTreeSnapshot btree_get_snapshot(BTreeHandle handle) {
-    BTreeSnapshot snapshot = {0};
+    BTreeSnapshot snapshot = {};
     if (!handle) return snapshot;
     
     BTreeWrapper* wrapper = static_cast<BTreeWrapper*>(handle);
@@ -159,4 +268,150 @@ void btree_free_snapshot(BTreeSnapshot snapshot) {
     delete[] snapshot.edges;
 }
 
+BTreeSnapshotDelta btree_get_snapshot_since(BTreeHandle handle, uint64_t version) {
+    BTreeSnapshotDelta delta = {};
+    if (!handle) return delta;
+    
+    BTreeWrapper* wrapper = static_cast<BTreeWrapper*>(handle);
+    auto treeDelta = wrapper->tree->getSnapshotSince(version);
+    
+    delta.fromVersion = treeDelta.fromVersion;
+    delta.version = treeDelta.version;
+    delta.isFull = treeDelta.full ? 1 : 0;
+    delta.rootId = treeDelta.rootId;
+    delta.nodeCount = static_cast<int>(treeDelta.nodes.size());
+    delta.removedCount = static_cast<int>(treeDelta.removedIds.size());
+    
+    if (delta.removedCount > 0) {
+        delta.removedIds = new uint64_t[delta.removedCount];
+        std::copy(treeDelta.removedIds.begin(), treeDelta.removedIds.end(), delta.removedIds);
+    }
+    if (delta.nodeCount == 0) return delta;
+    
+    delta.nodeIds = new uint64_t[delta.nodeCount];
+    delta.keys = new int*[delta.nodeCount];
+    delta.values = new char**[delta.nodeCount];
+    delta.keyCounts = new int[delta.nodeCount];
+    delta.childIds = new uint64_t*[delta.nodeCount];
+    delta.childCounts = new int[delta.nodeCount];
+    delta.isLeaf = new int[delta.nodeCount];
+    delta.accessCount = new int[delta.nodeCount];
+    
+    for (int i = 0; i < delta.nodeCount; i++) {
+        const auto& node = treeDelta.nodes[i];
+        delta.nodeIds[i] = node.id;
+        delta.keyCounts[i] = static_cast<int>(node.keys.size());
+        delta.childCounts[i] = static_cast<int>(node.childIds.size());
+        
+        delta.keys[i] = new int[delta.keyCounts[i]];
+        delta.values[i] = new char*[delta.keyCounts[i]];
+        for (int j = 0; j < delta.keyCounts[i]; j++) {
+            delta.keys[i][j] = node.keys[j];
+            delta.values[i][j] = new char[node.values[j].length() + 1];
+            strcpy(delta.values[i][j], node.values[j].c_str());
+        }
+        
+        delta.childIds[i] = new uint64_t[delta.childCounts[i]];
+        std::copy(node.childIds.begin(), node.childIds.end(), delta.childIds[i]);
+        
+        delta.isLeaf[i] = node.isLeaf ? 1 : 0;
+        delta.accessCount[i] = node.accessCount;
+    }
+    
+    return delta;
+}
+
+void btree_free_snapshot_delta(BTreeSnapshotDelta delta) {
+    delete[] delta.removedIds;
+    if (delta.nodeCount == 0) return;
+    
+    for (int i = 0; i < delta.nodeCount; i++) {
+        for (int j = 0; j < delta.keyCounts[i]; j++) {
+            delete[] delta.values[i][j];
+        }
+        delete[] delta.keys[i];
+        delete[] delta.values[i];
+        delete[] delta.childIds[i];
+    }
+    
+    delete[] delta.nodeIds;
+    delete[] delta.keys;
+    delete[] delta.values;
+    delete[] delta.keyCounts;
+    delete[] delta.childIds;
+    delete[] delta.childCounts;
+    delete[] delta.isLeaf;
+    delete[] delta.accessCount;
+}
+
+struct BTreeBytesWrapper {
+    BTree<std::string, std::string>* tree;
+    
+    BTreeBytesWrapper(int minDegree) : tree(new BTree<std::string, std::string>(minDegree)) {}
+    ~BTreeBytesWrapper() {
+        if (tree) {
+            tree->stopWorkerThreads();
+            delete tree;
+        }
+    }
+};
+
+static std::string bytesKey(const void* key, size_t keyLength) {
+    return key ? std::string(static_cast<const char*>(key), keyLength) : std::string();
+}
+
+BTreeBytesHandle btree_bytes_create(int minDegree) {
+    return new BTreeBytesWrapper(minDegree);
+}
+
+void btree_bytes_destroy(BTreeBytesHandle handle) {
+    if (handle) {
+        delete static_cast<BTreeBytesWrapper*>(handle);
+    }
+}
+
+int btree_bytes_insert(BTreeBytesHandle handle, const void* key, size_t keyLength,
+                       const char* value) {
+    if (!handle || (!key && keyLength > 0)) return 0;
+    BTreeBytesWrapper* wrapper = static_cast<BTreeBytesWrapper*>(handle);
+    bool result = wrapper->tree->insert(bytesKey(key, keyLength), std::string(value ? value : ""));
+    return result ? 1 : 0;
+}
+
+int btree_bytes_remove(BTreeBytesHandle handle, const void* key, size_t keyLength) {
+    if (!handle || (!key && keyLength > 0)) return 0;
+    BTreeBytesWrapper* wrapper = static_cast<BTreeBytesWrapper*>(handle);
+    bool result = wrapper->tree->remove(bytesKey(key, keyLength));
+    return result ? 1 : 0;
+}
+
+const char* btree_bytes_search(BTreeBytesHandle handle, const void* key, size_t keyLength) {
+    if (!handle || (!key && keyLength > 0)) return nullptr;
+    BTreeBytesWrapper* wrapper = static_cast<BTreeBytesWrapper*>(handle);
+    std::string lookup = bytesKey(key, keyLength);
+    // Copied under the tree lock into a per-thread buffer, so other
+    // threads searching or writing the handle cannot change it
+    thread_local std::string value;
+    bool found = false;
+    wrapper->tree->searchBatch(&lookup, 1, [&found](size_t, const std::string* result) {
+        if (result) {
+            value = *result;
+            found = true;
+        }
+    });
+    return found ? value.c_str() : nullptr;
+}
+
+int btree_bytes_size(BTreeBytesHandle handle) {
+    if (!handle) return 0;
+    BTreeBytesWrapper* wrapper = static_cast<BTreeBytesWrapper*>(handle);
+    return static_cast<int>(wrapper->tree->size());
+}
+
+int btree_bytes_height(BTreeBytesHandle handle) {
+    if (!handle) return 0;
+    BTreeBytesWrapper* wrapper = static_cast<BTreeBytesWrapper*>(handle);
+    return wrapper->tree->height();
+}
+
 } // extern "C"
@@ -6,6 +6,9 @@
 #ifndef BTREEBRIDGE_H
 #define BTREEBRIDGE_H
 
+#include <stdint.h>
+#include <stddef.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -17,6 +20,8 @@ BTreeHandle btree_create(int minDegree);
 void btree_destroy(BTreeHandle handle);
 int btree_insert(BTreeHandle handle, int key, const char* value);
 int btree_remove(BTreeHandle handle, int key);
+// The returned string is the calling thread's own copy and stays valid
+// until that thread's next btree_search
 const char* btree_search(BTreeHandle handle, int key);
 void btree_start_threads(BTreeHandle handle, int numThreads);
 void btree_stop_threads(BTreeHandle handle);
@@ -24,6 +29,68 @@ int btree_size(BTreeHandle handle);
 int btree_height(BTreeHandle handle);
 void btree_set_min_degree(BTreeHandle handle, int degree);
 
+// Batched operations. Each takes the tree lock once for the whole batch
+// and allocates nothing per call beyond the stored values themselves.
+//
+// Values travel as length-prefixed records packed back to back: a
+// uint32_t byte count in native byte order, then that many bytes (no
+// terminator). A missing key is a record with length
+// BTREE_BATCH_NOT_FOUND and no bytes.
+#define BTREE_BATCH_OK                0
+#define BTREE_BATCH_BUFFER_TOO_SMALL  (-1)
+#define BTREE_BATCH_INVALID_ARGUMENT  (-2)
+#define BTREE_BATCH_NOT_FOUND         0xFFFFFFFFu
+
+// Looks up keys[0..count) and writes one record per key into out. Returns
+// BTREE_BATCH_BUFFER_TOO_SMALL if they do not all fit; *outSize is then
+// the capacity needed (the searches have run, and out holds the records
+// that fit). On success *outSize is the number of bytes written.
+int btree_search_batch(BTreeHandle handle, const int* keys, int count,
+                       void* out, size_t outCapacity, size_t* outSize);
+
+// Inserts keys[i] with the i-th record of values (valuesSize bytes,
+// exactly count records). results, if not NULL, receives 1 per key that
+// was inserted and 0 per key that already existed. The records are
+// validated before the tree is touched.
+int btree_insert_batch(BTreeHandle handle, const int* keys, int count,
+                       const void* values, size_t valuesSize, int* results);
+
+// Hot-path counters, all zero (and enabled 0) unless the library was
+// built with TREE_ENABLE_STATS. Histogram bucket 0 counts zeros and
+// bucket i counts values in [2^(i-1), 2^i); they fill only after
+// btree_enable_stats_histograms. queueDepth and executorQueued are read
+// live either way.
+#define BTREE_STATS_BUCKETS 32
+
+typedef struct {
+    int enabled;
+    uint64_t lookups;
+    uint64_t nodesVisited;
+    uint64_t rotations;          // Borrows through the parent
+    uint64_t splits;
+    uint64_t merges;
+    uint64_t lockAcquisitions;
+    uint64_t lockContended;
+    uint64_t lockWaitNs;
+    uint64_t queueDepth;         // This tree's queued or running async tasks
+    uint64_t executorQueued;     // Tasks queued on the shared executor
+    uint64_t lockWaitHistogram[BTREE_STATS_BUCKETS];      // ns, contended only
+    uint64_t nodesPerLookupHistogram[BTREE_STATS_BUCKETS];
+} BTreeStats;
+
+BTreeStats btree_get_stats(BTreeHandle handle);
+void btree_reset_stats(BTreeHandle handle);
+void btree_enable_stats_histograms(BTreeHandle handle, int enable);
+
+// Operation tracing for tree_replay (format in TraceLog.h). While a trace
+// is running every insert, remove and search on handle, batched or not,
+// is appended to the file at path with its key, calling thread and time.
+// Starting a trace ends any current one. btree_trace_start returns 0 if
+// the file cannot be created; btree_trace_stop returns 0 if writing any
+// part of the trace failed.
+int btree_trace_start(BTreeHandle handle, const char* path);
+int btree_trace_stop(BTreeHandle handle);
+
 // Snapshot for visualization
 typedef struct {
     int** keys;           // Array of arrays: keys[i] is keys for node i
@@ -41,6 +108,50 @@ typedef struct {
 BTreeSnapshot btree_get_snapshot(BTreeHandle handle);
 void btree_free_snapshot(BTreeSnapshot snapshot);
 
+// Incremental snapshot: the nodes added or modified since a version and
+// the ids of nodes removed since then. Start with version 0 and pass the
+// returned version on the next call. Nodes are identified by id, and a
+// listed node's childIds replace its previous children. If the tree can
+// no longer tell what changed, isFull is set: nodes then holds the whole
+// tree and earlier state should be discarded.
+typedef struct {
+    uint64_t fromVersion;
+    uint64_t version;
+    int isFull;
+    uint64_t rootId;
+    uint64_t* nodeIds;
+    int** keys;
+    char*** values;
+    int* keyCounts;
+    uint64_t** childIds;
+    int* childCounts;
+    int* isLeaf;
+    int* accessCount;
+    int nodeCount;
+    uint64_t* removedIds;
+    int removedCount;
+} BTreeSnapshotDelta;
+
+BTreeSnapshotDelta btree_get_snapshot_since(BTreeHandle handle, uint64_t version);
+void btree_free_snapshot_delta(BTreeSnapshotDelta delta);
+
+// Trees keyed by byte strings (paths, URLs, binary ids). Keys may hold
+// any bytes, including NUL, and are ordered bytewise with a shorter key
+// first when one is a prefix of the other. Nodes store them
+// prefix-compressed, so keys sharing long prefixes are cheap.
+typedef void* BTreeBytesHandle;
+
+BTreeBytesHandle btree_bytes_create(int minDegree);
+void btree_bytes_destroy(BTreeBytesHandle handle);
+int btree_bytes_insert(BTreeBytesHandle handle, const void* key, size_t keyLength,
+                       const char* value);
+int btree_bytes_remove(BTreeBytesHandle handle, const void* key, size_t keyLength);
+// The returned string is the calling thread's own copy and stays valid
+// until that thread's next btree_bytes_search
+const char* btree_bytes_search(BTreeBytesHandle handle, const void* key, size_t keyLength);
+int btree_bytes_size(BTreeBytesHandle handle);
+int btree_bytes_height(BTreeBytesHandle handle);
+
 #ifdef __cplusplus
 }
 #endif
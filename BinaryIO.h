@@ -0,0 +1,58 @@
+/*
+ * Binary IO
+ * Copyright (C) 2025, Shyamal Suhana Chandra
+ * All rights reserved.
+ */
+
+#ifndef BINARY_IO_H
+#define BINARY_IO_H
+
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstddef>
+#include <cstdint>
+
+// Pieces shared by the on-disk formats (TraceLog.h, AccessStats.h):
+// LEB128 varints over a byte buffer, and reading a whole file into one.
+namespace binary_io {
+
+inline void putVarint(std::vector<unsigned char>& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<unsigned char>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<unsigned char>(value));
+}
+
+// False at the end of data or on a varint longer than 64 bits
+inline bool getVarint(const std::vector<unsigned char>& data, size_t& offset, uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (offset >= data.size()) return false;
+        unsigned char byte = data[offset++];
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+// Replaces data with the contents of path; false if the file cannot be
+// opened or a read fails
+inline bool readFile(const std::string& path, std::vector<unsigned char>& data) {
+    data.clear();
+    std::FILE* file = std::fopen(path.c_str(), "rb");
+    if (!file) return false;
+    unsigned char chunk[64 * 1024];
+    size_t read;
+    while ((read = std::fread(chunk, 1, sizeof(chunk), file)) > 0) {
+        data.insert(data.end(), chunk, chunk + read);
+    }
+    bool readFailed = std::ferror(file) != 0;
+    std::fclose(file);
+    return !readFailed;
+}
+
+} // namespace binary_io
+
+#endif // BINARY_IO_H
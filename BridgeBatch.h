@@ -0,0 +1,73 @@
+/*
+ * Bridge Batch Records
+ * Copyright (C) 2025, Shyamal Suhana Chandra
+ * All rights reserved.
+ */
+
+#ifndef BRIDGE_BATCH_H
+#define BRIDGE_BATCH_H
+
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+
+// Length-prefixed value records used by the C bridges' batch calls: a
+// uint32_t byte count in native byte order followed by the bytes, packed
+// back to back. kNotFound as the count marks a missing value.
+struct BatchRecords {
+    static constexpr uint32_t kNotFound = 0xFFFFFFFFu;
+
+    // Appends the record for value (nullptr: not found) while records
+    // still fit; used always advances, so afterwards it is the capacity
+    // the whole batch needs. Once one record does not fit, no later one
+    // is written either, so out only ever holds a complete prefix.
+    static void put(unsigned char* out, size_t capacity, size_t& used,
+                    bool& overflow, const std::string* value) {
+        uint32_t length = value ? static_cast<uint32_t>(value->size()) : kNotFound;
+        size_t size = sizeof(length) + (value ? value->size() : 0);
+        if (!overflow && used + size <= capacity) {
+            std::memcpy(out + used, &length, sizeof(length));
+            if (value) {
+                std::memcpy(out + used + sizeof(length), value->data(), value->size());
+            }
+        } else {
+            overflow = true;
+        }
+        used += size;
+    }
+
+    // True if data holds exactly count well-formed records with values
+    static bool validate(const unsigned char* data, size_t size, size_t count) {
+        size_t offset = 0;
+        for (size_t i = 0; i < count; i++) {
+            uint32_t length;
+            if (size - offset < sizeof(length)) return false;
+            std::memcpy(&length, data + offset, sizeof(length));
+            offset += sizeof(length);
+            if (length == kNotFound || size - offset < length) return false;
+            offset += length;
+        }
+        return offset == size;
+    }
+
+    // The record at offset (already validated), advancing offset past it
+    static std::string take(const unsigned char* data, size_t& offset) {
+        uint32_t length;
+        std::memcpy(&length, data + offset, sizeof(length));
+        offset += sizeof(length);
+        std::string value(reinterpret_cast<const char*>(data + offset), length);
+        offset += length;
+        return value;
+    }
+
+    // Like take, but only returns the record's length
+    static uint32_t skip(const unsigned char* data, size_t& offset) {
+        uint32_t length;
+        std::memcpy(&length, data + offset, sizeof(length));
+        offset += sizeof(length) + length;
+        return length;
+    }
+};
+
+#endif // BRIDGE_BATCH_H
@@ -0,0 +1,7 @@
+// Explicit template instantiations
+#include "CircularBufferSplayTree.h"
+
+template class CircularBufferSplayTree<int, int>;
+template class CircularBufferSplayTree<int, std::string>;
+template class CircularBufferSplayTree<std::string, int>;
+template class CircularBufferSplayTree<std::string, std::string>;
@@ -15,6 +15,17 @@
 #include <algorithm>
 #include <string>
 #include <type_traits>
+#include <cstdint>
+#include <limits>
+#include <charconv>
+#include <sstream>
+#include <string_view>
+#include <chrono>
+#include <thread>
+#include <condition_variable>
+#include "TreeStats.h"
+#include "ParallelExport.h"
+#include "AccessStats.h"
 
 enum class SortMode {
     LEXICOGRAPHIC,  // String comparison
@@ -27,22 +38,112 @@ enum class SortOrder {
     DESCENDING
 };
 
-template<typename Key, typename Value>
+namespace comparator_detail {
+
+// Keys that already are strings compare directly in lexicographic mode;
+// anything else is compared through its formatted text.
+template<typename Key>
+constexpr bool kIsStringLike = std::is_convertible_v<const Key&, std::string_view>;
+
+template<typename Key>
+std::string lexicographicKey(const Key& key) {
+    if constexpr (std::is_integral_v<Key> && !std::is_same_v<Key, bool>) {
+        char buffer[24];
+        auto result = std::to_chars(buffer, buffer + sizeof(buffer), key);
+        return std::string(buffer, result.ptr);
+    } else {
+        std::ostringstream oss;
+        oss << key;
+        return oss.str();
+    }
+}
+
+template<typename Key>
+bool lexicographicLess(const Key& a, const Key& b) {
+    if constexpr (kIsStringLike<Key>) {
+        return std::string_view(a) < std::string_view(b);
+    } else {
+        return lexicographicKey(a) < lexicographicKey(b);
+    }
+}
+
+} // namespace comparator_detail
+
+// Comparator policies. CircularBufferSplayTree calls the policy's
+// per-mode less-than directly, so a policy without std::function members
+// inlines into findNode, insert and the splay descent.
+//
+// RuntimeComparator keeps the configurable behaviour: each mode uses its
+// built-in comparison until a custom std::function is installed.
+template<typename Key>
+class RuntimeComparator {
+public:
+    static constexpr bool kConfigurable = true;
+    
+    bool lexicographicLess(const Key& a, const Key& b) const {
+        return lexicographic_ ? lexicographic_(a, b) : comparator_detail::lexicographicLess(a, b);
+    }
+    bool numericLess(const Key& a, const Key& b) const {
+        return numeric_ ? numeric_(a, b) : a < b;
+    }
+    bool semanticLess(const Key& a, const Key& b) const {
+        return semantic_ ? semantic_(a, b) : a < b;  // Default to numeric
+    }
+    
+    // Cached formatted keys are only valid for the built-in ordering
+    bool cachesLexicographicKeys() const { return !lexicographic_; }
+    
+    void setLexicographic(std::function<bool(const Key&, const Key&)> cmp) { lexicographic_ = cmp; }
+    void setNumeric(std::function<bool(const Key&, const Key&)> cmp) { numeric_ = cmp; }
+    void setSemantic(std::function<bool(const Key&, const Key&)> cmp) { semantic_ = cmp; }
+    
+private:
+    std::function<bool(const Key&, const Key&)> lexicographic_;
+    std::function<bool(const Key&, const Key&)> numeric_;
+    std::function<bool(const Key&, const Key&)> semantic_;
+};
+
+// NaturalComparator fixes every mode at compile time: operator< for
+// numeric and semantic, formatted text for lexicographic.
+template<typename Key>
+struct NaturalComparator {
+    static constexpr bool kConfigurable = false;
+    
+    bool lexicographicLess(const Key& a, const Key& b) const {
+        return comparator_detail::lexicographicLess(a, b);
+    }
+    bool numericLess(const Key& a, const Key& b) const { return a < b; }
+    bool semanticLess(const Key& a, const Key& b) const { return a < b; }
+    bool cachesLexicographicKeys() const { return true; }
+};
+
+template<typename Key, typename Value, typename Compare = RuntimeComparator<Key>>
 class CircularBufferSplayTree {
 public:
+    // Nodes live inline in a slab preallocated at construction and are
+    // linked by 32-bit slot numbers; slot i is also ring position i.
+    using NodeIndex = uint32_t;
+    static constexpr NodeIndex kNullIndex = std::numeric_limits<NodeIndex>::max();
+    using Clock = std::chrono::steady_clock;
+    
+    // Splay links of one slot within one ordering
+    struct Link {
+        NodeIndex left;
+        NodeIndex right;
+        NodeIndex parent;
+        int subtreeSize;
+        
+        Link() : left(kNullIndex), right(kNullIndex), parent(kNullIndex), subtreeSize(0) {}
+    };
+    
     struct Node {
         Key key;
         Value value;
-        std::shared_ptr<Node> left;
-        std::shared_ptr<Node> right;
-        std::shared_ptr<Node> parent;
-        std::atomic<int> accessCount;
-        std::atomic<int> subtreeSize;
-        size_t bufferIndex;  // Index in circular buffer
+        Link link;  // Links in the primary (defaultSortMode_) ordering
+        int accessCount;
+        bool occupied;
         
-        Node(const Key& k, const Value& v, size_t idx)
-            : key(k), value(v), left(nullptr), right(nullptr), parent(nullptr),
-              accessCount(0), subtreeSize(1), bufferIndex(idx) {}
+        Node() : key(), value(), link(), accessCount(0), occupied(false) {}
     };
     
     CircularBufferSplayTree(size_t bufferSize = 1024, 
@@ -60,71 +161,244 @@ public:
     std::vector<std::pair<Key, Value>> sortAscending(SortMode mode = SortMode::NUMERIC);
     std::vector<std::pair<Key, Value>> sortDescending(SortMode mode = SortMode::NUMERIC);
     
+    // sort() with the tree walk split across the shared executor: subtrees
+    // of the ordering are written concurrently at offsets given by their
+    // sizes, into an output sized once
+    std::vector<std::pair<Key, Value>> sortParallel(SortOrder order = SortOrder::ASCENDING,
+                                                   SortMode mode = SortMode::NUMERIC);
+    
+    // Entries with low <= key <= high under the given mode, ascending
+    std::vector<std::pair<Key, Value>> range(const Key& low, const Key& high,
+                                            SortMode mode = SortMode::NUMERIC);
+    
+    // Secondary orderings: extra splay indexes over the same slots, kept
+    // up to date on every insert and eviction so that sort() and range()
+    // in a registered mode are plain tree walks.
+    bool addOrdering(SortMode mode);
+    bool removeOrdering(SortMode mode);
+    bool hasOrdering(SortMode mode) const;
+    
     // Splay operation
-    void splay(std::shared_ptr<Node> node);
+    void splay(NodeIndex node);
     
     // Buffer management
     void setBufferSize(size_t size);
     size_t getBufferSize() const { return bufferSize_; }
-    size_t getCurrentSize() const { return currentSize_; }
+    size_t getCurrentSize() const { return size(); }
+    
+    // Time-based expiry: entries older than the window are treated as
+    // absent and reclaimed oldest-first by walking the ring, at most
+    // batchSize per insert, or all at once by tick(). Updating an existing
+    // key keeps its original insertion time. size() leaves out expired
+    // entries that are still waiting to be reclaimed.
+    void setExpiryWindow(Clock::duration window, size_t batchSize = 64);
+    void disableExpiry();
+    bool expiryEnabled() const { return expiryWindow_ > Clock::duration::zero(); }
+    Clock::duration getExpiryWindow() const { return expiryWindow_; }
+    size_t tick();
+    size_t tick(Clock::time_point now);
+    
+    // Lock-free ingest: producers publish inserts into a bounded MPSC ring
+    // without taking treeMutex_; a single applier drains it in batches,
+    // holding the tree lock once per batch and inserting in enqueue order,
+    // so ring slots and eviction follow arrival as with insert(). Entries
+    // become visible (and get their expiry timestamp) when applied.
+    // enableIngest must be called before producers start; the capacity
+    // rounds up to a power of two.
+    void enableIngest(size_t capacity = 4096);
+    bool ingestEnabled() const { return ingestMask_ != 0; }
+    bool tryEnqueueInsert(const Key& key, const Value& value);  // false when full
+    void enqueueInsert(const Key& key, const Value& value);     // helps drain when full
+    size_t drainIngest(size_t maxBatch = std::numeric_limits<size_t>::max());
+    // Read-your-writes barrier: returns once everything enqueued before
+    // the call has been applied to the tree
+    void flushIngest();
+    // Optional background applier; without it, drainIngest/flushIngest apply
+    void startIngestApplier();
+    void stopIngestApplier();
+    
+    // Hot keys: an indexed max-heap of live slots by accessCount, updated
+    // on search, insert and eviction, so topK(k) costs O(k log k) instead
+    // of a sort of the window. Off by default; enabling it builds the heap
+    // from the current window. Without it topK falls back to a scan.
+    void enableAccessTracking();
+    void disableAccessTracking();
+    bool accessTrackingEnabled() const { return accessTracking_; }
+    std::vector<std::pair<Key, int>> topK(size_t k);  // (key, accessCount), hottest first
+    
+    // Warm start (AccessStats.h): accessStats() lists the live entries'
+    // access counts in primary order; applyAccessStats() copies counts
+    // onto the keys present here and rebuilds the primary ordering with
+    // every node the weighted median (by accessCount + 1) of its range,
+    // so hot keys start near the root. Returns how many keys matched.
+    std::vector<AccessStat<Key>> accessStats() const;
+    size_t applyAccessStats(const std::vector<AccessStat<Key>>& stats);
     
     // Statistics
-    size_t size() const { return currentSize_; }
+    size_t size() const;
     int height() const;
     double averageDepth() const;
     
-    // Custom comparison functions
+    // Hot-path counters (TreeStats.h); zero unless built with
+    // TREE_ENABLE_STATS. Rotations count every ordering; queueDepth is
+    // the ingest backlog and is filled in either way.
+    TreeStatsReport getStats() const;
+    void resetStats() { stats_.reset(); }
+    void enableStatsHistograms(bool on = true) { stats_.enableHistograms(on); }
+    
+    // Custom comparison functions (RuntimeComparator-style policies only)
     void setLexicographicComparator(std::function<bool(const Key&, const Key&)> cmp);
     void setNumericComparator(std::function<bool(const Key&, const Key&)> cmp);
     void setSemanticComparator(std::function<bool(const Key&, const Key&)> cmp);
     
 private:
+    struct SecondaryOrdering {
+        SortMode mode;
+        NodeIndex root;
+        std::vector<Link> links;  // Indexed by slot
+    };
+    
+    // Ordering 0 is the primary index (links inline in Node); ordering
+    // i > 0 is secondary_[i - 1].
+    static constexpr size_t kPrimary = 0;
+    
     size_t bufferSize_;
     size_t currentSize_;
     size_t nextIndex_;
-    std::vector<std::shared_ptr<Node>> circularBuffer_;
-    std::shared_ptr<Node> root_;
+    std::vector<Node> slab_;
+    NodeIndex root_;
+    std::vector<SecondaryOrdering> secondary_;
     mutable std::mutex treeMutex_;
+    mutable TreeStats stats_;
     SortMode defaultSortMode_;
     
-    // Custom comparators
-    std::function<bool(const Key&, const Key&)> lexicographicCmp_;
-    std::function<bool(const Key&, const Key&)> numericCmp_;
-    std::function<bool(const Key&, const Key&)> semanticCmp_;
+    // Comparator policy
+    Compare compare_;
+    
+    // Formatted keys for lexicographic comparisons, indexed by slot; only
+    // populated while a lexicographic ordering is registered and the
+    // policy's built-in lexicographic comparison is in effect.
+    std::vector<std::string> lexicographicKeys_;
+    bool lexicographicKeysCached_;
+    
+    // Expiry state. timestamps_ is indexed by slot and only allocated while
+    // expiry is enabled. expiryCursor_ is the oldest ring position not yet
+    // examined; pendingExpiry_ counts positions written since then.
+    Clock::duration expiryWindow_;
+    size_t expiryBatch_;
+    std::vector<Clock::time_point> timestamps_;
+    size_t expiryCursor_;
+    size_t pendingExpiry_;
+    
+    // Access heap: accessHeap_ holds live slots in max-heap order of
+    // accessCount and accessHeapPos_[slot] is each slot's heap position
+    // (kNullIndex when absent). Both are empty while tracking is off.
+    bool accessTracking_;
+    std::vector<NodeIndex> accessHeap_;
+    std::vector<NodeIndex> accessHeapPos_;
+    
+    // Ingest ring (Vyukov bounded queue, single consumer). A cell is free
+    // for position p when sequence == p and holds p's entry when
+    // sequence == p + 1.
+    struct IngestCell {
+        std::atomic<size_t> sequence;
+        Key key;
+        Value value;
+    };
+    struct IngestEntry {
+        Key key;
+        Value value;
+    };
+    std::unique_ptr<IngestCell[]> ingestCells_;
+    size_t ingestMask_;
+    alignas(64) std::atomic<size_t> ingestEnqueuePos_;
+    alignas(64) std::atomic<size_t> ingestApplied_;
+    size_t ingestDequeuePos_;                // Guarded by ingestApplierMutex_
+    std::vector<IngestEntry> ingestBatch_;   // Guarded by ingestApplierMutex_
+    std::mutex ingestApplierMutex_;
+    std::thread ingestApplier_;
+    std::atomic<bool> ingestApplierRunning_;
+    std::mutex ingestWakeMutex_;
+    std::condition_variable ingestWake_;
+    
+    // A lookup key together with its formatted form (when cached)
+    struct Probe {
+        const Key& key;
+        std::string lexicographicKey;
+    };
     
     // Comparison function
-    bool compare(const Key& a, const Key& b, SortMode mode) const;
     bool compareLess(const Key& a, const Key& b, SortMode mode) const;
     bool compareEqual(const Key& a, const Key& b, SortMode mode) const;
+    Probe makeProbe(const Key& key) const;
+    bool probeLess(const Probe& probe, NodeIndex node, SortMode mode) const;
+    bool nodeLess(NodeIndex node, const Probe& probe, SortMode mode) const;
+    bool slotLess(NodeIndex a, NodeIndex b, SortMode mode) const;
+    void refreshLexicographicKeys();
+    
+    // Ordering access
+    Link& link(size_t ordering, NodeIndex node);
+    const Link& link(size_t ordering, NodeIndex node) const;
+    NodeIndex& rootOf(size_t ordering);
+    NodeIndex rootOf(size_t ordering) const;
+    SortMode modeOf(size_t ordering) const;
+    size_t findOrdering(SortMode mode) const;
     
     // Splay operations
-    void zig(std::shared_ptr<Node> node);
-    void zag(std::shared_ptr<Node> node);
-    void zigZig(std::shared_ptr<Node> node);
-    void zagZag(std::shared_ptr<Node> node);
-    void zigZag(std::shared_ptr<Node> node);
-    void zagZig(std::shared_ptr<Node> node);
+    void splay(size_t ordering, NodeIndex node);
+    void zig(size_t ordering, NodeIndex node);
+    void zag(size_t ordering, NodeIndex node);
+    void zigZig(size_t ordering, NodeIndex node);
+    void zagZag(size_t ordering, NodeIndex node);
+    void zigZag(size_t ordering, NodeIndex node);
+    void zagZig(size_t ordering, NodeIndex node);
     
     // Helper functions
-    std::shared_ptr<Node> findNode(const Key& key);
-    std::shared_ptr<Node> findNodeRecursive(std::shared_ptr<Node> node, const Key& key);
-    void insertNode(std::shared_ptr<Node> node, const Key& key, const Value& value);
-    void removeNode(std::shared_ptr<Node> node);
-    void updateSubtreeSize(std::shared_ptr<Node> node);
+    NodeIndex findNode(const Probe& probe) const;
+    NodeIndex lowerBound(size_t ordering, const Probe& probe) const;
+    void linkIntoOrdering(size_t ordering, NodeIndex node);
+    void replaceChild(size_t ordering, NodeIndex parent, NodeIndex oldChild, NodeIndex newChild);
+    void unlinkNode(size_t ordering, NodeIndex node);
+    void updateSubtreeSize(size_t ordering, NodeIndex node);
+    void updateSubtreeSizesUpward(size_t ordering, NodeIndex node);
+    void rebuildOrdering(size_t ordering);
+    NodeIndex buildWeighted(size_t ordering, const std::vector<NodeIndex>& sorted,
+                            const std::vector<uint64_t>& prefix,
+                            size_t lo, size_t hi, NodeIndex parent);
+    NodeIndex buildBalanced(size_t ordering, const std::vector<NodeIndex>& sorted,
+                            size_t lo, size_t hi, NodeIndex parent);
     
     // Buffer management
-    std::shared_ptr<Node> allocateNode(const Key& key, const Value& value);
-    void deallocateNode(std::shared_ptr<Node> node);
+    bool insertLocked(const Key& key, const Value& value);
+    size_t applyIngestBatch(size_t maxBatch);
+    NodeIndex allocateNode(const Key& key, const Value& value);
+    void deallocateNode(NodeIndex node);
+    size_t expireEntries(Clock::time_point now, size_t limit);
+    bool isExpired(NodeIndex node, Clock::time_point now) const;
+    size_t countExpired(Clock::time_point now) const;
+    
+    // Access heap maintenance
+    void heapPlace(size_t position, NodeIndex node);
+    void heapSiftUp(size_t position);
+    void heapSiftDown(size_t position);
+    void heapInsert(NodeIndex node);
+    void heapErase(NodeIndex node);
+    void rebuildAccessHeap();
     
     // Traversal
-    void inOrderHelper(std::shared_ptr<Node> node,
+    NodeIndex leftmost(size_t ordering, NodeIndex node) const;
+    NodeIndex rightmost(size_t ordering, NodeIndex node) const;
+    NodeIndex successor(size_t ordering, NodeIndex node) const;
+    NodeIndex predecessor(size_t ordering, NodeIndex node) const;
+    void inOrderHelper(size_t ordering,
                       std::vector<std::pair<Key, Value>>& result,
-                      SortOrder order,
-                      SortMode mode) const;
+                      SortOrder order) const;
+    std::vector<std::pair<Key, Value>> exportParallel(size_t ordering, SortOrder order,
+                                                      TreeExecutor& executor) const;
     
     // Statistics
-    int calculateHeight(std::shared_ptr<Node> node) const;
-    void calculateAverageDepth(std::shared_ptr<Node> node, int depth, double& sum, int& count) const;
+    int calculateHeight(NodeIndex node) const;
+    void calculateAverageDepth(NodeIndex node, int depth, double& sum, int& count) const;
 };
 
 #include "CircularBufferSplayTree.tpp"
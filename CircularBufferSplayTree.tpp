@@ -7,497 +7,1483 @@
 #include <sstream>
 #include <iomanip>
 
-template<typename Key, typename Value>
-CircularBufferSplayTree<Key, Value>::CircularBufferSplayTree(
+template<typename Key, typename Value, typename Compare>
+CircularBufferSplayTree<Key, Value, Compare>::CircularBufferSplayTree(
     size_t bufferSize, SortMode mode)
-    : bufferSize_(bufferSize), currentSize_(0), nextIndex_(0),
-      root_(nullptr), defaultSortMode_(mode) {
-    circularBuffer_.resize(bufferSize_);
-    
-    // Default comparators
-    lexicographicCmp_ = [](const Key& a, const Key& b) {
-        if constexpr (std::is_convertible_v<Key, std::string>) {
-            return std::string(a) < std::string(b);
-        } else {
-            std::ostringstream ossA, ossB;
-            ossA << a;
-            ossB << b;
-            return ossA.str() < ossB.str();
+    : bufferSize_(std::min<size_t>(std::max<size_t>(bufferSize, 1), kNullIndex)),
+      currentSize_(0), nextIndex_(0), root_(kNullIndex), defaultSortMode_(mode),
+      lexicographicKeysCached_(false), expiryWindow_(Clock::duration::zero()),
+      expiryBatch_(0), expiryCursor_(0), pendingExpiry_(0), accessTracking_(false),
+      ingestMask_(0),
+      ingestEnqueuePos_(0), ingestApplied_(0), ingestDequeuePos_(0),
+      ingestApplierRunning_(false) {
+    // The whole slab is allocated up front; inserts and evictions only
+    // rewrite slots in place.
+    slab_.resize(bufferSize_);
+    refreshLexicographicKeys();
+}
+
+template<typename Key, typename Value, typename Compare>
+CircularBufferSplayTree<Key, Value, Compare>::~CircularBufferSplayTree() {
+    stopIngestApplier();
+    TreeStats::Lock lock(treeMutex_, stats_);
+    root_ = kNullIndex;
+    secondary_.clear();
+    slab_.clear();
+}
+
+template<typename Key, typename Value, typename Compare>
+typename CircularBufferSplayTree<Key, Value, Compare>::Link&
+CircularBufferSplayTree<Key, Value, Compare>::link(size_t ordering, NodeIndex node) {
+    return ordering == kPrimary ? slab_[node].link : secondary_[ordering - 1].links[node];
+}
+
+template<typename Key, typename Value, typename Compare>
+const typename CircularBufferSplayTree<Key, Value, Compare>::Link&
+CircularBufferSplayTree<Key, Value, Compare>::link(size_t ordering, NodeIndex node) const {
+    return ordering == kPrimary ? slab_[node].link : secondary_[ordering - 1].links[node];
+}
+
+template<typename Key, typename Value, typename Compare>
+typename CircularBufferSplayTree<Key, Value, Compare>::NodeIndex&
+CircularBufferSplayTree<Key, Value, Compare>::rootOf(size_t ordering) {
+    return ordering == kPrimary ? root_ : secondary_[ordering - 1].root;
+}
+
+template<typename Key, typename Value, typename Compare>
+typename CircularBufferSplayTree<Key, Value, Compare>::NodeIndex
+CircularBufferSplayTree<Key, Value, Compare>::rootOf(size_t ordering) const {
+    return ordering == kPrimary ? root_ : secondary_[ordering - 1].root;
+}
+
+template<typename Key, typename Value, typename Compare>
+SortMode CircularBufferSplayTree<Key, Value, Compare>::modeOf(size_t ordering) const {
+    return ordering == kPrimary ? defaultSortMode_ : secondary_[ordering - 1].mode;
+}
+
+template<typename Key, typename Value, typename Compare>
+size_t CircularBufferSplayTree<Key, Value, Compare>::findOrdering(SortMode mode) const {
+    if (mode == defaultSortMode_) return kPrimary;
+    for (size_t i = 0; i < secondary_.size(); i++) {
+        if (secondary_[i].mode == mode) return i + 1;
+    }
+    return SIZE_MAX;
+}
+
+template<typename Key, typename Value, typename Compare>
+typename CircularBufferSplayTree<Key, Value, Compare>::NodeIndex
+CircularBufferSplayTree<Key, Value, Compare>::allocateNode(const Key& key, const Value& value) {
+    // The slot under the cursor always holds the oldest entry in the ring,
+    // so reclaim it if it is still live.
+    NodeIndex index = static_cast<NodeIndex>(nextIndex_);
+    if (slab_[index].occupied) {
+        deallocateNode(index);
+    }
+
+    Node& node = slab_[index];
+    node.key = key;
+    node.value = value;
+    node.link = Link();
+    node.link.subtreeSize = 1;
+    node.accessCount = 0;
+    node.occupied = true;
+    currentSize_++;
+    if (accessTracking_) {
+        heapInsert(index);
+    }
+
+    nextIndex_ = (nextIndex_ + 1) % bufferSize_;
+    if (++pendingExpiry_ > bufferSize_) {
+        // The writer lapped the expiry cursor; the oldest position is now
+        // the one just past the newest write
+        expiryCursor_ = nextIndex_;
+        pendingExpiry_ = bufferSize_;
+    }
+    return index;
+}
+
+template<typename Key, typename Value, typename Compare>
+bool CircularBufferSplayTree<Key, Value, Compare>::isExpired(
+    NodeIndex node, Clock::time_point now) const {
+    return expiryEnabled() && now - timestamps_[node] >= expiryWindow_;
+}
+
+template<typename Key, typename Value, typename Compare>
+size_t CircularBufferSplayTree<Key, Value, Compare>::countExpired(Clock::time_point now) const {
+    // What expireEntries would reclaim, without reclaiming it
+    if (!expiryEnabled()) return 0;
+    size_t expired = 0;
+    size_t cursor = expiryCursor_;
+    for (size_t pending = pendingExpiry_; pending > 0; pending--) {
+        NodeIndex slot = static_cast<NodeIndex>(cursor);
+        if (slab_[slot].occupied) {
+            if (!isExpired(slot, now)) break;
+            expired++;
         }
+        cursor = (cursor + 1) % bufferSize_;
+    }
+    return expired;
+}
+
+template<typename Key, typename Value, typename Compare>
+size_t CircularBufferSplayTree<Key, Value, Compare>::expireEntries(
+    Clock::time_point now, size_t limit) {
+    // Timestamps are non-decreasing in ring order, so the walk stops at
+    // the first live entry that is still inside the window.
+    size_t expired = 0;
+    while (pendingExpiry_ > 0 && expired < limit) {
+        NodeIndex slot = static_cast<NodeIndex>(expiryCursor_);
+        if (slab_[slot].occupied) {
+            if (!isExpired(slot, now)) break;
+            deallocateNode(slot);
+            expired++;
+        }
+        expiryCursor_ = (expiryCursor_ + 1) % bufferSize_;
+        pendingExpiry_--;
+    }
+    return expired;
+}
+
+template<typename Key, typename Value, typename Compare>
+void CircularBufferSplayTree<Key, Value, Compare>::setExpiryWindow(
+    Clock::duration window, size_t batchSize) {
+    TreeStats::Lock lock(treeMutex_, stats_);
+    if (window <= Clock::duration::zero()) {
+        expiryWindow_ = Clock::duration::zero();
+        std::vector<Clock::time_point>().swap(timestamps_);
+        return;
+    }
+
+    if (!expiryEnabled()) {
+        // Entries already in the window start aging now
+        timestamps_.assign(bufferSize_, Clock::now());
+    }
+    expiryWindow_ = window;
+    expiryBatch_ = std::max<size_t>(batchSize, 2);
+}
+
+template<typename Key, typename Value, typename Compare>
+void CircularBufferSplayTree<Key, Value, Compare>::disableExpiry() {
+    setExpiryWindow(Clock::duration::zero());
+}
+
+template<typename Key, typename Value, typename Compare>
+size_t CircularBufferSplayTree<Key, Value, Compare>::size() const {
+    TreeStats::Lock lock(treeMutex_, stats_);
+    return currentSize_ - countExpired(Clock::now());
+}
+
+template<typename Key, typename Value, typename Compare>
+size_t CircularBufferSplayTree<Key, Value, Compare>::tick() {
+    return tick(Clock::now());
+}
+
+template<typename Key, typename Value, typename Compare>
+size_t CircularBufferSplayTree<Key, Value, Compare>::tick(Clock::time_point now) {
+    TreeStats::Lock lock(treeMutex_, stats_);
+    if (!expiryEnabled()) return 0;
+    return expireEntries(now, SIZE_MAX);
+}
+
+template<typename Key, typename Value, typename Compare>
+std::vector<AccessStat<Key>> CircularBufferSplayTree<Key, Value, Compare>::accessStats() const {
+    TreeStats::Lock lock(treeMutex_, stats_);
+    std::vector<AccessStat<Key>> result;
+    result.reserve(currentSize_);
+    if (root_ == kNullIndex) return result;
+    Clock::time_point now = expiryEnabled() ? Clock::now() : Clock::time_point();
+    for (NodeIndex n = leftmost(kPrimary, root_); n != kNullIndex; n = successor(kPrimary, n)) {
+        if (isExpired(n, now)) continue;
+        result.push_back({slab_[n].key, slab_[n].accessCount, 0});
+    }
+    return result;
+}
+
+template<typename Key, typename Value, typename Compare>
+size_t CircularBufferSplayTree<Key, Value, Compare>::applyAccessStats(
+    const std::vector<AccessStat<Key>>& stats) {
+    TreeStats::Lock lock(treeMutex_, stats_);
+    if (root_ == kNullIndex) return 0;
+
+    // Looked up one by one, so the stats may come in any order
+    size_t matched = 0;
+    for (const AccessStat<Key>& stat : stats) {
+        NodeIndex node = findNode(makeProbe(stat.key));
+        if (node != kNullIndex) {
+            slab_[node].accessCount = stat.accessCount;
+            matched++;
+        }
+    }
+
+    std::vector<NodeIndex> sorted;
+    sorted.reserve(currentSize_);
+    for (NodeIndex n = leftmost(kPrimary, root_); n != kNullIndex; n = successor(kPrimary, n)) {
+        sorted.push_back(n);
+    }
+    std::vector<uint64_t> prefix(sorted.size() + 1, 0);
+    for (size_t i = 0; i < sorted.size(); i++) {
+        prefix[i + 1] = prefix[i] + static_cast<uint64_t>(std::max(slab_[sorted[i]].accessCount, 0)) + 1;
+    }
+    root_ = buildWeighted(kPrimary, sorted, prefix, 0, sorted.size(), kNullIndex);
+    if (accessTracking_) {
+        rebuildAccessHeap();
+    }
+    return matched;
+}
+
+template<typename Key, typename Value, typename Compare>
+void CircularBufferSplayTree<Key, Value, Compare>::enableAccessTracking() {
+    TreeStats::Lock lock(treeMutex_, stats_);
+    if (accessTracking_) return;
+    accessTracking_ = true;
+    rebuildAccessHeap();
+}
+
+template<typename Key, typename Value, typename Compare>
+void CircularBufferSplayTree<Key, Value, Compare>::disableAccessTracking() {
+    TreeStats::Lock lock(treeMutex_, stats_);
+    accessTracking_ = false;
+    std::vector<NodeIndex>().swap(accessHeap_);
+    std::vector<NodeIndex>().swap(accessHeapPos_);
+}
+
+template<typename Key, typename Value, typename Compare>
+std::vector<std::pair<Key, int>> CircularBufferSplayTree<Key, Value, Compare>::topK(size_t k) {
+    TreeStats::Lock lock(treeMutex_, stats_);
+    std::vector<std::pair<Key, int>> result;
+    Clock::time_point now;
+    if (expiryEnabled()) {
+        now = Clock::now();
+    }
+
+    if (!accessTracking_) {
+        std::vector<NodeIndex> live;
+        live.reserve(currentSize_);
+        for (size_t slot = 0; slot < bufferSize_; slot++) {
+            if (slab_[slot].occupied && !isExpired(static_cast<NodeIndex>(slot), now)) {
+                live.push_back(static_cast<NodeIndex>(slot));
+            }
+        }
+        k = std::min(k, live.size());
+        std::partial_sort(live.begin(), live.begin() + k, live.end(),
+            [this](NodeIndex a, NodeIndex b) {
+                return slab_[a].accessCount > slab_[b].accessCount;
+            });
+        result.reserve(k);
+        for (size_t i = 0; i < k; i++) {
+            result.emplace_back(slab_[live[i]].key, slab_[live[i]].accessCount);
+        }
+        return result;
+    }
+
+    // Best-first walk of the access heap: a candidate's children are only
+    // pushed once it is emitted, so at most 2k + 1 positions are touched.
+    // Expired entries are skipped but still expanded.
+    auto lessHot = [this](size_t a, size_t b) {
+        return slab_[accessHeap_[a]].accessCount < slab_[accessHeap_[b]].accessCount;
     };
-    
-    numericCmp_ = [](const Key& a, const Key& b) {
-        return a < b;
-    };
-    
-    semanticCmp_ = numericCmp_;  // Default to numeric
+    std::vector<size_t> candidates;
+    if (!accessHeap_.empty()) {
+        candidates.push_back(0);
+    }
+    result.reserve(std::min(k, accessHeap_.size()));
+    while (result.size() < k && !candidates.empty()) {
+        std::pop_heap(candidates.begin(), candidates.end(), lessHot);
+        size_t position = candidates.back();
+        candidates.pop_back();
+
+        NodeIndex node = accessHeap_[position];
+        if (!isExpired(node, now)) {
+            result.emplace_back(slab_[node].key, slab_[node].accessCount);
+        }
+        for (size_t child = 2 * position + 1; child <= 2 * position + 2; child++) {
+            if (child < accessHeap_.size()) {
+                candidates.push_back(child);
+                std::push_heap(candidates.begin(), candidates.end(), lessHot);
+            }
+        }
+    }
+    return result;
 }
 
-template<typename Key, typename Value>
-CircularBufferSplayTree<Key, Value>::~CircularBufferSplayTree() {
-    std::lock_guard<std::mutex> lock(treeMutex_);
-    root_ = nullptr;
-    circularBuffer_.clear();
+template<typename Key, typename Value, typename Compare>
+void CircularBufferSplayTree<Key, Value, Compare>::enableIngest(size_t capacity) {
+    std::lock_guard<std::mutex> lock(ingestApplierMutex_);
+    if (ingestEnabled()) return;
+
+    size_t cells = 2;
+    while (cells < capacity) cells <<= 1;
+    ingestCells_.reset(new IngestCell[cells]);
+    for (size_t i = 0; i < cells; i++) {
+        ingestCells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    ingestBatch_.reserve(cells);
+    ingestEnqueuePos_.store(0, std::memory_order_relaxed);
+    ingestApplied_.store(0, std::memory_order_relaxed);
+    ingestDequeuePos_ = 0;
+    ingestMask_ = cells - 1;
 }
 
-template<typename Key, typename Value>
-std::shared_ptr<typename CircularBufferSplayTree<Key, Value>::Node>
-CircularBufferSplayTree<Key, Value>::allocateNode(const Key& key, const Value& value) {
-    // Use circular buffer - overwrite oldest if full
-    if (currentSize_ >= bufferSize_) {
-        // Find and remove oldest node (LRU)
-        // For simplicity, we'll use the next index
-        if (circularBuffer_[nextIndex_] != nullptr) {
-            deallocateNode(circularBuffer_[nextIndex_]);
+template<typename Key, typename Value, typename Compare>
+bool CircularBufferSplayTree<Key, Value, Compare>::tryEnqueueInsert(const Key& key, const Value& value) {
+    if (!ingestEnabled()) return false;
+
+    size_t pos = ingestEnqueuePos_.load(std::memory_order_relaxed);
+    IngestCell* cell;
+    while (true) {
+        cell = &ingestCells_[pos & ingestMask_];
+        size_t sequence = cell->sequence.load(std::memory_order_acquire);
+        intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+        if (diff == 0) {
+            // Claim the position; on failure pos is reloaded
+            if (ingestEnqueuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return false;  // The cell still holds an entry from the previous lap
+        } else {
+            pos = ingestEnqueuePos_.load(std::memory_order_relaxed);
         }
-    } else {
-        currentSize_++;
     }
-    
-    auto node = std::make_shared<Node>(key, value, nextIndex_);
-    circularBuffer_[nextIndex_] = node;
-    nextIndex_ = (nextIndex_ + 1) % bufferSize_;
-    
-    return node;
+
+    cell->key = key;
+    cell->value = value;
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
 }
 
-template<typename Key, typename Value>
-void CircularBufferSplayTree<Key, Value>::deallocateNode(std::shared_ptr<Node> node) {
-    if (node == nullptr) return;
-    
-    // Remove from tree structure
-    if (node->parent != nullptr) {
-        if (node->parent->left == node) {
-            node->parent->left = nullptr;
-        } else if (node->parent->right == node) {
-            node->parent->right = nullptr;
+template<typename Key, typename Value, typename Compare>
+void CircularBufferSplayTree<Key, Value, Compare>::enqueueInsert(const Key& key, const Value& value) {
+    if (!ingestEnabled()) {
+        insert(key, value);
+        return;
+    }
+    while (!tryEnqueueInsert(key, value)) {
+        // Ring full: drain it ourselves unless an applier already is
+        std::unique_lock<std::mutex> applier(ingestApplierMutex_, std::try_to_lock);
+        if (applier.owns_lock()) {
+            applyIngestBatch(std::numeric_limits<size_t>::max());
+        } else {
+            std::this_thread::yield();
         }
     }
-    
-    if (node == root_) {
-        root_ = nullptr;
+}
+
+template<typename Key, typename Value, typename Compare>
+size_t CircularBufferSplayTree<Key, Value, Compare>::drainIngest(size_t maxBatch) {
+    if (!ingestEnabled()) return 0;
+    std::lock_guard<std::mutex> applier(ingestApplierMutex_);
+    return applyIngestBatch(maxBatch);
+}
+
+template<typename Key, typename Value, typename Compare>
+size_t CircularBufferSplayTree<Key, Value, Compare>::applyIngestBatch(size_t maxBatch) {
+    size_t applied = 0;
+    while (applied < maxBatch) {
+        // Take the published prefix of the ring, up to one lap at a time
+        ingestBatch_.clear();
+        size_t limit = std::min(maxBatch - applied, ingestMask_ + 1);
+        while (ingestBatch_.size() < limit) {
+            IngestCell& cell = ingestCells_[ingestDequeuePos_ & ingestMask_];
+            if (cell.sequence.load(std::memory_order_acquire) != ingestDequeuePos_ + 1) break;
+            ingestBatch_.push_back({std::move(cell.key), std::move(cell.value)});
+            cell.sequence.store(ingestDequeuePos_ + ingestMask_ + 1, std::memory_order_release);
+            ingestDequeuePos_++;
+        }
+        if (ingestBatch_.empty()) break;
+
+        {
+            TreeStats::Lock lock(treeMutex_, stats_);
+            // Enqueue order: ring slots, and with them eviction and expiry,
+            // follow arrival just as they do for insert(), and the last
+            // write to a key wins
+            for (const IngestEntry& entry : ingestBatch_) {
+                insertLocked(entry.key, entry.value);
+            }
+        }
+        applied += ingestBatch_.size();
+        ingestApplied_.store(ingestDequeuePos_, std::memory_order_release);
     }
-    
-    // Clear buffer slot
-    if (node->bufferIndex < circularBuffer_.size()) {
-        circularBuffer_[node->bufferIndex] = nullptr;
+    return applied;
+}
+
+template<typename Key, typename Value, typename Compare>
+void CircularBufferSplayTree<Key, Value, Compare>::flushIngest() {
+    if (!ingestEnabled()) return;
+
+    // Positions below target are claimed; wait until each is published
+    // and applied, helping the applier rather than sleeping on it
+    size_t target = ingestEnqueuePos_.load(std::memory_order_acquire);
+    while (ingestApplied_.load(std::memory_order_acquire) < target) {
+        std::unique_lock<std::mutex> applier(ingestApplierMutex_, std::try_to_lock);
+        if (applier.owns_lock()) {
+            applyIngestBatch(std::numeric_limits<size_t>::max());
+        } else {
+            std::this_thread::yield();
+        }
     }
-    
+}
+
+template<typename Key, typename Value, typename Compare>
+void CircularBufferSplayTree<Key, Value, Compare>::startIngestApplier() {
+    if (!ingestEnabled() || ingestApplierRunning_.exchange(true)) return;
+
+    ingestApplier_ = std::thread([this]() {
+        while (ingestApplierRunning_.load(std::memory_order_acquire)) {
+            if (drainIngest(ingestMask_ + 1) > 0) continue;
+            // Producers never block, so idle polling is bounded by a timeout
+            // instead of a notification
+            std::unique_lock<std::mutex> wake(ingestWakeMutex_);
+            ingestWake_.wait_for(wake, std::chrono::milliseconds(1), [this]() {
+                return !ingestApplierRunning_.load(std::memory_order_acquire) ||
+                       ingestEnqueuePos_.load(std::memory_order_acquire) !=
+                           ingestApplied_.load(std::memory_order_acquire);
+            });
+        }
+        drainIngest();
+    });
+}
+
+template<typename Key, typename Value, typename Compare>
+void CircularBufferSplayTree<Key, Value, Compare>::stopIngestApplier() {
+    if (!ingestApplierRunning_.exchange(false)) return;
+    {
+        std::lock_guard<std::mutex> wake(ingestWakeMutex_);
+    }
+    ingestWake_.notify_all();
+    if (ingestApplier_.joinable()) {
+        ingestApplier_.join();
+    }
+}
+
+template<typename Key, typename Value, typename Compare>
+void CircularBufferSplayTree<Key, Value, Compare>::deallocateNode(NodeIndex node) {
+    if (node == kNullIndex || !slab_[node].occupied) return;
+
+    // Remove from every ordering, then clear buffer slot. A node at the
+    // bottom of a long path (e.g. after key-ordered inserts) is splayed up
+    // first so the size fix-up does not walk the whole path again on the
+    // next eviction.
+    int depthLimit = 2;
+    for (size_t n = currentSize_; n > 1; n >>= 1) depthLimit += 2;
+    for (size_t o = 0; o <= secondary_.size(); o++) {
+        int depth = 0;
+        for (NodeIndex n = link(o, node).parent; n != kNullIndex && depth <= depthLimit;
+             n = link(o, n).parent) {
+            depth++;
+        }
+        if (depth > depthLimit) {
+            splay(o, node);
+        }
+        unlinkNode(o, node);
+        link(o, node) = Link();
+    }
+    if (accessTracking_) {
+        heapErase(node);
+    }
+    slab_[node].occupied = false;
+
     currentSize_--;
 }
 
-template<typename Key, typename Value>
-bool CircularBufferSplayTree<Key, Value>::compareLess(const Key& a, const Key& b, SortMode mode) const {
+template<typename Key, typename Value, typename Compare>
+bool CircularBufferSplayTree<Key, Value, Compare>::compareLess(const Key& a, const Key& b, SortMode mode) const {
     switch (mode) {
         case SortMode::LEXICOGRAPHIC:
-            return lexicographicCmp_(a, b);
+            return compare_.lexicographicLess(a, b);
         case SortMode::NUMERIC:
-            return numericCmp_(a, b);
+            return compare_.numericLess(a, b);
         case SortMode::SEMANTIC:
-            return semanticCmp_(a, b);
+            return compare_.semanticLess(a, b);
         default:
-            return numericCmp_(a, b);
+            return compare_.numericLess(a, b);
     }
 }
 
-template<typename Key, typename Value>
-bool CircularBufferSplayTree<Key, Value>::compareEqual(const Key& a, const Key& b, SortMode mode) const {
+template<typename Key, typename Value, typename Compare>
+bool CircularBufferSplayTree<Key, Value, Compare>::compareEqual(const Key& a, const Key& b, SortMode mode) const {
     return !compareLess(a, b, mode) && !compareLess(b, a, mode);
 }
 
-template<typename Key, typename Value>
-bool CircularBufferSplayTree<Key, Value>::insert(const Key& key, const Value& value) {
-    std::lock_guard<std::mutex> lock(treeMutex_);
-    
-    if (root_ == nullptr) {
-        root_ = allocateNode(key, value);
-        return true;
+template<typename Key, typename Value, typename Compare>
+typename CircularBufferSplayTree<Key, Value, Compare>::Probe
+CircularBufferSplayTree<Key, Value, Compare>::makeProbe(const Key& key) const {
+    // Format the lookup key once per operation instead of once per
+    // comparison
+    if (lexicographicKeysCached_) {
+        return Probe{key, comparator_detail::lexicographicKey(key)};
     }
-    
-    auto node = findNode(key);
-    if (node && compareEqual(node->key, key, defaultSortMode_)) {
-        // Key exists, update value
-        node->value = value;
-        splay(node);
-        return false;
+    return Probe{key, std::string()};
+}
+
+template<typename Key, typename Value, typename Compare>
+bool CircularBufferSplayTree<Key, Value, Compare>::probeLess(
+    const Probe& probe, NodeIndex node, SortMode mode) const {
+    if (mode == SortMode::LEXICOGRAPHIC && lexicographicKeysCached_) {
+        return probe.lexicographicKey < lexicographicKeys_[node];
+    }
+    return compareLess(probe.key, slab_[node].key, mode);
+}
+
+template<typename Key, typename Value, typename Compare>
+bool CircularBufferSplayTree<Key, Value, Compare>::nodeLess(
+    NodeIndex node, const Probe& probe, SortMode mode) const {
+    if (mode == SortMode::LEXICOGRAPHIC && lexicographicKeysCached_) {
+        return lexicographicKeys_[node] < probe.lexicographicKey;
+    }
+    return compareLess(slab_[node].key, probe.key, mode);
+}
+
+template<typename Key, typename Value, typename Compare>
+bool CircularBufferSplayTree<Key, Value, Compare>::slotLess(
+    NodeIndex a, NodeIndex b, SortMode mode) const {
+    if (mode == SortMode::LEXICOGRAPHIC && lexicographicKeysCached_) {
+        return lexicographicKeys_[a] < lexicographicKeys_[b];
     }
-    
-    // Insert new node
-    if (node == nullptr) {
-        node = root_;
+    return compareLess(slab_[a].key, slab_[b].key, mode);
+}
+
+template<typename Key, typename Value, typename Compare>
+void CircularBufferSplayTree<Key, Value, Compare>::refreshLexicographicKeys() {
+    bool needed = !comparator_detail::kIsStringLike<Key> &&
+                  compare_.cachesLexicographicKeys() &&
+                  findOrdering(SortMode::LEXICOGRAPHIC) != SIZE_MAX;
+    lexicographicKeysCached_ = needed;
+    if (!needed) {
+        std::vector<std::string>().swap(lexicographicKeys_);
+        return;
     }
-    
-    insertNode(node, key, value);
-    auto newNode = findNode(key);
-    if (newNode) {
-        splay(newNode);
+
+    lexicographicKeys_.resize(bufferSize_);
+    for (size_t i = 0; i < bufferSize_; i++) {
+        if (slab_[i].occupied) {
+            lexicographicKeys_[i] = comparator_detail::lexicographicKey(slab_[i].key);
+        }
     }
-    
-    return true;
 }
 
-template<typename Key, typename Value>
-void CircularBufferSplayTree<Key, Value>::insertNode(
-    std::shared_ptr<Node> node, const Key& key, const Value& value) {
-    if (compareLess(key, node->key, defaultSortMode_)) {
-        if (node->left == nullptr) {
-            auto newNode = allocateNode(key, value);
-            newNode->parent = node;
-            node->left = newNode;
-            updateSubtreeSize(node);
-        } else {
-            insertNode(node->left, key, value);
+template<typename Key, typename Value, typename Compare>
+bool CircularBufferSplayTree<Key, Value, Compare>::insert(const Key& key, const Value& value) {
+    TreeStats::Lock lock(treeMutex_, stats_);
+    return insertLocked(key, value);
+}
+
+template<typename Key, typename Value, typename Compare>
+bool CircularBufferSplayTree<Key, Value, Compare>::insertLocked(const Key& key, const Value& value) {
+    Probe probe = makeProbe(key);
+
+    // Amortize expiry over inserts; a batch of at least two per insert
+    // keeps reclamation ahead of the arrival rate
+    Clock::time_point now;
+    if (expiryEnabled()) {
+        now = Clock::now();
+        expireEntries(now, expiryBatch_);
+    }
+
+    bool evicted = false;
+    while (true) {
+        // Find the key or the empty child slot where it belongs
+        NodeIndex parent = kNullIndex;
+        bool goLeft = false;
+        NodeIndex current = root_;
+        while (current != kNullIndex) {
+            Node& node = slab_[current];
+            if (probeLess(probe, current, defaultSortMode_)) {
+                parent = current;
+                goLeft = true;
+                current = node.link.left;
+            } else if (nodeLess(current, probe, defaultSortMode_)) {
+                parent = current;
+                goLeft = false;
+                current = node.link.right;
+            } else if (isExpired(current, now)) {
+                // Expired but not yet reclaimed: drop it and start over
+                deallocateNode(current);
+                parent = kNullIndex;
+                current = root_;
+            } else {
+                // Key exists, update value
+                node.value = value;
+                splay(kPrimary, current);
+                return false;
+            }
         }
-    } else {
-        if (node->right == nullptr) {
-            auto newNode = allocateNode(key, value);
-            newNode->parent = node;
-            node->right = newNode;
-            updateSubtreeSize(node);
+
+        // Reclaim the oldest slot before linking. Unlinking it can only
+        // invalidate the insertion point if it removed the parent or
+        // moved a subtree under it; in that case descend again.
+        if (!evicted && slab_[nextIndex_].occupied) {
+            deallocateNode(static_cast<NodeIndex>(nextIndex_));
+            evicted = true;
+            if (parent != kNullIndex &&
+                (!slab_[parent].occupied ||
+                 (goLeft ? slab_[parent].link.left : slab_[parent].link.right) != kNullIndex)) {
+                continue;
+            }
+        }
+
+        NodeIndex newNode = allocateNode(key, value);
+        if (lexicographicKeysCached_) {
+            lexicographicKeys_[newNode] = std::move(probe.lexicographicKey);
+        }
+        if (expiryEnabled()) {
+            timestamps_[newNode] = now;
+        }
+        if (parent == kNullIndex) {
+            root_ = newNode;
         } else {
-            insertNode(node->right, key, value);
+            slab_[newNode].link.parent = parent;
+            if (goLeft) {
+                slab_[parent].link.left = newNode;
+            } else {
+                slab_[parent].link.right = newNode;
+            }
+            for (NodeIndex n = parent; n != kNullIndex; n = slab_[n].link.parent) {
+                slab_[n].link.subtreeSize++;
+            }
+            splay(kPrimary, newNode);
         }
+
+        for (size_t o = 1; o <= secondary_.size(); o++) {
+            linkIntoOrdering(o, newNode);
+        }
+        return true;
     }
 }
 
-template<typename Key, typename Value>
-Value* CircularBufferSplayTree<Key, Value>::search(const Key& key) {
-    std::lock_guard<std::mutex> lock(treeMutex_);
-    
-    auto node = findNode(key);
-    if (node && compareEqual(node->key, key, defaultSortMode_)) {
-        node->accessCount++;
-        splay(node);
-        return &node->value;
+template<typename Key, typename Value, typename Compare>
+Value* CircularBufferSplayTree<Key, Value, Compare>::search(const Key& key) {
+    TreeStats::Lock lock(treeMutex_, stats_);
+
+    NodeIndex node = findNode(makeProbe(key));
+    if (node != kNullIndex && !(expiryEnabled() && isExpired(node, Clock::now()))) {
+        slab_[node].accessCount++;
+        if (accessTracking_) {
+            heapSiftUp(accessHeapPos_[node]);
+        }
+        splay(kPrimary, node);
+        return &slab_[node].value;
     }
-    
+
     return nullptr;
 }
 
-template<typename Key, typename Value>
-std::shared_ptr<typename CircularBufferSplayTree<Key, Value>::Node>
-CircularBufferSplayTree<Key, Value>::findNode(const Key& key) {
-    return findNodeRecursive(root_, key);
+template<typename Key, typename Value, typename Compare>
+typename CircularBufferSplayTree<Key, Value, Compare>::NodeIndex
+CircularBufferSplayTree<Key, Value, Compare>::findNode(const Probe& probe) const {
+    NodeIndex current = root_;
+    size_t visited = 0;
+    while (current != kNullIndex) {
+        visited++;
+        const Node& node = slab_[current];
+        if (probeLess(probe, current, defaultSortMode_)) {
+            current = node.link.left;
+        } else if (nodeLess(current, probe, defaultSortMode_)) {
+            current = node.link.right;
+        } else {
+            stats_.recordLookup(visited);
+            return current;
+        }
+    }
+    stats_.recordLookup(visited);
+    return kNullIndex;
+}
+
+template<typename Key, typename Value, typename Compare>
+typename CircularBufferSplayTree<Key, Value, Compare>::NodeIndex
+CircularBufferSplayTree<Key, Value, Compare>::lowerBound(size_t ordering, const Probe& probe) const {
+    // First node whose key is not less than key
+    SortMode mode = modeOf(ordering);
+    NodeIndex current = rootOf(ordering);
+    NodeIndex best = kNullIndex;
+    while (current != kNullIndex) {
+        if (nodeLess(current, probe, mode)) {
+            current = link(ordering, current).right;
+        } else {
+            best = current;
+            current = link(ordering, current).left;
+        }
+    }
+    return best;
 }
 
-template<typename Key, typename Value>
-std::shared_ptr<typename CircularBufferSplayTree<Key, Value>::Node>
-CircularBufferSplayTree<Key, Value>::findNodeRecursive(
-    std::shared_ptr<Node> node, const Key& key) {
-    if (node == nullptr) return nullptr;
-    
-    if (compareEqual(node->key, key, defaultSortMode_)) {
-        return node;
+template<typename Key, typename Value, typename Compare>
+void CircularBufferSplayTree<Key, Value, Compare>::linkIntoOrdering(size_t ordering, NodeIndex node) {
+    // Secondary modes may tie on distinct keys; ties go right so equal
+    // keys stay in insertion order.
+    SortMode mode = modeOf(ordering);
+    NodeIndex parent = kNullIndex;
+    bool goLeft = false;
+    NodeIndex current = rootOf(ordering);
+    while (current != kNullIndex) {
+        parent = current;
+        goLeft = slotLess(node, current, mode);
+        current = goLeft ? link(ordering, current).left : link(ordering, current).right;
+    }
+
+    Link& l = link(ordering, node);
+    l = Link();
+    l.subtreeSize = 1;
+    if (parent == kNullIndex) {
+        rootOf(ordering) = node;
+        return;
     }
-    
-    if (compareLess(key, node->key, defaultSortMode_)) {
-        return findNodeRecursive(node->left, key);
+
+    l.parent = parent;
+    if (goLeft) {
+        link(ordering, parent).left = node;
     } else {
-        return findNodeRecursive(node->right, key);
+        link(ordering, parent).right = node;
+    }
+    for (NodeIndex n = parent; n != kNullIndex; n = link(ordering, n).parent) {
+        link(ordering, n).subtreeSize++;
     }
+    splay(ordering, node);
 }
 
-template<typename Key, typename Value>
-bool CircularBufferSplayTree<Key, Value>::remove(const Key& key) {
-    std::lock_guard<std::mutex> lock(treeMutex_);
-    
-    auto node = findNode(key);
-    if (node == nullptr || !compareEqual(node->key, key, defaultSortMode_)) {
+template<typename Key, typename Value, typename Compare>
+bool CircularBufferSplayTree<Key, Value, Compare>::remove(const Key& key) {
+    TreeStats::Lock lock(treeMutex_, stats_);
+
+    NodeIndex node = findNode(makeProbe(key));
+    if (node == kNullIndex) {
+        return false;
+    }
+    if (expiryEnabled() && isExpired(node, Clock::now())) {
+        deallocateNode(node);
         return false;
     }
-    
-    splay(node);
-    removeNode(node);
+
+    splay(kPrimary, node);
+    deallocateNode(node);
     return true;
 }
 
-template<typename Key, typename Value>
-void CircularBufferSplayTree<Key, Value>::removeNode(std::shared_ptr<Node> node) {
-    if (node->left == nullptr && node->right == nullptr) {
-        // Leaf node
-        if (node->parent != nullptr) {
-            if (node->parent->left == node) {
-                node->parent->left = nullptr;
-            } else {
-                node->parent->right = nullptr;
-            }
-            updateSubtreeSize(node->parent);
-        } else {
-            root_ = nullptr;
-        }
-        deallocateNode(node);
-    } else if (node->left == nullptr) {
-        // Only right child
-        if (node->parent != nullptr) {
-            if (node->parent->left == node) {
-                node->parent->left = node->right;
-            } else {
-                node->parent->right = node->right;
-            }
-            node->right->parent = node->parent;
-            updateSubtreeSize(node->parent);
-        } else {
-            root_ = node->right;
-            root_->parent = nullptr;
-        }
-        deallocateNode(node);
-    } else if (node->right == nullptr) {
-        // Only left child
-        if (node->parent != nullptr) {
-            if (node->parent->left == node) {
-                node->parent->left = node->left;
-            } else {
-                node->parent->right = node->left;
-            }
-            node->left->parent = node->parent;
-            updateSubtreeSize(node->parent);
-        } else {
-            root_ = node->left;
-            root_->parent = nullptr;
-        }
-        deallocateNode(node);
+template<typename Key, typename Value, typename Compare>
+void CircularBufferSplayTree<Key, Value, Compare>::replaceChild(
+    size_t ordering, NodeIndex parent, NodeIndex oldChild, NodeIndex newChild) {
+    if (parent == kNullIndex) {
+        rootOf(ordering) = newChild;
+    } else if (link(ordering, parent).left == oldChild) {
+        link(ordering, parent).left = newChild;
     } else {
-        // Two children - find successor
-        auto successor = node->right;
-        while (successor->left != nullptr) {
-            successor = successor->left;
+        link(ordering, parent).right = newChild;
+    }
+    if (newChild != kNullIndex) {
+        link(ordering, newChild).parent = parent;
+    }
+}
+
+template<typename Key, typename Value, typename Compare>
+void CircularBufferSplayTree<Key, Value, Compare>::unlinkNode(size_t ordering, NodeIndex node) {
+    // Relink neighbours around the node instead of copying the successor's
+    // payload into it, so every entry stays in its own ring slot.
+    Link target = link(ordering, node);
+    NodeIndex fixFrom;
+
+    if (target.left == kNullIndex) {
+        fixFrom = target.parent;
+        replaceChild(ordering, target.parent, node, target.right);
+    } else if (target.right == kNullIndex) {
+        fixFrom = target.parent;
+        replaceChild(ordering, target.parent, node, target.left);
+    } else {
+        // Two children - splice in the successor
+        NodeIndex successorNode = leftmost(ordering, target.right);
+        NodeIndex successorParent = link(ordering, successorNode).parent;
+        if (successorParent != node) {
+            fixFrom = successorParent;
+            replaceChild(ordering, successorParent, successorNode,
+                         link(ordering, successorNode).right);
+            link(ordering, successorNode).right = target.right;
+            link(ordering, target.right).parent = successorNode;
+        } else {
+            fixFrom = successorNode;
         }
-        
-        // Replace node with successor
-        node->key = successor->key;
-        node->value = successor->value;
-        removeNode(successor);
+        replaceChild(ordering, target.parent, node, successorNode);
+        link(ordering, successorNode).left = target.left;
+        link(ordering, target.left).parent = successorNode;
     }
+
+    updateSubtreeSizesUpward(ordering, fixFrom);
 }
 
-template<typename Key, typename Value>
+template<typename Key, typename Value, typename Compare>
 std::vector<std::pair<Key, Value>>
-CircularBufferSplayTree<Key, Value>::sort(SortOrder order, SortMode mode) {
-    std::lock_guard<std::mutex> lock(treeMutex_);
+CircularBufferSplayTree<Key, Value, Compare>::sort(SortOrder order, SortMode mode) {
+    TreeStats::Lock lock(treeMutex_, stats_);
     std::vector<std::pair<Key, Value>> result;
-    inOrderHelper(root_, result, order, mode);
+    result.reserve(currentSize_);
+
+    size_t ordering = findOrdering(mode);
+    if (ordering != SIZE_MAX) {
+        inOrderHelper(ordering, result, order);
+        return result;
+    }
+
+    // Unregistered mode: fall back to a comparison sort of the window
+    inOrderHelper(kPrimary, result, SortOrder::ASCENDING);
+    std::stable_sort(result.begin(), result.end(),
+        [this, mode](const std::pair<Key, Value>& a, const std::pair<Key, Value>& b) {
+            return compareLess(a.first, b.first, mode);
+        });
+    if (order == SortOrder::DESCENDING) {
+        std::reverse(result.begin(), result.end());
+    }
     return result;
 }
 
-template<typename Key, typename Value>
+template<typename Key, typename Value, typename Compare>
 std::vector<std::pair<Key, Value>>
-CircularBufferSplayTree<Key, Value>::sortAscending(SortMode mode) {
+CircularBufferSplayTree<Key, Value, Compare>::sortAscending(SortMode mode) {
     return sort(SortOrder::ASCENDING, mode);
 }
 
-template<typename Key, typename Value>
+template<typename Key, typename Value, typename Compare>
 std::vector<std::pair<Key, Value>>
-CircularBufferSplayTree<Key, Value>::sortDescending(SortMode mode) {
+CircularBufferSplayTree<Key, Value, Compare>::sortDescending(SortMode mode) {
     return sort(SortOrder::DESCENDING, mode);
 }
 
-template<typename Key, typename Value>
-void CircularBufferSplayTree<Key, Value>::inOrderHelper(
-    std::shared_ptr<Node> node,
+template<typename Key, typename Value, typename Compare>
+std::vector<std::pair<Key, Value>>
+CircularBufferSplayTree<Key, Value, Compare>::sortParallel(SortOrder order, SortMode mode) {
+    TreeExecutor& executor = TreeExecutor::shared();
+    TreeStats::Lock lock(treeMutex_, stats_);
+
+    size_t ordering = findOrdering(mode);
+    if (ordering != SIZE_MAX) {
+        return exportParallel(ordering, order, executor);
+    }
+
+    // Unregistered mode: as in sort(), only the window scan is parallel
+    std::vector<std::pair<Key, Value>> result = exportParallel(kPrimary, SortOrder::ASCENDING, executor);
+    std::stable_sort(result.begin(), result.end(),
+        [this, mode](const std::pair<Key, Value>& a, const std::pair<Key, Value>& b) {
+            return compareLess(a.first, b.first, mode);
+        });
+    if (order == SortOrder::DESCENDING) {
+        std::reverse(result.begin(), result.end());
+    }
+    return result;
+}
+
+template<typename Key, typename Value, typename Compare>
+std::vector<std::pair<Key, Value>>
+CircularBufferSplayTree<Key, Value, Compare>::exportParallel(size_t ordering, SortOrder order,
+                                                             TreeExecutor& executor) const {
+    std::vector<std::pair<Key, Value>> result;
+    NodeIndex root = rootOf(ordering);
+    if (root == kNullIndex) return result;
+    Clock::time_point now = expiryEnabled() ? Clock::now() : Clock::time_point();
+    bool ascending = order == SortOrder::ASCENDING;
+
+    // Expired entries are still linked and counted in subtreeSize; they
+    // are skipped when written and the gaps closed by exportPieces
+    result.resize(static_cast<size_t>(link(ordering, root).subtreeSize));
+    size_t grain = exportGrain(result.size(), executor);
+
+    // Iterative walk of the nodes above the pieces, first side first (left
+    // when ascending); a subtree of at most grain entries becomes a piece
+    std::vector<ExportPiece<NodeIndex>> pieces;
+    std::vector<NodeIndex> stack;
+    size_t position = 0;
+    auto descend = [&](NodeIndex node) {
+        while (node != kNullIndex) {
+            size_t size = static_cast<size_t>(link(ordering, node).subtreeSize);
+            if (size <= grain) {
+                pieces.push_back({node, position, size});
+                position += size;
+                return;
+            }
+            stack.push_back(node);
+            node = ascending ? link(ordering, node).left : link(ordering, node).right;
+        }
+    };
+    descend(root);
+    while (!stack.empty()) {
+        NodeIndex node = stack.back();
+        stack.pop_back();
+        if (!isExpired(node, now)) {
+            result[position++] = {slab_[node].key, slab_[node].value};
+        }
+        descend(ascending ? link(ordering, node).right : link(ordering, node).left);
+    }
+
+    // A subtree's entries are the size nodes from its extreme on, so the
+    // successor walk never has to leave it
+    exportPieces(executor, result, position, pieces,
+        [&](NodeIndex subtree, std::pair<Key, Value>* out) {
+            size_t size = static_cast<size_t>(link(ordering, subtree).subtreeSize);
+            NodeIndex node = ascending ? leftmost(ordering, subtree) : rightmost(ordering, subtree);
+            size_t written = 0;
+            for (size_t i = 0; i < size; i++) {
+                if (!isExpired(node, now)) {
+                    out[written++] = {slab_[node].key, slab_[node].value};
+                }
+                if (i + 1 < size) {
+                    node = ascending ? successor(ordering, node) : predecessor(ordering, node);
+                }
+            }
+            return written;
+        });
+    return result;
+}
+
+template<typename Key, typename Value, typename Compare>
+std::vector<std::pair<Key, Value>>
+CircularBufferSplayTree<Key, Value, Compare>::range(const Key& low, const Key& high, SortMode mode) {
+    TreeStats::Lock lock(treeMutex_, stats_);
+    std::vector<std::pair<Key, Value>> result;
+
+    Clock::time_point now = expiryEnabled() ? Clock::now() : Clock::time_point();
+
+    size_t ordering = findOrdering(mode);
+    if (ordering != SIZE_MAX) {
+        Probe lowProbe = makeProbe(low);
+        Probe highProbe = makeProbe(high);
+        for (NodeIndex n = lowerBound(ordering, lowProbe);
+             n != kNullIndex && !probeLess(highProbe, n, mode);
+             n = successor(ordering, n)) {
+            if (isExpired(n, now)) continue;
+            result.push_back({slab_[n].key, slab_[n].value});
+        }
+        return result;
+    }
+
+    // Unregistered mode: filter the window, then sort the matches
+    for (NodeIndex n = leftmost(kPrimary, root_); n != kNullIndex; n = successor(kPrimary, n)) {
+        const Key& key = slab_[n].key;
+        if (isExpired(n, now)) continue;
+        if (!compareLess(key, low, mode) && !compareLess(high, key, mode)) {
+            result.push_back({key, slab_[n].value});
+        }
+    }
+    std::stable_sort(result.begin(), result.end(),
+        [this, mode](const std::pair<Key, Value>& a, const std::pair<Key, Value>& b) {
+            return compareLess(a.first, b.first, mode);
+        });
+    return result;
+}
+
+template<typename Key, typename Value, typename Compare>
+bool CircularBufferSplayTree<Key, Value, Compare>::addOrdering(SortMode mode) {
+    TreeStats::Lock lock(treeMutex_, stats_);
+    if (findOrdering(mode) != SIZE_MAX) {
+        return false;
+    }
+
+    SecondaryOrdering ordering;
+    ordering.mode = mode;
+    ordering.root = kNullIndex;
+    ordering.links.resize(bufferSize_);
+    secondary_.push_back(std::move(ordering));
+    refreshLexicographicKeys();
+    rebuildOrdering(secondary_.size());
+    return true;
+}
+
+template<typename Key, typename Value, typename Compare>
+bool CircularBufferSplayTree<Key, Value, Compare>::removeOrdering(SortMode mode) {
+    TreeStats::Lock lock(treeMutex_, stats_);
+    size_t ordering = findOrdering(mode);
+    if (ordering == SIZE_MAX || ordering == kPrimary) {
+        return false;
+    }
+    secondary_.erase(secondary_.begin() + (ordering - 1));
+    refreshLexicographicKeys();
+    return true;
+}
+
+template<typename Key, typename Value, typename Compare>
+bool CircularBufferSplayTree<Key, Value, Compare>::hasOrdering(SortMode mode) const {
+    TreeStats::Lock lock(treeMutex_, stats_);
+    return findOrdering(mode) != SIZE_MAX;
+}
+
+template<typename Key, typename Value, typename Compare>
+typename CircularBufferSplayTree<Key, Value, Compare>::NodeIndex
+CircularBufferSplayTree<Key, Value, Compare>::leftmost(size_t ordering, NodeIndex node) const {
+    while (node != kNullIndex && link(ordering, node).left != kNullIndex) {
+        node = link(ordering, node).left;
+    }
+    return node;
+}
+
+template<typename Key, typename Value, typename Compare>
+typename CircularBufferSplayTree<Key, Value, Compare>::NodeIndex
+CircularBufferSplayTree<Key, Value, Compare>::rightmost(size_t ordering, NodeIndex node) const {
+    while (node != kNullIndex && link(ordering, node).right != kNullIndex) {
+        node = link(ordering, node).right;
+    }
+    return node;
+}
+
+template<typename Key, typename Value, typename Compare>
+typename CircularBufferSplayTree<Key, Value, Compare>::NodeIndex
+CircularBufferSplayTree<Key, Value, Compare>::successor(size_t ordering, NodeIndex node) const {
+    if (link(ordering, node).right != kNullIndex) {
+        return leftmost(ordering, link(ordering, node).right);
+    }
+    NodeIndex parent = link(ordering, node).parent;
+    while (parent != kNullIndex && link(ordering, parent).right == node) {
+        node = parent;
+        parent = link(ordering, parent).parent;
+    }
+    return parent;
+}
+
+template<typename Key, typename Value, typename Compare>
+typename CircularBufferSplayTree<Key, Value, Compare>::NodeIndex
+CircularBufferSplayTree<Key, Value, Compare>::predecessor(size_t ordering, NodeIndex node) const {
+    if (link(ordering, node).left != kNullIndex) {
+        return rightmost(ordering, link(ordering, node).left);
+    }
+    NodeIndex parent = link(ordering, node).parent;
+    while (parent != kNullIndex && link(ordering, parent).left == node) {
+        node = parent;
+        parent = link(ordering, parent).parent;
+    }
+    return parent;
+}
+
+template<typename Key, typename Value, typename Compare>
+void CircularBufferSplayTree<Key, Value, Compare>::inOrderHelper(
+    size_t ordering,
     std::vector<std::pair<Key, Value>>& result,
-    SortOrder order,
-    SortMode mode) const {
-    if (node == nullptr) return;
-    
+    SortOrder order) const {
+    NodeIndex root = rootOf(ordering);
+    if (root == kNullIndex) return;
+    Clock::time_point now = expiryEnabled() ? Clock::now() : Clock::time_point();
+
+    // Walk parent links rather than recursing: a splay tree can
+    // degenerate into a chain as deep as the buffer.
     if (order == SortOrder::ASCENDING) {
-        inOrderHelper(node->left, result, order, mode);
-        result.push_back({node->key, node->value});
-        inOrderHelper(node->right, result, order, mode);
+        for (NodeIndex n = leftmost(ordering, root); n != kNullIndex; n = successor(ordering, n)) {
+            if (isExpired(n, now)) continue;
+            result.push_back({slab_[n].key, slab_[n].value});
+        }
     } else {
-        inOrderHelper(node->right, result, order, mode);
-        result.push_back({node->key, node->value});
-        inOrderHelper(node->left, result, order, mode);
+        for (NodeIndex n = rightmost(ordering, root); n != kNullIndex; n = predecessor(ordering, n)) {
+            if (isExpired(n, now)) continue;
+            result.push_back({slab_[n].key, slab_[n].value});
+        }
     }
 }
 
-template<typename Key, typename Value>
-void CircularBufferSplayTree<Key, Value>::splay(std::shared_ptr<Node> node) {
-    if (node == nullptr || node == root_) return;
-    
-    while (node->parent != nullptr) {
-        auto parent = node->parent;
-        auto grandparent = parent->parent;
-        
-        if (grandparent == nullptr) {
+template<typename Key, typename Value, typename Compare>
+void CircularBufferSplayTree<Key, Value, Compare>::splay(NodeIndex node) {
+    splay(kPrimary, node);
+}
+
+template<typename Key, typename Value, typename Compare>
+void CircularBufferSplayTree<Key, Value, Compare>::splay(size_t ordering, NodeIndex node) {
+    if (node == kNullIndex || node == rootOf(ordering)) return;
+
+    while (link(ordering, node).parent != kNullIndex) {
+        NodeIndex parent = link(ordering, node).parent;
+        NodeIndex grandparent = link(ordering, parent).parent;
+
+        if (grandparent == kNullIndex) {
             // Zig or Zag
-            if (parent->left == node) {
-                zig(node);
+            if (link(ordering, parent).left == node) {
+                zig(ordering, node);
             } else {
-                zag(node);
+                zag(ordering, node);
             }
         } else {
-            if (parent->left == node && grandparent->left == parent) {
-                zigZig(node);
-            } else if (parent->right == node && grandparent->right == parent) {
-                zagZag(node);
-            } else if (parent->left == node && grandparent->right == parent) {
-                zigZag(node);
+            bool nodeIsLeft = link(ordering, parent).left == node;
+            bool parentIsLeft = link(ordering, grandparent).left == parent;
+            if (nodeIsLeft && parentIsLeft) {
+                zigZig(ordering, node);
+            } else if (!nodeIsLeft && !parentIsLeft) {
+                zagZag(ordering, node);
+            } else if (nodeIsLeft && !parentIsLeft) {
+                zigZag(ordering, node);
             } else {
-                zagZig(node);
+                zagZig(ordering, node);
             }
         }
     }
-    
-    root_ = node;
+
+    rootOf(ordering) = node;
 }
 
-template<typename Key, typename Value>
-void CircularBufferSplayTree<Key, Value>::zig(std::shared_ptr<Node> node) {
-    auto parent = node->parent;
-    if (parent == nullptr) return;
-    
-    parent->left = node->right;
-    if (node->right != nullptr) {
-        node->right->parent = parent;
+template<typename Key, typename Value, typename Compare>
+void CircularBufferSplayTree<Key, Value, Compare>::zig(size_t ordering, NodeIndex node) {
+    NodeIndex parent = link(ordering, node).parent;
+    if (parent == kNullIndex) return;
+
+    NodeIndex inner = link(ordering, node).right;
+    link(ordering, parent).left = inner;
+    if (inner != kNullIndex) {
+        link(ordering, inner).parent = parent;
     }
-    
-    node->parent = parent->parent;
-    if (parent->parent != nullptr) {
-        if (parent->parent->left == parent) {
-            parent->parent->left = node;
-        } else {
-            parent->parent->right = node;
-        }
-    }
-    
-    node->right = parent;
-    parent->parent = node;
-    
-    updateSubtreeSize(parent);
-    updateSubtreeSize(node);
-}
-
-template<typename Key, typename Value>
-void CircularBufferSplayTree<Key, Value>::zag(std::shared_ptr<Node> node) {
-    auto parent = node->parent;
-    if (parent == nullptr) return;
-    
-    parent->right = node->left;
-    if (node->left != nullptr) {
-        node->left->parent = parent;
-    }
-    
-    node->parent = parent->parent;
-    if (parent->parent != nullptr) {
-        if (parent->parent->left == parent) {
-            parent->parent->left = node;
-        } else {
-            parent->parent->right = node;
-        }
+
+    replaceChild(ordering, link(ordering, parent).parent, parent, node);
+
+    link(ordering, node).right = parent;
+    link(ordering, parent).parent = node;
+
+    updateSubtreeSize(ordering, parent);
+    updateSubtreeSize(ordering, node);
+    stats_.add(TreeCounter::ROTATIONS);
+}
+
+template<typename Key, typename Value, typename Compare>
+void CircularBufferSplayTree<Key, Value, Compare>::zag(size_t ordering, NodeIndex node) {
+    NodeIndex parent = link(ordering, node).parent;
+    if (parent == kNullIndex) return;
+
+    NodeIndex inner = link(ordering, node).left;
+    link(ordering, parent).right = inner;
+    if (inner != kNullIndex) {
+        link(ordering, inner).parent = parent;
     }
-    
-    node->left = parent;
-    parent->parent = node;
-    
-    updateSubtreeSize(parent);
-    updateSubtreeSize(node);
+
+    replaceChild(ordering, link(ordering, parent).parent, parent, node);
+
+    link(ordering, node).left = parent;
+    link(ordering, parent).parent = node;
+
+    updateSubtreeSize(ordering, parent);
+    updateSubtreeSize(ordering, node);
+    stats_.add(TreeCounter::ROTATIONS);
 }
 
-template<typename Key, typename Value>
-void CircularBufferSplayTree<Key, Value>::zigZig(std::shared_ptr<Node> node) {
-    zig(node->parent);
-    zig(node);
+template<typename Key, typename Value, typename Compare>
+void CircularBufferSplayTree<Key, Value, Compare>::zigZig(size_t ordering, NodeIndex node) {
+    zig(ordering, link(ordering, node).parent);
+    zig(ordering, node);
 }
 
-template<typename Key, typename Value>
-void CircularBufferSplayTree<Key, Value>::zagZag(std::shared_ptr<Node> node) {
-    zag(node->parent);
-    zag(node);
+template<typename Key, typename Value, typename Compare>
+void CircularBufferSplayTree<Key, Value, Compare>::zagZag(size_t ordering, NodeIndex node) {
+    zag(ordering, link(ordering, node).parent);
+    zag(ordering, node);
 }
 
-template<typename Key, typename Value>
-void CircularBufferSplayTree<Key, Value>::zigZag(std::shared_ptr<Node> node) {
-    zig(node);
-    zag(node);
+template<typename Key, typename Value, typename Compare>
+void CircularBufferSplayTree<Key, Value, Compare>::zigZag(size_t ordering, NodeIndex node) {
+    zig(ordering, node);
+    zag(ordering, node);
 }
 
-template<typename Key, typename Value>
-void CircularBufferSplayTree<Key, Value>::zagZig(std::shared_ptr<Node> node) {
-    zag(node);
-    zig(node);
+template<typename Key, typename Value, typename Compare>
+void CircularBufferSplayTree<Key, Value, Compare>::zagZig(size_t ordering, NodeIndex node) {
+    zag(ordering, node);
+    zig(ordering, node);
 }
 
-template<typename Key, typename Value>
-void CircularBufferSplayTree<Key, Value>::updateSubtreeSize(std::shared_ptr<Node> node) {
-    if (node == nullptr) return;
-    
+template<typename Key, typename Value, typename Compare>
+void CircularBufferSplayTree<Key, Value, Compare>::updateSubtreeSize(size_t ordering, NodeIndex node) {
+    if (node == kNullIndex) return;
+
+    // Rotations only change the sizes of the two nodes involved
+    Link& n = link(ordering, node);
     int size = 1;
-    if (node->left != nullptr) {
-        size += node->left->subtreeSize.load();
+    if (n.left != kNullIndex) {
+        size += link(ordering, n.left).subtreeSize;
     }
-    if (node->right != nullptr) {
-        size += node->right->subtreeSize.load();
+    if (n.right != kNullIndex) {
+        size += link(ordering, n.right).subtreeSize;
     }
-    node->subtreeSize = size;
-    
-    if (node->parent != nullptr) {
-        updateSubtreeSize(node->parent);
+    n.subtreeSize = size;
+}
+
+template<typename Key, typename Value, typename Compare>
+void CircularBufferSplayTree<Key, Value, Compare>::updateSubtreeSizesUpward(size_t ordering, NodeIndex node) {
+    for (; node != kNullIndex; node = link(ordering, node).parent) {
+        updateSubtreeSize(ordering, node);
     }
 }
 
-template<typename Key, typename Value>
-int CircularBufferSplayTree<Key, Value>::height() const {
-    std::lock_guard<std::mutex> lock(treeMutex_);
+template<typename Key, typename Value, typename Compare>
+int CircularBufferSplayTree<Key, Value, Compare>::height() const {
+    TreeStats::Lock lock(treeMutex_, stats_);
     return calculateHeight(root_);
 }
 
-template<typename Key, typename Value>
-int CircularBufferSplayTree<Key, Value>::calculateHeight(std::shared_ptr<Node> node) const {
-    if (node == nullptr) return 0;
-    return 1 + std::max(calculateHeight(node->left), calculateHeight(node->right));
+template<typename Key, typename Value, typename Compare>
+int CircularBufferSplayTree<Key, Value, Compare>::calculateHeight(NodeIndex node) const {
+    if (node == kNullIndex) return 0;
+
+    int maxDepth = 0;
+    std::vector<std::pair<NodeIndex, int>> stack;
+    stack.push_back({node, 1});
+    while (!stack.empty()) {
+        auto [current, depth] = stack.back();
+        stack.pop_back();
+        maxDepth = std::max(maxDepth, depth);
+        const Link& l = slab_[current].link;
+        if (l.left != kNullIndex) stack.push_back({l.left, depth + 1});
+        if (l.right != kNullIndex) stack.push_back({l.right, depth + 1});
+    }
+    return maxDepth;
 }
 
-template<typename Key, typename Value>
-double CircularBufferSplayTree<Key, Value>::averageDepth() const {
-    std::lock_guard<std::mutex> lock(treeMutex_);
+template<typename Key, typename Value, typename Compare>
+double CircularBufferSplayTree<Key, Value, Compare>::averageDepth() const {
+    TreeStats::Lock lock(treeMutex_, stats_);
     double sum = 0;
     int count = 0;
     calculateAverageDepth(root_, 0, sum, count);
     return count > 0 ? sum / count : 0;
 }
 
-template<typename Key, typename Value>
-void CircularBufferSplayTree<Key, Value>::calculateAverageDepth(
-    std::shared_ptr<Node> node, int depth, double& sum, int& count) const {
-    if (node == nullptr) return;
-    
-    sum += depth;
-    count++;
-    calculateAverageDepth(node->left, depth + 1, sum, count);
-    calculateAverageDepth(node->right, depth + 1, sum, count);
+template<typename Key, typename Value, typename Compare>
+TreeStatsReport CircularBufferSplayTree<Key, Value, Compare>::getStats() const {
+    TreeStatsReport report = stats_.report();
+    // Applied first so the difference never goes negative
+    size_t applied = ingestApplied_.load(std::memory_order_acquire);
+    report.queueDepth = ingestEnqueuePos_.load(std::memory_order_acquire) - applied;
+    return report;
+}
+
+template<typename Key, typename Value, typename Compare>
+void CircularBufferSplayTree<Key, Value, Compare>::calculateAverageDepth(
+    NodeIndex node, int depth, double& sum, int& count) const {
+    if (node == kNullIndex) return;
+
+    std::vector<std::pair<NodeIndex, int>> stack;
+    stack.push_back({node, depth});
+    while (!stack.empty()) {
+        auto [current, d] = stack.back();
+        stack.pop_back();
+        sum += d;
+        count++;
+        const Link& l = slab_[current].link;
+        if (l.left != kNullIndex) stack.push_back({l.left, d + 1});
+        if (l.right != kNullIndex) stack.push_back({l.right, d + 1});
+    }
 }
 
-template<typename Key, typename Value>
-void CircularBufferSplayTree<Key, Value>::setLexicographicComparator(
+template<typename Key, typename Value, typename Compare>
+void CircularBufferSplayTree<Key, Value, Compare>::setLexicographicComparator(
     std::function<bool(const Key&, const Key&)> cmp) {
-    std::lock_guard<std::mutex> lock(treeMutex_);
-    lexicographicCmp_ = cmp;
+    static_assert(Compare::kConfigurable, "comparator policy is fixed at compile time");
+    TreeStats::Lock lock(treeMutex_, stats_);
+    compare_.setLexicographic(cmp);
+    refreshLexicographicKeys();
+    size_t ordering = findOrdering(SortMode::LEXICOGRAPHIC);
+    if (ordering != SIZE_MAX) rebuildOrdering(ordering);
 }
 
-template<typename Key, typename Value>
-void CircularBufferSplayTree<Key, Value>::setNumericComparator(
+template<typename Key, typename Value, typename Compare>
+void CircularBufferSplayTree<Key, Value, Compare>::setNumericComparator(
     std::function<bool(const Key&, const Key&)> cmp) {
-    std::lock_guard<std::mutex> lock(treeMutex_);
-    numericCmp_ = cmp;
+    static_assert(Compare::kConfigurable, "comparator policy is fixed at compile time");
+    TreeStats::Lock lock(treeMutex_, stats_);
+    compare_.setNumeric(cmp);
+    size_t ordering = findOrdering(SortMode::NUMERIC);
+    if (ordering != SIZE_MAX) rebuildOrdering(ordering);
 }
 
-template<typename Key, typename Value>
-void CircularBufferSplayTree<Key, Value>::setSemanticComparator(
+template<typename Key, typename Value, typename Compare>
+void CircularBufferSplayTree<Key, Value, Compare>::setSemanticComparator(
     std::function<bool(const Key&, const Key&)> cmp) {
-    std::lock_guard<std::mutex> lock(treeMutex_);
-    semanticCmp_ = cmp;
+    static_assert(Compare::kConfigurable, "comparator policy is fixed at compile time");
+    TreeStats::Lock lock(treeMutex_, stats_);
+    compare_.setSemantic(cmp);
+    size_t ordering = findOrdering(SortMode::SEMANTIC);
+    if (ordering != SIZE_MAX) rebuildOrdering(ordering);
+}
+
+template<typename Key, typename Value, typename Compare>
+typename CircularBufferSplayTree<Key, Value, Compare>::NodeIndex
+CircularBufferSplayTree<Key, Value, Compare>::buildBalanced(
+    size_t ordering, const std::vector<NodeIndex>& sorted,
+    size_t lo, size_t hi, NodeIndex parent) {
+    if (lo >= hi) return kNullIndex;
+
+    size_t mid = lo + (hi - lo) / 2;
+    NodeIndex node = sorted[mid];
+    link(ordering, node).parent = parent;
+    link(ordering, node).left = buildBalanced(ordering, sorted, lo, mid, node);
+    link(ordering, node).right = buildBalanced(ordering, sorted, mid + 1, hi, node);
+    link(ordering, node).subtreeSize = static_cast<int>(hi - lo);
+    return node;
 }
 
-template<typename Key, typename Value>
-void CircularBufferSplayTree<Key, Value>::setBufferSize(size_t size) {
-    std::lock_guard<std::mutex> lock(treeMutex_);
-    if (size < currentSize_) {
-        // Need to remove excess nodes
-        // For simplicity, we'll just update the size
-        // In practice, you'd want to remove LRU nodes
+template<typename Key, typename Value, typename Compare>
+typename CircularBufferSplayTree<Key, Value, Compare>::NodeIndex
+CircularBufferSplayTree<Key, Value, Compare>::buildWeighted(
+    size_t ordering, const std::vector<NodeIndex>& sorted, const std::vector<uint64_t>& prefix,
+    size_t lo, size_t hi, NodeIndex parent) {
+    // buildBalanced with the weighted median as the split; each side
+    // weighs at most half of the range, so the depth stays logarithmic in
+    // the total weight
+    if (lo >= hi) return kNullIndex;
+
+    size_t mid = weightedMedian(prefix, lo, hi);
+    NodeIndex node = sorted[mid];
+    link(ordering, node).parent = parent;
+    link(ordering, node).left = buildWeighted(ordering, sorted, prefix, lo, mid, node);
+    link(ordering, node).right = buildWeighted(ordering, sorted, prefix, mid + 1, hi, node);
+    link(ordering, node).subtreeSize = static_cast<int>(hi - lo);
+    return node;
+}
+
+template<typename Key, typename Value, typename Compare>
+void CircularBufferSplayTree<Key, Value, Compare>::rebuildOrdering(size_t ordering) {
+    // Slots in ring order (oldest first), so the stable sort keeps ties
+    // in insertion order
+    std::vector<NodeIndex> sorted;
+    sorted.reserve(currentSize_);
+    for (size_t i = 0; i < bufferSize_; i++) {
+        NodeIndex slot = static_cast<NodeIndex>((nextIndex_ + i) % bufferSize_);
+        if (slab_[slot].occupied) {
+            sorted.push_back(slot);
+        }
+    }
+
+    SortMode mode = modeOf(ordering);
+    std::stable_sort(sorted.begin(), sorted.end(), [this, mode](NodeIndex a, NodeIndex b) {
+        return slotLess(a, b, mode);
+    });
+    rootOf(ordering) = buildBalanced(ordering, sorted, 0, sorted.size(), kNullIndex);
+}
+
+template<typename Key, typename Value, typename Compare>
+void CircularBufferSplayTree<Key, Value, Compare>::setBufferSize(size_t size) {
+    TreeStats::Lock lock(treeMutex_, stats_);
+    size = std::min<size_t>(std::max<size_t>(size, 1), kNullIndex);
+
+    // Keep the newest entries, oldest first, so ring order survives
+    std::vector<NodeIndex> ringOrder;
+    ringOrder.reserve(currentSize_);
+    for (size_t i = 0; i < bufferSize_; i++) {
+        NodeIndex slot = static_cast<NodeIndex>((nextIndex_ + i) % bufferSize_);
+        if (slab_[slot].occupied) {
+            ringOrder.push_back(slot);
+        }
     }
+    size_t dropped = ringOrder.size() > size ? ringOrder.size() - size : 0;
+
+    std::vector<NodeIndex> remap(bufferSize_, kNullIndex);
+    for (size_t i = dropped; i < ringOrder.size(); i++) {
+        remap[ringOrder[i]] = static_cast<NodeIndex>(i - dropped);
+    }
+
+    // Collect each ordering's surviving slots in order before moving them
+    std::vector<std::vector<NodeIndex>> sorted(secondary_.size() + 1);
+    for (size_t o = 0; o < sorted.size(); o++) {
+        sorted[o].reserve(ringOrder.size() - dropped);
+        NodeIndex root = rootOf(o);
+        if (root == kNullIndex) continue;
+        for (NodeIndex n = leftmost(o, root); n != kNullIndex; n = successor(o, n)) {
+            if (remap[n] != kNullIndex) {
+                sorted[o].push_back(remap[n]);
+            }
+        }
+    }
+
+    std::vector<Node> slab(size);
+    std::vector<Clock::time_point> timestamps(expiryEnabled() ? size : 0);
+    for (size_t i = dropped; i < ringOrder.size(); i++) {
+        Node& from = slab_[ringOrder[i]];
+        Node& to = slab[i - dropped];
+        to.key = std::move(from.key);
+        to.value = std::move(from.value);
+        to.accessCount = from.accessCount;
+        to.occupied = true;
+        if (expiryEnabled()) {
+            timestamps[i - dropped] = timestamps_[ringOrder[i]];
+        }
+    }
+    slab_.swap(slab);
+    timestamps_.swap(timestamps);
+    for (auto& ordering : secondary_) {
+        ordering.links.assign(size, Link());
+    }
+
     bufferSize_ = size;
-    circularBuffer_.resize(bufferSize_);
+    currentSize_ = ringOrder.size() - dropped;
+    nextIndex_ = currentSize_ % bufferSize_;
+    expiryCursor_ = 0;
+    pendingExpiry_ = currentSize_;
+    for (size_t o = 0; o < sorted.size(); o++) {
+        rootOf(o) = buildBalanced(o, sorted[o], 0, sorted[o].size(), kNullIndex);
+    }
+    refreshLexicographicKeys();
+    if (accessTracking_) {
+        rebuildAccessHeap();
+    }
+}
+
+template<typename Key, typename Value, typename Compare>
+void CircularBufferSplayTree<Key, Value, Compare>::heapPlace(size_t position, NodeIndex node) {
+    accessHeap_[position] = node;
+    accessHeapPos_[node] = static_cast<NodeIndex>(position);
+}
+
+template<typename Key, typename Value, typename Compare>
+void CircularBufferSplayTree<Key, Value, Compare>::heapSiftUp(size_t position) {
+    NodeIndex node = accessHeap_[position];
+    int count = slab_[node].accessCount;
+    while (position > 0) {
+        size_t parent = (position - 1) / 2;
+        if (slab_[accessHeap_[parent]].accessCount >= count) break;
+        heapPlace(position, accessHeap_[parent]);
+        position = parent;
+    }
+    heapPlace(position, node);
+}
+
+template<typename Key, typename Value, typename Compare>
+void CircularBufferSplayTree<Key, Value, Compare>::heapSiftDown(size_t position) {
+    NodeIndex node = accessHeap_[position];
+    int count = slab_[node].accessCount;
+    size_t size = accessHeap_.size();
+    while (true) {
+        size_t child = 2 * position + 1;
+        if (child >= size) break;
+        if (child + 1 < size &&
+            slab_[accessHeap_[child + 1]].accessCount > slab_[accessHeap_[child]].accessCount) {
+            child++;
+        }
+        if (slab_[accessHeap_[child]].accessCount <= count) break;
+        heapPlace(position, accessHeap_[child]);
+        position = child;
+    }
+    heapPlace(position, node);
+}
+
+template<typename Key, typename Value, typename Compare>
+void CircularBufferSplayTree<Key, Value, Compare>::heapInsert(NodeIndex node) {
+    accessHeap_.push_back(node);
+    heapSiftUp(accessHeap_.size() - 1);
+}
+
+template<typename Key, typename Value, typename Compare>
+void CircularBufferSplayTree<Key, Value, Compare>::heapErase(NodeIndex node) {
+    size_t position = accessHeapPos_[node];
+    accessHeapPos_[node] = kNullIndex;
+    NodeIndex last = accessHeap_.back();
+    accessHeap_.pop_back();
+    if (position == accessHeap_.size()) return;
+
+    // Move the last entry into the hole and restore order in whichever
+    // direction it violates
+    heapPlace(position, last);
+    heapSiftUp(position);
+    heapSiftDown(accessHeapPos_[last]);
+}
+
+template<typename Key, typename Value, typename Compare>
+void CircularBufferSplayTree<Key, Value, Compare>::rebuildAccessHeap() {
+    accessHeap_.clear();
+    accessHeap_.reserve(bufferSize_);
+    accessHeapPos_.assign(bufferSize_, kNullIndex);
+    for (size_t slot = 0; slot < bufferSize_; slot++) {
+        if (slab_[slot].occupied) {
+            accessHeapPos_[slot] = static_cast<NodeIndex>(accessHeap_.size());
+            accessHeap_.push_back(static_cast<NodeIndex>(slot));
+        }
+    }
+    for (size_t i = accessHeap_.size() / 2; i-- > 0;) {
+        heapSiftDown(i);
+    }
 }
 
 #endif // CIRCULAR_BUFFER_SPLAY_TREE_TPP
@@ -0,0 +1,188 @@
+/*
+ * Flat Combiner
+ * Copyright (C) 2025, Shyamal Suhana Chandra
+ * All rights reserved.
+ */
+
+#ifndef FLAT_COMBINER_H
+#define FLAT_COMBINER_H
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include "TreeStats.h"
+
+// Flat combining over an existing mutex. Each thread owns a publication
+// slot; to run an operation it publishes a request there and then either
+// finds it already applied, or acquires the lock and becomes the combiner:
+// it collects every pending request and hands the whole batch to the
+// caller's apply function in one critical section.
+//
+// Request is caller-owned and must hold both the operation's inputs and
+// room for its result; it stays alive because the publisher waits for it.
+template<typename Request>
+class FlatCombiner {
+public:
+    explicit FlatCombiner(size_t maxThreads = 64)
+        : table_(std::make_shared<SlotTable>(maxThreads)), id_(nextId()),
+          batches_(0), combined_(0) {
+        batch_.reserve(maxThreads);
+        batchSlots_.reserve(maxThreads);
+    }
+
+    FlatCombiner(const FlatCombiner&) = delete;
+    FlatCombiner& operator=(const FlatCombiner&) = delete;
+
+    // Returns once apply has processed request. apply(std::vector<Request*>&)
+    // runs with lock held. Returns false without doing anything when all
+    // slots are taken by other threads; the caller then applies directly.
+    //
+    // Each request counts as one acquisition in stats, as if it had gone
+    // through TreeStats::Lock. When the first try_lock fails, the wait runs
+    // until this thread gets the lock or finds the request already applied.
+    template<typename Apply>
+    bool execute(Request& request, std::mutex& lock, TreeStats& stats, Apply apply) {
+        Slot* slot = threadSlot();
+        if (slot == nullptr) {
+            return false;
+        }
+
+        slot->request = &request;
+        slot->state.store(kPending, std::memory_order_release);
+        bool contended = false;
+        std::chrono::steady_clock::time_point start;
+        while (true) {
+            bool locked = lock.try_lock();
+            if (locked) {
+                stats.recordAcquisition(contended, start);
+                combine(apply);
+                lock.unlock();
+            } else if (!contended) {
+                contended = true;
+                if (TreeStats::kEnabled) {
+                    start = std::chrono::steady_clock::now();
+                }
+            }
+            if (slot->state.load(std::memory_order_acquire) == kDone) {
+                slot->state.store(kEmpty, std::memory_order_relaxed);
+                if (!locked) {
+                    stats.recordAcquisition(contended, start);
+                }
+                return true;
+            }
+            std::this_thread::yield();
+        }
+    }
+
+    // Statistics
+    size_t batches() const { return batches_.load(std::memory_order_relaxed); }
+    size_t combinedRequests() const { return combined_.load(std::memory_order_relaxed); }
+
+private:
+    enum State : int { kEmpty, kPending, kDone };
+
+    struct alignas(64) Slot {
+        std::atomic<bool> owned{false};
+        std::atomic<int> state{kEmpty};
+        Request* request = nullptr;
+    };
+
+    // Shared with the per-thread registries so a thread exiting after the
+    // combiner is gone can still tell (through a weak_ptr) not to touch it
+    struct SlotTable {
+        explicit SlotTable(size_t count)
+            : slots(new Slot[count]), count(count), highWater(0) {}
+        std::unique_ptr<Slot[]> slots;
+        size_t count;
+        std::atomic<size_t> highWater;  // One past the highest slot ever claimed
+    };
+
+    // Slots this thread has claimed, released when the thread exits
+    struct ThreadSlots {
+        struct Entry {
+            uint64_t id;
+            std::weak_ptr<SlotTable> table;
+            size_t index;
+        };
+        std::vector<Entry> entries;
+
+        ~ThreadSlots() {
+            for (auto& entry : entries) {
+                if (auto table = entry.table.lock()) {
+                    table->slots[entry.index].owned.store(false, std::memory_order_release);
+                }
+            }
+        }
+    };
+
+    std::shared_ptr<SlotTable> table_;
+    uint64_t id_;
+    std::vector<Request*> batch_;      // Guarded by the lock
+    std::vector<Slot*> batchSlots_;    // Guarded by the lock
+    std::atomic<size_t> batches_;
+    std::atomic<size_t> combined_;
+
+    static uint64_t nextId() {
+        static std::atomic<uint64_t> counter{0};
+        return ++counter;
+    }
+
+    Slot* threadSlot() {
+        thread_local ThreadSlots registry;
+        for (auto& entry : registry.entries) {
+            if (entry.id == id_) {
+                return &table_->slots[entry.index];
+            }
+        }
+
+        // Forget combiners that no longer exist before claiming a new slot
+        registry.entries.erase(
+            std::remove_if(registry.entries.begin(), registry.entries.end(),
+                           [](const typename ThreadSlots::Entry& e) { return e.table.expired(); }),
+            registry.entries.end());
+
+        for (size_t i = 0; i < table_->count; i++) {
+            bool expected = false;
+            if (table_->slots[i].owned.compare_exchange_strong(expected, true)) {
+                size_t high = table_->highWater.load();
+                while (high < i + 1 && !table_->highWater.compare_exchange_weak(high, i + 1)) {
+                }
+                registry.entries.push_back({id_, table_, i});
+                return &table_->slots[i];
+            }
+        }
+        return nullptr;
+    }
+
+    template<typename Apply>
+    void combine(Apply& apply) {
+        batch_.clear();
+        batchSlots_.clear();
+        size_t high = table_->highWater.load(std::memory_order_acquire);
+        for (size_t i = 0; i < high; i++) {
+            Slot& slot = table_->slots[i];
+            if (slot.state.load(std::memory_order_acquire) == kPending) {
+                batch_.push_back(slot.request);
+                batchSlots_.push_back(&slot);
+            }
+        }
+        if (batch_.empty()) {
+            return;
+        }
+
+        apply(batch_);
+        for (Slot* slot : batchSlots_) {
+            slot->state.store(kDone, std::memory_order_release);
+        }
+        batches_.fetch_add(1, std::memory_order_relaxed);
+        combined_.fetch_add(batch_.size(), std::memory_order_relaxed);
+    }
+};
+
+#endif // FLAT_COMBINER_H
@@ -0,0 +1,156 @@
+/*
+ * Frozen Index
+ * Copyright (C) 2025, Shyamal Suhana Chandra
+ * All rights reserved.
+ */
+
+#ifndef FROZEN_INDEX_H
+#define FROZEN_INDEX_H
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <cstddef>
+
+// An immutable, array-based copy of a tree's contents for read-only
+// phases, built by BTree::freeze() / NSplayTree::freeze(). Keys are laid
+// out in Eytzinger (BFS) order: the root at 1, the children of k at 2k
+// and 2k + 1. A search is a fixed-length descent whose only branch is the
+// loop condition, and it prefetches the cache line holding the node's
+// descendants a few levels down so they are loaded by the time it gets
+// there.
+//
+// Nothing changes after construction, so any number of threads can call
+// search() and range() with no locking. To apply updates, thaw() the
+// entries back into a tree, modify it, and freeze again; readers can go
+// on using the old index (through its shared_ptr) until they switch.
+template<typename Key, typename Value>
+class FrozenIndex {
+public:
+    // entries must be sorted by key, without duplicates
+    explicit FrozenIndex(std::vector<std::pair<Key, Value>> entries)
+        : size_(entries.size()), keys_(entries.size() + 1), values_(entries.size() + 1) {
+        size_t next = 0;
+        fill(entries, next, 1);
+    }
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+    // The value stored under key, or nullptr; valid as long as the index
+    const Value* search(const Key& key) const {
+        size_t k = lowerBound(key);
+        return k != 0 && !(key < keys_[k]) ? &values_[k] : nullptr;
+    }
+
+    // Calls visit(key, value) for every entry with low <= key <= high,
+    // ascending, and returns how many there were
+    template<typename Visit>
+    size_t range(const Key& low, const Key& high, Visit visit) const {
+        size_t count = 0;
+        for (size_t k = lowerBound(low); k != 0 && !(high < keys_[k]); k = successor(k)) {
+            visit(keys_[k], values_[k]);
+            count++;
+        }
+        return count;
+    }
+
+    std::vector<std::pair<Key, Value>> range(const Key& low, const Key& high) const {
+        std::vector<std::pair<Key, Value>> result;
+        range(low, high, [&](const Key& key, const Value& value) {
+            result.emplace_back(key, value);
+        });
+        return result;
+    }
+
+    // Every entry in key order
+    template<typename Visit>
+    void forEach(Visit visit) const {
+        for (size_t k = first(); k != 0; k = successor(k)) {
+            visit(keys_[k], values_[k]);
+        }
+    }
+
+    std::vector<std::pair<Key, Value>> entries() const {
+        std::vector<std::pair<Key, Value>> result;
+        result.reserve(size_);
+        forEach([&](const Key& key, const Value& value) {
+            result.emplace_back(key, value);
+        });
+        return result;
+    }
+
+private:
+    // Keys per cache line, rounded down to a power of two so that
+    // k * stride is a descendant of k (four levels down for 4-byte keys)
+    static constexpr size_t prefetchStride() {
+        size_t stride = 1;
+        while (stride * 2 * sizeof(Key) <= 64) stride *= 2;
+        return stride;
+    }
+    static constexpr size_t kPrefetchStride = prefetchStride();
+
+    size_t size_;
+    std::vector<Key> keys_;      // Slot 0 unused, so children are 2k / 2k + 1
+    std::vector<Value> values_;
+
+    // In-order walk of the implicit tree, taking entries in sorted order
+    void fill(std::vector<std::pair<Key, Value>>& entries, size_t& next, size_t k) {
+        if (k > size_) return;
+        fill(entries, next, 2 * k);
+        keys_[k] = std::move(entries[next].first);
+        values_[k] = std::move(entries[next].second);
+        next++;
+        fill(entries, next, 2 * k + 1);
+    }
+
+    // Slot of the first key not less than key, 0 if there is none. The
+    // descent goes right past every smaller key; the answer is where it
+    // last went left, found by dropping the trailing right turns (1 bits)
+    // and that one left turn from the final position.
+    size_t lowerBound(const Key& key) const {
+        size_t k = 1;
+        while (k <= size_) {
+#if defined(__GNUC__) || defined(__clang__)
+            // Clamped so the hinted address stays inside the array
+            __builtin_prefetch(keys_.data() + std::min(k * kPrefetchStride, size_));
+#endif
+            k = 2 * k + static_cast<size_t>(keys_[k] < key);
+        }
+        return k >> (countTrailingOnes(k) + 1);
+    }
+
+    static size_t countTrailingOnes(size_t k) {
+#if defined(__GNUC__) || defined(__clang__)
+        return static_cast<size_t>(__builtin_ctzll(~static_cast<unsigned long long>(k)));
+#else
+        size_t count = 0;
+        while (k & 1) {
+            k >>= 1;
+            count++;
+        }
+        return count;
+#endif
+    }
+
+    size_t first() const {
+        if (size_ == 0) return 0;
+        size_t k = 1;
+        while (2 * k <= size_) k = 2 * k;
+        return k;
+    }
+
+    // Next slot in key order, 0 after the last: the leftmost node of the
+    // right subtree, or else the nearest ancestor reached from a left child
+    size_t successor(size_t k) const {
+        if (2 * k + 1 <= size_) {
+            k = 2 * k + 1;
+            while (2 * k <= size_) k = 2 * k;
+            return k;
+        }
+        k >>= countTrailingOnes(k);
+        return k >> 1;
+    }
+};
+
+#endif // FROZEN_INDEX_H
@@ -10,13 +10,20 @@
 #include <memory>
 #include <mutex>
 #include <atomic>
-#include <thread>
 #include <functional>
-#include <queue>
-#include <condition_variable>
 #include <cstdint>
 #include <string>
 #include <type_traits>
+#include <optional>
+#include "TreeExecutor.h"
+#include "TreeFuture.h"
+#include "FlatCombiner.h"
+#include "SnapshotJournal.h"
+#include "TreeStats.h"
+#include "FrozenIndex.h"
+#include "NodePool.h"
+#include "ParallelExport.h"
+#include "AccessStats.h"
 
 // Rolling checksum for rsync (Adler-32 variant)
 struct RollingChecksum {
@@ -48,23 +55,32 @@ struct BlockMetadata {
         : checksum(cs), strongHash(sh), blockIndex(idx), blockSize(sz) {}
 };
 
+// Each node holds one key and up to maxChildren children sorted by key.
+// Children with keys below the node's key form its left group and the
+// rest its right group; every child's subtree covers a contiguous key
+// interval, so an in-order walk visits the left group, the node, then
+// the right group. Rotations move a child above its parent and hand the
+// groups over the same way a binary rotation hands over subtrees.
 template<typename Key, typename Value>
 class NSplayTree {
 public:
+    // Nodes live in the tree's NodePool and link to each other with raw
+    // pointers; every field is guarded by the tree lock
     struct Node {
         Key key;
         Value value;
-        std::vector<std::shared_ptr<Node>> children;
-        std::shared_ptr<Node> parent;
-        std::atomic<int> accessCount;
-        std::atomic<int> subtreeSize;
+        Key maxKey;  // Largest key in this subtree; routes descents
+        int accessCount;
+        int subtreeSize;
         int maxChildren;  // Dynamic branching factor
-        std::mutex nodeMutex;
+        Node* parent;     // Non-owning
+        ChildArray<Node, 2> children;  // Sorted by key; two fit inline
+        uint64_t id;       // Stable for the node's lifetime (see SnapshotJournal)
+        uint64_t version;  // Tree version of its last change
         
         Node(const Key& k, const Value& v, int maxChildren = 2)
-            : key(k), value(v), accessCount(0), subtreeSize(1), maxChildren(maxChildren) {
-            children.reserve(maxChildren);
-        }
+            : key(k), value(v), maxKey(k), accessCount(0), subtreeSize(1),
+              maxChildren(maxChildren), parent(nullptr), id(0), version(0) {}
     };
     
     NSplayTree(int initialBranching = 2, int maxBranching = 16);
@@ -76,11 +92,17 @@ public:
     Value* search(const Key& key);
     std::vector<std::pair<Key, Value>> inOrderTraversal();
     
+    // Same result, written by the shared executor's workers: subtrees are
+    // exported concurrently at offsets given by their sizes, into an
+    // output sized once. Trees too small to split are written by the
+    // calling thread alone.
+    std::vector<std::pair<Key, Value>> inOrderTraversalParallel();
+    
     // Splay operation - brings node to root
-    void splay(std::shared_ptr<Node> node);
+    void splay(Node* node);
     
     // Dynamic branching adjustment
-    void adjustBranching(std::shared_ptr<Node> node);
+    void adjustBranching(Node* node);
     void setMaxBranching(int maxBranch);
     int getMaxBranching() const { return maxBranching_; }
     
@@ -90,13 +112,8 @@ public:
                            std::is_same<V, BlockMetadata>::value, 
                            BlockMetadata*>::type
     findBlock(const RollingChecksum& checksum) {
-        auto node = findNode(checksum);
-        if (node && node->key == checksum) {
-            node->accessCount++;
-            splay(node);
-            return &node->value;
-        }
-        return nullptr;
+        TreeStats::Lock lock(treeMutex_, stats_);
+        return searchLocked(checksum);
     }
     
     template<typename K = Key, typename V = Value>
@@ -123,15 +140,63 @@ public:
         return results;
     }
     
-    // Real-time async operations
-    void insertAsync(const Key& key, const Value& value,
+    // Batch operations, each under a single acquisition of the tree lock.
+    // searchBatch calls visit(i, const Value*) for every key in order,
+    // with nullptr for a miss; the pointer is only valid inside visit.
+    // insertBatch inserts (keys[i], valueAt(i)) for i = 0..count-1 in
+    // order, sets results[i] (if given; bool or any integer type) to
+    // whether the key was new, and returns how many were.
+    template<typename Visit>
+    void searchBatch(const Key* keys, size_t count, Visit visit);
+    template<typename ValueAt, typename Result = bool>
+    size_t insertBatch(const Key* keys, size_t count, ValueAt valueAt, Result* results = nullptr);
+    
+    // Read-only phases: freeze() copies the current contents into an
+    // immutable FrozenIndex whose search and range need no locks; thaw()
+    // inserts a frozen index's entries back, as insertBatch would, and
+    // returns how many were new (all of them for an empty tree).
+    std::shared_ptr<const FrozenIndex<Key, Value>> freeze();
+    size_t thaw(const FrozenIndex<Key, Value>& frozen);
+    
+    // Warm start (AccessStats.h): accessStats() lists each key's access
+    // count and its node's maxChildren, in key order. applyAccessStats()
+    // copies them onto the keys present here (stats must be in key order;
+    // unmatched keys keep their own) and rebuilds the tree by weight,
+    // accessCount + 1: every node is the weighted median of its key range
+    // and its children split the rest into groups of equal weight, as
+    // many as its maxChildren allows. Returns how many keys matched.
+    std::vector<AccessStat<Key>> accessStats() const;
+    size_t applyAccessStats(const std::vector<AccessStat<Key>>& stats);
+    
+    // Real-time async operations, run on the shared TreeExecutor. Each
+    // returns false if the executor rejected the task (the callback is
+    // then not invoked).
+    bool insertAsync(const Key& key, const Value& value,
                      std::function<void(bool)> callback = nullptr);
-    void deleteAsync(const Key& key,
+    bool deleteAsync(const Key& key,
                     std::function<void(bool)> callback = nullptr);
-    void searchAsync(const Key& key,
+    bool searchAsync(const Key& key,
                     std::function<void(Value*)> callback = nullptr);
     
-    // Thread management
+    // Future / co_await variants. Results are copied out under the tree
+    // lock, so unlike searchAsync's Value* they stay valid whatever later
+    // tasks do to the tree. Called from an executor worker (e.g. inside an
+    // awaiting coroutine) they run inline.
+    TreeFuture<bool> insertFuture(const Key& key, const Value& value);
+    TreeFuture<bool> deleteFuture(const Key& key);
+    TreeFuture<std::optional<Value>> searchFuture(const Key& key);
+    
+    // Flat combining: insert, remove and search (and so every async and
+    // future variant) publish into per-thread slots and the thread that
+    // gets the tree lock applies all of them in one key-ordered pass.
+    // Enable before the tree is shared between threads; it stays on.
+    void enableFlatCombining(size_t maxThreads = 64);
+    bool flatCombiningEnabled() const { return combiner_ != nullptr; }
+    size_t combinedBatches() const { return combiner_ ? combiner_->batches() : 0; }
+    size_t combinedOperations() const { return combiner_ ? combiner_->combinedRequests() : 0; }
+    
+    // Thread management: attach to the shared executor (numThreads sizes
+    // it on first use) / wait for this tree's queued tasks
     void startWorkerThreads(int numThreads = 4);
     void stopWorkerThreads();
     
@@ -140,67 +205,115 @@ public:
     int height() const;
     double averageDepth() const;
     
-    // For visualization
+    // Hot-path counters (TreeStats.h); zero unless built with
+    // TREE_ENABLE_STATS. Splits are splitNode hand-downs, merges the root
+    // joins of remove. The queue gauges are filled in either way.
+    TreeStatsReport getStats() const;
+    void resetStats() { stats_.reset(); }
+    void enableStatsHistograms(bool on = true) { stats_.enableHistograms(on); }
+    
+    // For visualization. Nodes are listed in level order, root first.
     struct TreeSnapshot {
         struct NodeInfo {
+            uint64_t id;
             Key key;
             Value value;
-            std::vector<size_t> childIndices;
+            std::vector<size_t> childIndices;  // Into nodes (full snapshots only)
+            std::vector<uint64_t> childIds;
             int accessCount;
             int subtreeSize;
             int maxChildren;
         };
         std::vector<NodeInfo> nodes;
         std::vector<std::pair<size_t, size_t>> edges;
+        uint64_t version;
+    };
+    
+    // Nodes added or modified since fromVersion (childIds replace a
+    // node's previous edges) and ids of nodes that left the tree; full is
+    // set, with every node listed, when the tree cannot tell what changed
+    struct SnapshotDelta {
+        uint64_t fromVersion;
+        uint64_t version;
+        bool full;
+        uint64_t rootId;  // 0 when empty
+        std::vector<typename TreeSnapshot::NodeInfo> nodes;
+        std::vector<uint64_t> removedIds;
     };
     
     TreeSnapshot getSnapshot() const;
+    SnapshotDelta getSnapshotSince(uint64_t version) const;
+    uint64_t version() const;
     
 private:
     int initialBranching_;
     int maxBranching_;
-    std::shared_ptr<Node> root_;
+    Node* root_;
+    NodePool<Node> pool_;
+    std::vector<Node*> scratch_;  // Child lists being rebuilt by rotations and splits
     mutable std::mutex treeMutex_;
     
-    // Thread pool
-    std::vector<std::thread> workerThreads_;
-    std::queue<std::function<void()>> taskQueue_;
-    std::mutex queueMutex_;
-    std::condition_variable queueCondition_;
-    std::atomic<bool> running_;
+    // This tree's tasks on the shared executor, created on first use
+    std::unique_ptr<TreeExecutor::TaskGroup> tasks_;
+    mutable std::mutex tasksMutex_;
+    
+    // An operation published to the flat combiner, filled in by it
+    struct CombinedOp {
+        enum Kind { INSERT, REMOVE, SEARCH };
+        Kind kind;
+        const Key* key;
+        const Value* value;           // INSERT
+        bool result = false;          // INSERT, REMOVE
+        Value* found = nullptr;       // SEARCH
+        std::optional<Value>* copy = nullptr;  // SEARCH: also copy under the lock
+    };
+    std::unique_ptr<FlatCombiner<CombinedOp>> combiner_;
+    
+    mutable TreeStats stats_;
+    
+    // Change tracking for getSnapshotSince; started by the first snapshot
+    mutable SnapshotJournal<Node> journal_;
     
     // Splay operations
-    void zig(std::shared_ptr<Node> node);
-    void zag(std::shared_ptr<Node> node);
-    void zigZig(std::shared_ptr<Node> node);
-    void zagZag(std::shared_ptr<Node> node);
-    void zigZag(std::shared_ptr<Node> node);
-    void zagZig(std::shared_ptr<Node> node);
+    void zig(Node* node);
+    void zag(Node* node);
+    void zigZig(Node* node);
+    void zagZag(Node* node);
+    void zigZag(Node* node);
+    void zagZig(Node* node);
     
     // Helper functions
-    std::shared_ptr<Node> findNode(const Key& key);
-    std::shared_ptr<Node> findNodeRecursive(std::shared_ptr<Node> node, const Key& key);
-    void insertNode(std::shared_ptr<Node> node, const Key& key, const Value& value);
-    void removeNode(std::shared_ptr<Node> node);
-    void updateSubtreeSize(std::shared_ptr<Node> node);
+    Node* findNode(const Key& key);
+    bool insertLocked(const Key& key, const Value& value);
+    bool removeLocked(const Key& key);
+    Value* searchLocked(const Key& key);
+    Node* insertNode(Node* parent, const Key& key, const Value& value);
+    void removeNode(Node* node);
+    void updateSubtreeSize(Node* node);
+    size_t leftChildCount(const Node& node) const;
+    size_t childIndex(const Node& parent, const Node& child) const;
     
     // Tree restructuring
-    void splitNode(std::shared_ptr<Node> node);
-    void mergeNode(std::shared_ptr<Node> node);
-    void redistributeChildren(std::shared_ptr<Node> node);
+    int optimalBranching(int subtreeSize) const;
+    void splitNode(Node* node);
+    Node* buildWeighted(const std::vector<Node*>& sorted, const std::vector<uint64_t>& prefix,
+                        size_t lo, size_t hi, Node* parent);
     
     // Traversal
-    void inOrderHelper(std::shared_ptr<Node> node, 
-                     std::vector<std::pair<Key, Value>>& result) const;
+    template<typename Visit>
+    void inOrderHelper(Node* node, Visit visit) const;
     
     // Statistics
-    int calculateHeight(std::shared_ptr<Node> node) const;
-    size_t calculateSize(std::shared_ptr<Node> node) const;
-    double calculateAverageDepth(std::shared_ptr<Node> node, int depth) const;
+    int calculateHeight(const Node* node) const;
+    size_t calculateSize(const Node* node) const;
+    double calculateAverageDepth(const Node* node, int depth) const;
+    typename TreeSnapshot::NodeInfo nodeInfo(const Node& node) const;
     
-    // Thread worker
-    void workerThread();
-    void enqueueTask(std::function<void()> task);
+    // Async dispatch
+    TreeExecutor::TaskGroup& taskGroup(int numThreads = 0);
+    bool enqueueTask(std::function<void()> task);
+    bool runCombined(CombinedOp& op);
+    void applyCombined(std::vector<CombinedOp*>& batch);
 };
 
 #include "NSplayTree.tpp"
@@ -4,112 +4,138 @@
 #include "NSplayTree.h"
 #include <algorithm>
 #include <iostream>
-#include <map>
 #include <cmath>
 
 template<typename Key, typename Value>
 NSplayTree<Key, Value>::NSplayTree(int initialBranching, int maxBranching)
-    : initialBranching_(initialBranching), maxBranching_(maxBranching),
-      root_(nullptr), running_(false) {
+    : initialBranching_(std::max(initialBranching, 2)), maxBranching_(maxBranching),
+      root_(nullptr) {
 }
 
 template<typename Key, typename Value>
 NSplayTree<Key, Value>::~NSplayTree() {
     stopWorkerThreads();
+    
+    // The pool frees its chunks without running destructors, so destroy
+    // each node first; iterative, since splay trees can be deep
+    std::lock_guard<std::mutex> lock(treeMutex_);
+    std::vector<Node*> pending;
+    if (root_) pending.push_back(root_);
+    root_ = nullptr;
+    while (!pending.empty()) {
+        Node* node = pending.back();
+        pending.pop_back();
+        pending.insert(pending.end(), node->children.begin(), node->children.end());
+        pool_.destroy(node);
+    }
+}
+
+template<typename Key, typename Value>
+size_t NSplayTree<Key, Value>::leftChildCount(const Node& node) const {
+    // Children are sorted by key, so the left group is a prefix
+    return std::partition_point(node.children.begin(), node.children.end(),
+        [&node](const Node* c) { return c->key < node.key; })
+        - node.children.begin();
+}
+
+template<typename Key, typename Value>
+size_t NSplayTree<Key, Value>::childIndex(const Node& parent, const Node& child) const {
+    return std::partition_point(parent.children.begin(), parent.children.end(),
+        [&child](const Node* c) { return c->key < child.key; })
+        - parent.children.begin();
 }
 
 template<typename Key, typename Value>
 bool NSplayTree<Key, Value>::insert(const Key& key, const Value& value) {
-    std::lock_guard<std::mutex> lock(treeMutex_);
-    
+    CombinedOp op{CombinedOp::INSERT, &key, &value};
+    if (runCombined(op)) {
+        return op.result;
+    }
+    TreeStats::Lock lock(treeMutex_, stats_);
+    return insertLocked(key, value);
+}
+
+template<typename Key, typename Value>
+bool NSplayTree<Key, Value>::insertLocked(const Key& key, const Value& value) {
     if (root_ == nullptr) {
-        root_ = std::make_shared<Node>(key, value, initialBranching_);
+        root_ = pool_.create(key, value, initialBranching_);
+        journal_.added(*root_);
         return true;
     }
     
-    // Search for the key
-    auto node = findNode(key);
-    if (node && node->key == key) {
-        // Key exists, update value
-        node->value = value;
-        splay(node);
-        return false;
-    }
-    
-    // Insert new node
-    if (node == nullptr) {
-        node = root_;
+    // Descend within the key's side of each node: into the first child
+    // whose subtree reaches the key, or below the last one when the node
+    // is already full
+    auto node = root_;
+    size_t visited = 0;
+    while (true) {
+        visited++;
+        if (node->key == key) {
+            // Key exists, update value
+            node->value = value;
+            journal_.changed(*node);
+            stats_.recordLookup(visited);
+            splay(node);
+            return false;
+        }
+        
+        auto& children = node->children;
+        size_t split = leftChildCount(*node);
+        size_t lo = key < node->key ? 0 : split;
+        size_t hi = key < node->key ? split : children.size();
+        auto it = std::partition_point(children.begin() + lo, children.begin() + hi,
+            [&key](const Node* c) { return c->maxKey < key; });
+        
+        if (it != children.begin() + hi) {
+            node = *it;
+        } else if (lo < hi && children.size() >= static_cast<size_t>(node->maxChildren)) {
+            node = children[hi - 1];
+        } else {
+            break;
+        }
     }
+    stats_.recordLookup(visited);
     
-    insertNode(node, key, value);
-    auto newNode = findNode(key);
-    if (newNode) {
-        splay(newNode);
+    auto newNode = insertNode(node, key, value);
+    for (auto n = node; n != nullptr; n = n->parent) {
+        updateSubtreeSize(n);
     }
+    adjustBranching(node);
+    splay(newNode);
     
     return true;
 }
 
 template<typename Key, typename Value>
-void NSplayTree<Key, Value>::insertNode(std::shared_ptr<Node> node, 
-                                        const Key& key, const Value& value) {
-    // Find appropriate position
-    if (node->children.empty()) {
-        // Leaf node - add as child
-        auto newNode = std::make_shared<Node>(key, value, initialBranching_);
-        newNode->parent = node;
-        
-        // Insert in sorted order
-        auto it = node->children.begin();
-        while (it != node->children.end() && (*it)->key < key) {
-            ++it;
-        }
-        node->children.insert(it, newNode);
-        
-        // Check if we need to split
-        if (node->children.size() > node->maxChildren) {
-            splitNode(node);
-        }
-        
-        updateSubtreeSize(node);
-    } else {
-        // Find child to insert into
-        size_t childIndex = 0;
-        for (size_t i = 0; i < node->children.size(); i++) {
-            if (i < node->children.size() - 1 && node->children[i + 1]->key > key) {
-                childIndex = i;
-                break;
-            }
-            if (i == node->children.size() - 1) {
-                childIndex = i;
-                break;
-            }
-        }
-        
-        if (childIndex < node->children.size()) {
-            insertNode(node->children[childIndex], key, value);
-        } else {
-            // Insert as new child
-            auto newNode = std::make_shared<Node>(key, value, initialBranching_);
-            newNode->parent = node;
-            node->children.push_back(newNode);
-            
-            if (node->children.size() > node->maxChildren) {
-                splitNode(node);
-            }
-        }
-        
-        updateSubtreeSize(node);
-    }
+typename NSplayTree<Key, Value>::Node*
+NSplayTree<Key, Value>::insertNode(Node* parent,
+                                   const Key& key, const Value& value) {
+    // Attach a leaf in sorted position
+    Node* newNode = pool_.create(key, value, initialBranching_);
+    journal_.added(*newNode);
+    newNode->parent = parent;
+    auto it = std::partition_point(parent->children.begin(), parent->children.end(),
+        [&key](const Node* c) { return c->key < key; });
+    parent->children.insert(it - parent->children.begin(), newNode);
+    return newNode;
 }
 
 template<typename Key, typename Value>
 Value* NSplayTree<Key, Value>::search(const Key& key) {
-    std::lock_guard<std::mutex> lock(treeMutex_);
-    
+    CombinedOp op{CombinedOp::SEARCH, &key, nullptr};
+    if (runCombined(op)) {
+        return op.found;
+    }
+    TreeStats::Lock lock(treeMutex_, stats_);
+    return searchLocked(key);
+}
+
+template<typename Key, typename Value>
+Value* NSplayTree<Key, Value>::searchLocked(const Key& key) {
     auto node = findNode(key);
     if (node && node->key == key) {
         node->accessCount++;
+        journal_.changed(*node);
         splay(node);
         return &node->value;
     }
@@ -118,77 +144,50 @@ Value* NSplayTree<Key, Value>::search(const Key& key) {
 }
 
 template<typename Key, typename Value>
-std::shared_ptr<typename NSplayTree<Key, Value>::Node> 
+typename NSplayTree<Key, Value>::Node* 
 NSplayTree<Key, Value>::findNode(const Key& key) {
-    return findNodeRecursive(root_, key);
-}
-
-template<typename Key, typename Value>
-std::shared_ptr<typename NSplayTree<Key, Value>::Node>
-NSplayTree<Key, Value>::findNodeRecursive(std::shared_ptr<Node> node, const Key& key) {
-    if (node == nullptr) return nullptr;
-    
-    if (node->key == key) {
-        return node;
-    }
-    
-    // Binary search in children
-    if (node->children.empty()) {
-        return node;  // Return leaf node for insertion
-    }
-    
-    for (size_t i = 0; i < node->children.size(); i++) {
-        if (i < node->children.size() - 1) {
-            if (key >= node->children[i]->key && key < node->children[i + 1]->key) {
-                return findNodeRecursive(node->children[i], key);
-            }
-        } else {
-            if (key >= node->children[i]->key) {
-                return findNodeRecursive(node->children[i], key);
-            }
+    auto node = root_;
+    size_t visited = 0;
+    while (node != nullptr) {
+        visited++;
+        if (node->key == key) {
+            stats_.recordLookup(visited);
+            return node;
         }
+        
+        // Only the first child on the key's side whose subtree reaches the
+        // key can contain it
+        auto& children = node->children;
+        size_t split = leftChildCount(*node);
+        size_t lo = key < node->key ? 0 : split;
+        size_t hi = key < node->key ? split : children.size();
+        auto it = std::partition_point(children.begin() + lo, children.begin() + hi,
+            [&key](const Node* c) { return c->maxKey < key; });
+        node = it != children.begin() + hi ? *it : nullptr;
     }
-    
-    // If key is less than all children, return first child's subtree
-    if (!node->children.empty() && key < node->children[0]->key) {
-        return findNodeRecursive(node->children[0], key);
-    }
-    
-    return node;
+    stats_.recordLookup(visited);
+    return nullptr;
 }
 
 template<typename Key, typename Value>
-void NSplayTree<Key, Value>::splay(std::shared_ptr<Node> node) {
+void NSplayTree<Key, Value>::splay(Node* node) {
     if (node == nullptr || node == root_) return;
     
     while (node->parent != nullptr) {
         auto parent = node->parent;
         auto grandparent = parent->parent;
+        bool nodeIsLeft = node->key < parent->key;
         
         if (grandparent == nullptr) {
             // Zig or Zag
-            if (parent->children.size() > 0 && parent->children[0] == node) {
+            if (nodeIsLeft) {
                 zig(node);
             } else {
                 zag(node);
             }
         } else {
             // Determine rotation type
-            bool nodeIsLeft = false, parentIsLeft = false;
-            
-            for (size_t i = 0; i < parent->children.size(); i++) {
-                if (parent->children[i] == node) {
-                    nodeIsLeft = (i == 0);
-                    break;
-                }
-            }
-            
-            for (size_t i = 0; i < grandparent->children.size(); i++) {
-                if (grandparent->children[i] == parent) {
-                    parentIsLeft = (i == 0);
-                    break;
-                }
-            }
+            bool parentIsLeft = parent->key < grandparent->key;
             
             if (nodeIsLeft && parentIsLeft) {
                 zigZig(node);
@@ -199,174 +198,218 @@ void NSplayTree<Key, Value>::splay(std::shared_ptr<Node> node) {
             } else {
                 zagZig(node);
             }
+            adjustBranching(grandparent);
         }
         
-        adjustBranching(node);
+        adjustBranching(parent);
     }
     
     root_ = node;
+    adjustBranching(node);
 }
 
 template<typename Key, typename Value>
-void NSplayTree<Key, Value>::zig(std::shared_ptr<Node> node) {
+void NSplayTree<Key, Value>::zig(Node* node) {
+    // node sits in parent's left group. It keeps its left group, takes the
+    // parent's children before it, and gets the parent as its only right
+    // child; the parent's left group starts with node's old right group.
     auto parent = node->parent;
     if (parent == nullptr) return;
-    
-    // Remove node from parent's children
-    parent->children.erase(
-        std::remove_if(parent->children.begin(), parent->children.end(),
-            [&node](const std::shared_ptr<Node>& n) { return n == node; }),
-        parent->children.end()
-    );
-    
-    // Make parent a child of node
-    node->parent = parent->parent;
-    if (parent->parent != nullptr) {
-        // Replace parent in grandparent's children
-        for (auto& child : parent->parent->children) {
-            if (child == parent) {
-                child = node;
-                break;
-            }
-        }
+    auto grandparent = parent->parent;
+    size_t parentIndex = grandparent ? childIndex(*grandparent, *parent) : 0;
+    
+    size_t index = childIndex(*parent, *node);
+    size_t split = leftChildCount(*node);
+    auto& pc = parent->children;
+    auto& nc = node->children;
+    
+    // Both new lists are built in scratch_ before either is overwritten
+    scratch_.assign(pc.begin(), pc.begin() + index);
+    scratch_.insert(scratch_.end(), nc.begin(), nc.begin() + split);
+    scratch_.push_back(parent);
+    size_t nodeCount = scratch_.size();
+    scratch_.insert(scratch_.end(), nc.begin() + split, nc.end());
+    scratch_.insert(scratch_.end(), pc.begin() + index + 1, pc.end());
+    
+    node->children.assign(scratch_.data(), scratch_.data() + nodeCount);
+    parent->children.assign(scratch_.data() + nodeCount, scratch_.data() + scratch_.size());
+    for (Node* child : parent->children) child->parent = parent;
+    for (Node* child : node->children) child->parent = node;
+    
+    // node's subtree covers the same interval parent's did
+    node->parent = grandparent;
+    if (grandparent != nullptr) {
+        grandparent->children[parentIndex] = node;
+        journal_.changed(*grandparent);
     }
     
-    // Move parent's other children to node
-    for (auto& child : parent->children) {
-        if (child != node) {
-            child->parent = node;
-            node->children.push_back(child);
-        }
-    }
-    
-    parent->parent = node;
-    node->children.push_back(parent);
-    
-    // Sort children by key
-    std::sort(node->children.begin(), node->children.end(),
-        [](const std::shared_ptr<Node>& a, const std::shared_ptr<Node>& b) {
-            return a->key < b->key;
-        });
-    
-    updateSubtreeSize(node);
     updateSubtreeSize(parent);
+    updateSubtreeSize(node);
+    stats_.add(TreeCounter::ROTATIONS);
 }
 
 template<typename Key, typename Value>
-void NSplayTree<Key, Value>::zag(std::shared_ptr<Node> node) {
+void NSplayTree<Key, Value>::zag(Node* node) {
+    // Mirror of zig: node sits in parent's right group
     auto parent = node->parent;
     if (parent == nullptr) return;
+    auto grandparent = parent->parent;
+    size_t parentIndex = grandparent ? childIndex(*grandparent, *parent) : 0;
+    
+    size_t index = childIndex(*parent, *node);
+    size_t split = leftChildCount(*node);
+    auto& pc = parent->children;
+    auto& nc = node->children;
+    
+    scratch_.assign(pc.begin(), pc.begin() + index);
+    scratch_.insert(scratch_.end(), nc.begin(), nc.begin() + split);
+    size_t parentCount = scratch_.size();
+    scratch_.push_back(parent);
+    scratch_.insert(scratch_.end(), nc.begin() + split, nc.end());
+    scratch_.insert(scratch_.end(), pc.begin() + index + 1, pc.end());
+    
+    parent->children.assign(scratch_.data(), scratch_.data() + parentCount);
+    node->children.assign(scratch_.data() + parentCount, scratch_.data() + scratch_.size());
+    for (Node* child : parent->children) child->parent = parent;
+    for (Node* child : node->children) child->parent = node;
+    
+    node->parent = grandparent;
+    if (grandparent != nullptr) {
+        grandparent->children[parentIndex] = node;
+        journal_.changed(*grandparent);
+    }
     
-    // Similar to zig but node is rightmost child
-    zig(node);  // For simplicity, we'll use zig logic
-    // In a full implementation, zag would be the mirror
+    updateSubtreeSize(parent);
+    updateSubtreeSize(node);
+    stats_.add(TreeCounter::ROTATIONS);
 }
 
 template<typename Key, typename Value>
-void NSplayTree<Key, Value>::zigZig(std::shared_ptr<Node> node) {
+void NSplayTree<Key, Value>::zigZig(Node* node) {
     zig(node->parent);
     zig(node);
 }
 
 template<typename Key, typename Value>
-void NSplayTree<Key, Value>::zagZag(std::shared_ptr<Node> node) {
+void NSplayTree<Key, Value>::zagZag(Node* node) {
     zag(node->parent);
     zag(node);
 }
 
 template<typename Key, typename Value>
-void NSplayTree<Key, Value>::zigZag(std::shared_ptr<Node> node) {
+void NSplayTree<Key, Value>::zigZag(Node* node) {
     zig(node);
     zag(node);
 }
 
 template<typename Key, typename Value>
-void NSplayTree<Key, Value>::zagZig(std::shared_ptr<Node> node) {
+void NSplayTree<Key, Value>::zagZig(Node* node) {
     zag(node);
     zig(node);
 }
 
 template<typename Key, typename Value>
-void NSplayTree<Key, Value>::adjustBranching(std::shared_ptr<Node> node) {
+int NSplayTree<Key, Value>::optimalBranching(int subtreeSize) const {
+    return std::min(maxBranching_,
+                    std::max(initialBranching_, static_cast<int>(std::sqrt(subtreeSize))));
+}
+
+template<typename Key, typename Value>
+void NSplayTree<Key, Value>::adjustBranching(Node* node) {
     if (node == nullptr) return;
     
-    int currentSize = node->subtreeSize.load();
-    int optimalBranching = std::min(maxBranching_, 
-                                   std::max(initialBranching_, 
-                                           static_cast<int>(std::sqrt(currentSize))));
-    
-    if (node->maxChildren != optimalBranching && node->children.size() <= optimalBranching) {
-        node->maxChildren = optimalBranching;
+    int optimal = optimalBranching(node->subtreeSize);
+    if (node->maxChildren != optimal && node->children.size() <= static_cast<size_t>(optimal)) {
+        node->maxChildren = optimal;
+        journal_.changed(*node);
     }
     
     // If node has too many children, split
-    if (node->children.size() > node->maxChildren) {
+    if (node->children.size() > static_cast<size_t>(node->maxChildren)) {
         splitNode(node);
     }
 }
 
 template<typename Key, typename Value>
-void NSplayTree<Key, Value>::splitNode(std::shared_ptr<Node> node) {
-    if (node->children.size() <= node->maxChildren) return;
-    
-    int mid = node->children.size() / 2;
-    auto newNode = std::make_shared<Node>(node->children[mid]->key, 
-                                         node->children[mid]->value,
-                                         node->maxChildren);
-    newNode->parent = node->parent;
-    
-    // Move half children to new node
-    for (size_t i = mid + 1; i < node->children.size(); i++) {
-        node->children[i]->parent = newNode;
-        newNode->children.push_back(node->children[i]);
-    }
-    
-    node->children.resize(mid + 1);
-    
-    // Insert new node into parent
-    if (node->parent != nullptr) {
-        auto it = node->parent->children.begin();
-        while (it != node->parent->children.end() && (*it)->key < newNode->key) {
-            ++it;
-        }
-        node->parent->children.insert(it, newNode);
+void NSplayTree<Key, Value>::splitNode(Node* node) {
+    // Push excess children down: within the larger group, a run of
+    // adjacent siblings is handed to the middle one, which takes the
+    // lower ones into its left group and the higher ones into its right.
+    // The node's subtree is unchanged, so ancestors need no update; the
+    // adopting child may overflow in turn.
+    std::vector<Node*> pending{node};
+    while (!pending.empty()) {
+        Node* current = pending.back();
+        pending.pop_back();
         
-        if (node->parent->children.size() > node->parent->maxChildren) {
-            splitNode(node->parent);
+        while (current->children.size() > static_cast<size_t>(current->maxChildren)) {
+            auto& children = current->children;
+            size_t split = leftChildCount(*current);
+            bool leftLarger = split >= children.size() - split;
+            size_t lo = leftLarger ? 0 : split;
+            size_t groupSize = leftLarger ? split : children.size() - split;
+            if (groupSize < 2) break;
+            
+            size_t take = std::min(children.size() - current->maxChildren, groupSize - 1);
+            size_t first = lo + (groupSize - (take + 1)) / 2;
+            size_t last = first + take;  // Inclusive
+            size_t middle = first + take / 2;
+            Node* adopter = children[middle];
+            
+            scratch_.assign(children.begin() + first, children.begin() + middle);
+            scratch_.insert(scratch_.end(), adopter->children.begin(), adopter->children.end());
+            scratch_.insert(scratch_.end(), children.begin() + middle + 1,
+                            children.begin() + last + 1);
+            adopter->children.assign(scratch_.data(), scratch_.data() + scratch_.size());
+            for (Node* child : adopter->children) child->parent = adopter;
+            
+            children.erase(middle + 1, last + 1);
+            children.erase(first, middle);
+            journal_.changed(*current);
+            stats_.add(TreeCounter::SPLITS);
+            
+            updateSubtreeSize(adopter);
+            adopter->maxChildren = std::max(adopter->maxChildren,
+                                            optimalBranching(adopter->subtreeSize));
+            if (adopter->children.size() > static_cast<size_t>(adopter->maxChildren)) {
+                pending.push_back(adopter);
+            }
         }
-    } else {
-        // Create new root
-        auto newRoot = std::make_shared<Node>(node->key, node->value, node->maxChildren);
-        newRoot->children.push_back(node);
-        newRoot->children.push_back(newNode);
-        node->parent = newRoot;
-        newNode->parent = newRoot;
-        root_ = newRoot;
     }
-    
-    updateSubtreeSize(node);
-    updateSubtreeSize(newNode);
 }
 
 template<typename Key, typename Value>
-void NSplayTree<Key, Value>::updateSubtreeSize(std::shared_ptr<Node> node) {
+void NSplayTree<Key, Value>::updateSubtreeSize(Node* node) {
+    // Recompute size and maximum from the children; callers walk upwards
+    // themselves where ancestors change too
     if (node == nullptr) return;
     
     int size = 1;
-    for (auto& child : node->children) {
-        size += child->subtreeSize.load();
+    for (Node* child : node->children) {
+        size += child->subtreeSize;
     }
     node->subtreeSize = size;
     
-    if (node->parent != nullptr) {
-        updateSubtreeSize(node->parent);
-    }
+    const auto& children = node->children;
+    node->maxKey = (!children.empty() && node->key < children.back()->key)
+        ? children.back()->maxKey : node->key;
+    
+    // Every structural change passes through here for the nodes it touches
+    journal_.changed(*node);
 }
 
 template<typename Key, typename Value>
 bool NSplayTree<Key, Value>::remove(const Key& key) {
-    std::lock_guard<std::mutex> lock(treeMutex_);
-    
+    CombinedOp op{CombinedOp::REMOVE, &key, nullptr};
+    if (runCombined(op)) {
+        return op.result;
+    }
+    TreeStats::Lock lock(treeMutex_, stats_);
+    return removeLocked(key);
+}
+
+template<typename Key, typename Value>
+bool NSplayTree<Key, Value>::removeLocked(const Key& key) {
     auto node = findNode(key);
     if (node == nullptr || node->key != key) {
         return false;
@@ -378,237 +421,553 @@ bool NSplayTree<Key, Value>::remove(const Key& key) {
 }
 
 template<typename Key, typename Value>
-void NSplayTree<Key, Value>::removeNode(std::shared_ptr<Node> node) {
-    if (node->children.empty()) {
-        // Leaf node - just remove from parent
-        if (node->parent != nullptr) {
-            node->parent->children.erase(
-                std::remove_if(node->parent->children.begin(), 
-                              node->parent->children.end(),
-                    [&node](const std::shared_ptr<Node>& n) { return n == node; }),
-                node->parent->children.end()
-            );
-            updateSubtreeSize(node->parent);
-        } else {
-            root_ = nullptr;
-        }
+void NSplayTree<Key, Value>::removeNode(Node* node) {
+    // node is the root. Join its groups under the smallest right child
+    // (or, without one, the largest left child): that child's subtree
+    // lies between the two groups, so it adopts the rest of them.
+    journal_.removed(*node);
+    auto& children = node->children;
+    if (children.empty()) {
+        pool_.destroy(node);
+        root_ = nullptr;
+        return;
+    }
+    
+    size_t split = leftChildCount(*node);
+    Node* newRoot;
+    if (split < children.size()) {
+        newRoot = children[split];
+        scratch_.assign(children.begin(), children.begin() + split);
+        scratch_.insert(scratch_.end(), newRoot->children.begin(), newRoot->children.end());
+        scratch_.insert(scratch_.end(), children.begin() + split + 1, children.end());
     } else {
-        // Find successor and replace
-        auto successor = node->children[0];
-        while (!successor->children.empty()) {
-            successor = successor->children[0];
-        }
-        
-        node->key = successor->key;
-        node->value = successor->value;
-        removeNode(successor);
+        newRoot = children[split - 1];
+        scratch_.assign(children.begin(), children.begin() + split - 1);
+        scratch_.insert(scratch_.end(), newRoot->children.begin(), newRoot->children.end());
     }
+    
+    newRoot->children.assign(scratch_.data(), scratch_.data() + scratch_.size());
+    for (Node* child : newRoot->children) child->parent = newRoot;
+    newRoot->parent = nullptr;
+    pool_.destroy(node);
+    root_ = newRoot;
+    stats_.add(TreeCounter::MERGES);
+    
+    updateSubtreeSize(newRoot);
+    adjustBranching(newRoot);
 }
 
 template<typename Key, typename Value>
 std::vector<std::pair<Key, Value>> NSplayTree<Key, Value>::inOrderTraversal() {
-    std::lock_guard<std::mutex> lock(treeMutex_);
+    TreeStats::Lock lock(treeMutex_, stats_);
     std::vector<std::pair<Key, Value>> result;
-    inOrderHelper(root_, result);
+    result.reserve(calculateSize(root_));
+    inOrderHelper(root_, [&result](const Node& node) {
+        result.push_back({node.key, node.value});
+    });
     return result;
 }
 
 template<typename Key, typename Value>
-void NSplayTree<Key, Value>::inOrderHelper(std::shared_ptr<Node> node,
-                                          std::vector<std::pair<Key, Value>>& result) const {
-    if (node == nullptr) return;
+std::vector<std::pair<Key, Value>> NSplayTree<Key, Value>::inOrderTraversalParallel() {
+    TreeExecutor& executor = taskGroup().executor();
+    TreeStats::Lock lock(treeMutex_, stats_);
+    std::vector<std::pair<Key, Value>> result(calculateSize(root_));
+    size_t grain = exportGrain(result.size(), executor);
+    
+    // inOrderHelper's walk over the nodes above the pieces: a child
+    // subtree of at most grain entries is cut off instead of entered
+    struct Frame {
+        Node* node;
+        size_t next;
+        size_t split;
+    };
+    std::vector<Frame> stack;
+    std::vector<ExportPiece<Node*>> pieces;
+    size_t position = 0;
+    auto enter = [&](Node* node) {
+        size_t size = static_cast<size_t>(node->subtreeSize);
+        if (size <= grain) {
+            pieces.push_back({node, position, size});
+            position += size;
+        } else {
+            stack.push_back({node, 0, leftChildCount(*node)});
+        }
+    };
+    if (root_ != nullptr) enter(root_);
     
-    for (size_t i = 0; i < node->children.size(); i++) {
-        inOrderHelper(node->children[i], result);
-        if (i < node->children.size() - 1) {
-            result.push_back({node->key, node->value});
+    while (!stack.empty()) {
+        Frame& frame = stack.back();
+        if (frame.next == frame.split) {
+            result[position++] = {frame.node->key, frame.node->value};
+        }
+        if (frame.next < frame.node->children.size()) {
+            enter(frame.node->children[frame.next++]);
+        } else {
+            stack.pop_back();
         }
     }
     
-    if (node->children.empty()) {
-        result.push_back({node->key, node->value});
-    }
+    exportPieces(executor, result, position, pieces,
+        [this](Node* subtree, std::pair<Key, Value>* out) {
+            size_t written = 0;
+            inOrderHelper(subtree, [&](const Node& node) {
+                out[written++] = {node.key, node.value};
+            });
+            return written;
+        });
+    return result;
 }
 
 template<typename Key, typename Value>
-void NSplayTree<Key, Value>::startWorkerThreads(int numThreads) {
-    if (running_) return;
+template<typename Visit>
+void NSplayTree<Key, Value>::inOrderHelper(Node* node, Visit visit) const {
+    // Left group, node, right group; iterative so depth is not bounded by
+    // the call stack
+    struct Frame {
+        Node* node;
+        size_t next;
+        size_t split;
+    };
+    std::vector<Frame> stack;
+    if (node != nullptr) {
+        stack.push_back({node, 0, leftChildCount(*node)});
+    }
     
-    running_ = true;
-    for (int i = 0; i < numThreads; i++) {
-        workerThreads_.emplace_back(&NSplayTree::workerThread, this);
+    while (!stack.empty()) {
+        Frame& frame = stack.back();
+        if (frame.next == frame.split) {
+            visit(*frame.node);
+        }
+        if (frame.next < frame.node->children.size()) {
+            Node* child = frame.node->children[frame.next++];
+            stack.push_back({child, 0, leftChildCount(*child)});
+        } else {
+            stack.pop_back();
+        }
     }
 }
 
 template<typename Key, typename Value>
-void NSplayTree<Key, Value>::stopWorkerThreads() {
-    if (!running_) return;
-    
-    running_ = false;
-    queueCondition_.notify_all();
+template<typename Visit>
+void NSplayTree<Key, Value>::searchBatch(const Key* keys, size_t count, Visit visit) {
+    TreeStats::Lock lock(treeMutex_, stats_);
+    for (size_t i = 0; i < count; i++) {
+        visit(i, static_cast<const Value*>(searchLocked(keys[i])));
+    }
+}
+
+template<typename Key, typename Value>
+template<typename ValueAt, typename Result>
+size_t NSplayTree<Key, Value>::insertBatch(const Key* keys, size_t count, ValueAt valueAt, Result* results) {
+    TreeStats::Lock lock(treeMutex_, stats_);
+    size_t inserted = 0;
+    for (size_t i = 0; i < count; i++) {
+        bool added = insertLocked(keys[i], valueAt(i));
+        if (results) results[i] = added;
+        if (added) inserted++;
+    }
+    return inserted;
+}
+
+template<typename Key, typename Value>
+std::shared_ptr<const FrozenIndex<Key, Value>> NSplayTree<Key, Value>::freeze() {
+    return std::make_shared<const FrozenIndex<Key, Value>>(inOrderTraversal());
+}
+
+template<typename Key, typename Value>
+size_t NSplayTree<Key, Value>::thaw(const FrozenIndex<Key, Value>& frozen) {
+    TreeStats::Lock lock(treeMutex_, stats_);
+    size_t inserted = 0;
+    frozen.forEach([&](const Key& key, const Value& value) {
+        if (insertLocked(key, value)) inserted++;
+    });
+    return inserted;
+}
+
+template<typename Key, typename Value>
+std::vector<AccessStat<Key>> NSplayTree<Key, Value>::accessStats() const {
+    TreeStats::Lock lock(treeMutex_, stats_);
+    std::vector<AccessStat<Key>> result;
+    result.reserve(calculateSize(root_));
+    inOrderHelper(root_, [&result](const Node& node) {
+        result.push_back({node.key, node.accessCount, node.maxChildren});
+    });
+    return result;
+}
+
+template<typename Key, typename Value>
+size_t NSplayTree<Key, Value>::applyAccessStats(const std::vector<AccessStat<Key>>& stats) {
+    TreeStats::Lock lock(treeMutex_, stats_);
+    std::vector<Node*> sorted;
+    sorted.reserve(calculateSize(root_));
+    inOrderHelper(root_, [&sorted](Node& node) { sorted.push_back(&node); });
+    if (sorted.empty()) return 0;
+    
+    // Both lists are in key order
+    size_t matched = 0;
+    auto stat = stats.begin();
+    for (Node* node : sorted) {
+        while (stat != stats.end() && stat->key < node->key) ++stat;
+        if (stat == stats.end()) break;
+        if (stat->key == node->key) {
+            node->accessCount = stat->accessCount;
+            if (stat->maxChildren > 0) {
+                node->maxChildren = std::min(std::max(stat->maxChildren, initialBranching_),
+                                             std::max(maxBranching_, initialBranching_));
+            }
+            matched++;
+        }
+    }
     
-    for (auto& thread : workerThreads_) {
-        if (thread.joinable()) {
-            thread.join();
+    std::vector<uint64_t> prefix(sorted.size() + 1, 0);
+    for (size_t i = 0; i < sorted.size(); i++) {
+        prefix[i + 1] = prefix[i] + static_cast<uint64_t>(std::max(sorted[i]->accessCount, 0)) + 1;
+    }
+    root_ = buildWeighted(sorted, prefix, 0, sorted.size(), nullptr);
+    return matched;
+}
+
+template<typename Key, typename Value>
+typename NSplayTree<Key, Value>::Node*
+NSplayTree<Key, Value>::buildWeighted(const std::vector<Node*>& sorted,
+                                      const std::vector<uint64_t>& prefix,
+                                      size_t lo, size_t hi, Node* parent) {
+    // Each level at least halves the weight below it, so the recursion
+    // is at most about 64 deep
+    size_t mid = weightedMedian(prefix, lo, hi);
+    Node* node = sorted[mid];
+    node->parent = parent;
+    node->children.clear();
+    
+    // Children go to each side in proportion to its weight, at least one
+    // to a side with keys, none beyond a side's key count
+    size_t leftKeys = mid - lo;
+    size_t rightKeys = hi - mid - 1;
+    size_t fanout = std::min(static_cast<size_t>(node->maxChildren), leftKeys + rightKeys);
+    size_t leftGroups = 0;
+    if (leftKeys > 0 && rightKeys > 0) {
+        uint64_t leftWeight = prefix[mid] - prefix[lo];
+        uint64_t rightWeight = prefix[hi] - prefix[mid + 1];
+        double share = static_cast<double>(leftWeight) / static_cast<double>(leftWeight + rightWeight);
+        leftGroups = static_cast<size_t>(share * fanout + 0.5);
+        leftGroups = std::min(std::max<size_t>(leftGroups, 1), fanout - 1);
+    } else if (leftKeys > 0) {
+        leftGroups = fanout;
+    }
+    size_t rightGroups = std::min(fanout - leftGroups, rightKeys);
+    leftGroups = std::min(leftGroups, leftKeys);
+    
+    // Cut [first, last) into groups of about equal weight, none empty
+    auto addGroups = [&](size_t first, size_t last, size_t groups) {
+        uint64_t weight = prefix[last] - prefix[first];
+        size_t start = first;
+        for (size_t g = 1; g <= groups; g++) {
+            size_t end = last;
+            if (g < groups) {
+                uint64_t target = prefix[first] + weight * g / groups;
+                end = static_cast<size_t>(std::lower_bound(prefix.begin() + start + 1,
+                                                           prefix.begin() + last + 1, target)
+                                          - prefix.begin());
+                end = std::min(std::max(end, start + 1), last - (groups - g));
+            }
+            node->children.push_back(buildWeighted(sorted, prefix, start, end, node));
+            start = end;
         }
+    };
+    addGroups(lo, mid, leftGroups);
+    addGroups(mid + 1, hi, rightGroups);
+    
+    updateSubtreeSize(node);
+    return node;
+}
+
+template<typename Key, typename Value>
+void NSplayTree<Key, Value>::startWorkerThreads(int numThreads) {
+    taskGroup(numThreads);
+}
+
+template<typename Key, typename Value>
+void NSplayTree<Key, Value>::stopWorkerThreads() {
+    TreeExecutor::TaskGroup* tasks;
+    {
+        std::lock_guard<std::mutex> lock(tasksMutex_);
+        tasks = tasks_.get();
+    }
+    if (tasks) {
+        tasks->wait();
     }
-    workerThreads_.clear();
 }
 
 template<typename Key, typename Value>
-void NSplayTree<Key, Value>::workerThread() {
-    while (running_) {
-        std::unique_lock<std::mutex> lock(queueMutex_);
-        queueCondition_.wait(lock, [this] { 
-            return !taskQueue_.empty() || !running_; 
-        });
-        
-        if (!running_ && taskQueue_.empty()) break;
-        
-        if (!taskQueue_.empty()) {
-            auto task = taskQueue_.front();
-            taskQueue_.pop();
-            lock.unlock();
-            task();
-        }
+TreeExecutor::TaskGroup& NSplayTree<Key, Value>::taskGroup(int numThreads) {
+    std::lock_guard<std::mutex> lock(tasksMutex_);
+    if (!tasks_) {
+        tasks_ = std::make_unique<TreeExecutor::TaskGroup>(
+            TreeExecutor::shared(static_cast<size_t>(std::max(numThreads, 0))));
     }
+    return *tasks_;
 }
 
 template<typename Key, typename Value>
-void NSplayTree<Key, Value>::enqueueTask(std::function<void()> task) {
-    std::lock_guard<std::mutex> lock(queueMutex_);
-    taskQueue_.push(task);
-    queueCondition_.notify_one();
+bool NSplayTree<Key, Value>::enqueueTask(std::function<void()> task) {
+    return taskGroup().submit(std::move(task));
 }
 
 template<typename Key, typename Value>
-void NSplayTree<Key, Value>::insertAsync(const Key& key, const Value& value,
+bool NSplayTree<Key, Value>::insertAsync(const Key& key, const Value& value,
                                          std::function<void(bool)> callback) {
-    enqueueTask([this, key, value, callback]() {
+    return enqueueTask([this, key, value, callback]() {
         bool result = insert(key, value);
         if (callback) callback(result);
     });
 }
 
 template<typename Key, typename Value>
-void NSplayTree<Key, Value>::deleteAsync(const Key& key,
+bool NSplayTree<Key, Value>::deleteAsync(const Key& key,
                                         std::function<void(bool)> callback) {
-    enqueueTask([this, key, callback]() {
+    return enqueueTask([this, key, callback]() {
         bool result = remove(key);
         if (callback) callback(result);
     });
 }
 
 template<typename Key, typename Value>
-void NSplayTree<Key, Value>::searchAsync(const Key& key,
+bool NSplayTree<Key, Value>::searchAsync(const Key& key,
                                         std::function<void(Value*)> callback) {
-    enqueueTask([this, key, callback]() {
+    return enqueueTask([this, key, callback]() {
         Value* result = search(key);
         if (callback) callback(result);
     });
 }
 
+template<typename Key, typename Value>
+TreeFuture<bool> NSplayTree<Key, Value>::insertFuture(const Key& key, const Value& value) {
+    return runAsFuture<bool>(taskGroup(), [this, key, value]() {
+        return insert(key, value);
+    });
+}
+
+template<typename Key, typename Value>
+TreeFuture<bool> NSplayTree<Key, Value>::deleteFuture(const Key& key) {
+    return runAsFuture<bool>(taskGroup(), [this, key]() {
+        return remove(key);
+    });
+}
+
+template<typename Key, typename Value>
+TreeFuture<std::optional<Value>> NSplayTree<Key, Value>::searchFuture(const Key& key) {
+    return runAsFuture<std::optional<Value>>(taskGroup(), [this, key]() {
+        std::optional<Value> copy;
+        CombinedOp op{CombinedOp::SEARCH, &key, nullptr};
+        op.copy = &copy;
+        if (runCombined(op)) {
+            return copy;
+        }
+        TreeStats::Lock lock(treeMutex_, stats_);
+        Value* value = searchLocked(key);
+        return value ? std::optional<Value>(*value) : std::nullopt;
+    });
+}
+
+template<typename Key, typename Value>
+void NSplayTree<Key, Value>::enableFlatCombining(size_t maxThreads) {
+    if (!combiner_) {
+        combiner_ = std::make_unique<FlatCombiner<CombinedOp>>(std::max<size_t>(maxThreads, 1));
+    }
+}
+
+template<typename Key, typename Value>
+bool NSplayTree<Key, Value>::runCombined(CombinedOp& op) {
+    // false: combining is off or out of slots, caller takes the lock itself
+    return combiner_ && combiner_->execute(op, treeMutex_, stats_,
+        [this](std::vector<CombinedOp*>& batch) { applyCombined(batch); });
+}
+
+template<typename Key, typename Value>
+void NSplayTree<Key, Value>::applyCombined(std::vector<CombinedOp*>& batch) {
+    // In key order each operation starts next to the node the previous one
+    // just splayed to the root
+    std::sort(batch.begin(), batch.end(), [](const CombinedOp* a, const CombinedOp* b) {
+        return *a->key < *b->key;
+    });
+    
+    for (CombinedOp* op : batch) {
+        switch (op->kind) {
+            case CombinedOp::INSERT:
+                op->result = insertLocked(*op->key, *op->value);
+                break;
+            case CombinedOp::REMOVE:
+                op->result = removeLocked(*op->key);
+                break;
+            case CombinedOp::SEARCH:
+                op->found = searchLocked(*op->key);
+                if (op->copy && op->found) {
+                    *op->copy = *op->found;
+                }
+                break;
+        }
+    }
+}
+
 template<typename Key, typename Value>
 size_t NSplayTree<Key, Value>::size() const {
-    std::lock_guard<std::mutex> lock(treeMutex_);
+    TreeStats::Lock lock(treeMutex_, stats_);
     return calculateSize(root_);
 }
 
 template<typename Key, typename Value>
-size_t NSplayTree<Key, Value>::calculateSize(std::shared_ptr<Node> node) const {
+size_t NSplayTree<Key, Value>::calculateSize(const Node* node) const {
     if (node == nullptr) return 0;
-    return node->subtreeSize.load();
+    return node->subtreeSize;
 }
 
 template<typename Key, typename Value>
 int NSplayTree<Key, Value>::height() const {
-    std::lock_guard<std::mutex> lock(treeMutex_);
+    TreeStats::Lock lock(treeMutex_, stats_);
     return calculateHeight(root_);
 }
 
 template<typename Key, typename Value>
-int NSplayTree<Key, Value>::calculateHeight(std::shared_ptr<Node> node) const {
+int NSplayTree<Key, Value>::calculateHeight(const Node* node) const {
+    // Level-order walk; splay trees can be deep enough to overflow a
+    // recursive one
     if (node == nullptr) return 0;
-    if (node->children.empty()) return 1;
     
-    int maxChildHeight = 0;
-    for (auto& child : node->children) {
-        maxChildHeight = std::max(maxChildHeight, calculateHeight(child));
+    int height = 0;
+    std::vector<const Node*> level{node};
+    std::vector<const Node*> next;
+    while (!level.empty()) {
+        height++;
+        next.clear();
+        for (const Node* n : level) {
+            for (Node* child : n->children) {
+                next.push_back(child);
+            }
+        }
+        level.swap(next);
     }
-    return 1 + maxChildHeight;
+    return height;
 }
 
 template<typename Key, typename Value>
 double NSplayTree<Key, Value>::averageDepth() const {
-    std::lock_guard<std::mutex> lock(treeMutex_);
-    size_t treeSize = size();
+    TreeStats::Lock lock(treeMutex_, stats_);
+    size_t treeSize = calculateSize(root_);
     if (treeSize == 0) return 0.0;
     return calculateAverageDepth(root_, 0) / treeSize;
 }
 
 template<typename Key, typename Value>
-double NSplayTree<Key, Value>::calculateAverageDepth(std::shared_ptr<Node> node, 
+double NSplayTree<Key, Value>::calculateAverageDepth(const Node* node, 
                                                      int depth) const {
+    // Sum of depths below node, which itself sits at depth
     if (node == nullptr) return 0.0;
     
-    double total = depth;
-    for (auto& child : node->children) {
-        total += calculateAverageDepth(child, depth + 1);
+    double total = 0.0;
+    std::vector<std::pair<const Node*, int>> stack{{node, depth}};
+    while (!stack.empty()) {
+        auto [current, currentDepth] = stack.back();
+        stack.pop_back();
+        total += currentDepth;
+        for (Node* child : current->children) {
+            stack.push_back({child, currentDepth + 1});
+        }
     }
-    
     return total;
 }
 
 template<typename Key, typename Value>
 void NSplayTree<Key, Value>::setMaxBranching(int maxBranch) {
-    std::lock_guard<std::mutex> lock(treeMutex_);
+    TreeStats::Lock lock(treeMutex_, stats_);
     maxBranching_ = maxBranch;
 }
 
+template<typename Key, typename Value>
+TreeStatsReport NSplayTree<Key, Value>::getStats() const {
+    TreeStatsReport report = stats_.report();
+    std::lock_guard<std::mutex> lock(tasksMutex_);
+    if (tasks_) {
+        report.queueDepth = tasks_->pending();
+        report.executorQueued = tasks_->executor().pendingTasks();
+    }
+    return report;
+}
+
+template<typename Key, typename Value>
+typename NSplayTree<Key, Value>::TreeSnapshot::NodeInfo
+NSplayTree<Key, Value>::nodeInfo(const Node& node) const {
+    typename TreeSnapshot::NodeInfo info;
+    info.id = node.id;
+    info.key = node.key;
+    info.value = node.value;
+    info.accessCount = node.accessCount;
+    info.subtreeSize = node.subtreeSize;
+    info.maxChildren = node.maxChildren;
+    info.childIds.reserve(node.children.size());
+    for (Node* child : node.children) {
+        info.childIds.push_back(child->id);
+    }
+    return info;
+}
+
 template<typename Key, typename Value>
 typename NSplayTree<Key, Value>::TreeSnapshot NSplayTree<Key, Value>::getSnapshot() const {
-    std::lock_guard<std::mutex> lock(treeMutex_);
+    TreeStats::Lock lock(treeMutex_, stats_);
     TreeSnapshot snapshot;
+    snapshot.version = journal_.version();
+    
+    // Level order: children get their indices as they are queued
+    std::vector<Node*> order;
+    if (root_) order.push_back(root_);
+    for (size_t i = 0; i < order.size(); i++) {
+        const Node& node = *order[i];
+        snapshot.nodes.push_back(nodeInfo(node));
+        for (Node* child : node.children) {
+            snapshot.nodes[i].childIndices.push_back(order.size());
+            snapshot.edges.push_back({i, order.size()});
+            order.push_back(child);
+        }
+    }
     
-    std::map<std::shared_ptr<Node>, size_t> nodeToIndex;
-    
-    std::function<void(std::shared_ptr<Node>)> assignIndices = 
-        [&](std::shared_ptr<Node> node) {
-            if (node == nullptr) return;
-            nodeToIndex[node] = snapshot.nodes.size();
-            typename TreeSnapshot::NodeInfo info;
-            info.key = node->key;
-            info.value = node->value;
-            info.accessCount = node->accessCount.load();
-            info.subtreeSize = node->subtreeSize.load();
-            info.maxChildren = node->maxChildren;
-            snapshot.nodes.push_back(info);
-            
-            for (auto& child : node->children) {
-                assignIndices(child);
-            }
-        };
-    
-    assignIndices(root_);
-    
-    std::function<void(std::shared_ptr<Node>, size_t)> buildEdges = 
-        [&](std::shared_ptr<Node> node, size_t parentIndex) {
-            if (node == nullptr) return;
-            
-            size_t nodeIndex = nodeToIndex[node];
-            
-            if (parentIndex != SIZE_MAX) {
-                snapshot.edges.push_back({parentIndex, nodeIndex});
-            }
-            
-            for (auto& child : node->children) {
-                snapshot.nodes[nodeIndex].childIndices.push_back(nodeToIndex[child]);
-                buildEdges(child, nodeIndex);
+    // Later calls can ask for just the changes since this version
+    journal_.startTracking(order);
+    return snapshot;
+}
+
+template<typename Key, typename Value>
+typename NSplayTree<Key, Value>::SnapshotDelta
+NSplayTree<Key, Value>::getSnapshotSince(uint64_t version) const {
+    SnapshotDelta delta;
+    std::vector<Node*> changed;
+    {
+        TreeStats::Lock lock(treeMutex_, stats_);
+        if (journal_.changesSince(version, changed, delta.removedIds)) {
+            delta.fromVersion = version;
+            delta.version = journal_.version();
+            delta.full = false;
+            delta.rootId = root_ ? root_->id : 0;
+            delta.nodes.reserve(changed.size());
+            for (Node* node : changed) {
+                delta.nodes.push_back(nodeInfo(*node));
             }
-        };
+            return delta;
+        }
+    }
     
-    buildEdges(root_, SIZE_MAX);
-    return snapshot;
+    TreeSnapshot snapshot = getSnapshot();
+    delta.fromVersion = version;
+    delta.version = snapshot.version;
+    delta.full = true;
+    delta.rootId = snapshot.nodes.empty() ? 0 : snapshot.nodes.front().id;
+    delta.nodes = std::move(snapshot.nodes);
+    return delta;
+}
+
+template<typename Key, typename Value>
+uint64_t NSplayTree<Key, Value>::version() const {
+    TreeStats::Lock lock(treeMutex_, stats_);
+    return journal_.version();
 }
 
 // Explicit template instantiations
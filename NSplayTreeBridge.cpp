@@ -1,16 +1,18 @@
 #include "NSplayTreeBridge.h"
 #include "NSplayTree.h"
 #include <string>
-#include <map>
+#include "BridgeBatch.h"
+#include "TraceLog.h"
 #include <cstring>
 #include <vector>
+#include <algorithm>
 
 extern "C" {
 
 struct NSplayTreeWrapper {
     NSplayTree<int, std::string>* tree;
     NSplayTree<RollingChecksum, BlockMetadata>* rsyncTree;
-    std::map<int, std::string> valueCache;
+    TraceRecorder trace;    // The int tree's operations only
     bool isRsyncMode;
     
     NSplayTreeWrapper(int initialBranching, int maxBranching, bool rsync = false)
@@ -51,7 +53,9 @@ int nsplaytree_insert(NSplayTreeHandle handle, int key, const char* value) {
     NSplayTreeWrapper* wrapper = static_cast<NSplayTreeWrapper*>(handle);
     if (!wrapper->tree) return 0;
     
-    bool result = wrapper->tree->insert(key, std::string(value ? value : ""));
+    std::string stored(value ? value : "");
+    wrapper->trace.record(TraceOp::INSERT, key, static_cast<uint32_t>(stored.size()));
+    bool result = wrapper->tree->insert(key, stored);
     return result ? 1 : 0;
 }
 
@@ -60,6 +64,7 @@ int nsplaytree_remove(NSplayTreeHandle handle, int key) {
     NSplayTreeWrapper* wrapper = static_cast<NSplayTreeWrapper*>(handle);
     if (!wrapper->tree) return 0;
     
+    wrapper->trace.record(TraceOp::REMOVE, key);
     bool result = wrapper->tree->remove(key);
     return result ? 1 : 0;
 }
@@ -69,12 +74,18 @@ const char* nsplaytree_search(NSplayTreeHandle handle, int key) {
     NSplayTreeWrapper* wrapper = static_cast<NSplayTreeWrapper*>(handle);
     if (!wrapper->tree) return nullptr;
     
-    std::string* result = wrapper->tree->search(key);
-    if (result) {
-        wrapper->valueCache[key] = *result;
-        return wrapper->valueCache[key].c_str();
-    }
-    return nullptr;
+    wrapper->trace.record(TraceOp::SEARCH, key);
+    // Copied under the tree lock into a per-thread buffer, so other
+    // threads searching or writing the handle cannot change it
+    thread_local std::string value;
+    bool found = false;
+    wrapper->tree->searchBatch(&key, 1, [&found](size_t, const std::string* result) {
+        if (result) {
+            value = *result;
+            found = true;
+        }
+    });
+    return found ? value.c_str() : nullptr;
 }
 
 int nsplaytree_insert_block(NSplayTreeHandle handle, const BlockMetadataC* block) {
@@ -184,6 +195,55 @@ int nsplaytree_get_max_branching(NSplayTreeHandle handle) {
     return 0;
 }
 
+int nsplaytree_search_batch(NSplayTreeHandle handle, const int* keys, int count,
+                            void* out, size_t outCapacity, size_t* outSize) {
+    if (!handle || count < 0 || (count > 0 && !keys) || (outCapacity > 0 && !out) || !outSize) {
+        return NSPLAYTREE_BATCH_INVALID_ARGUMENT;
+    }
+    NSplayTreeWrapper* wrapper = static_cast<NSplayTreeWrapper*>(handle);
+    if (!wrapper->tree) return NSPLAYTREE_BATCH_INVALID_ARGUMENT;
+    wrapper->trace.recordBatch(TraceOp::SEARCH, keys, static_cast<size_t>(count),
+                               [](size_t) { return 0u; });
+    
+    // Records are copied straight out of the tree while the lock is held
+    unsigned char* bytes = static_cast<unsigned char*>(out);
+    size_t used = 0;
+    bool overflow = false;
+    wrapper->tree->searchBatch(keys, static_cast<size_t>(count),
+        [&](size_t, const std::string* value) {
+            BatchRecords::put(bytes, outCapacity, used, overflow, value);
+        });
+    
+    *outSize = used;
+    return overflow ? NSPLAYTREE_BATCH_BUFFER_TOO_SMALL : NSPLAYTREE_BATCH_OK;
+}
+
+int nsplaytree_insert_batch(NSplayTreeHandle handle, const int* keys, int count,
+                            const void* values, size_t valuesSize, int* results) {
+    if (!handle || count < 0 || (count > 0 && !keys) || (valuesSize > 0 && !values)) {
+        return NSPLAYTREE_BATCH_INVALID_ARGUMENT;
+    }
+    NSplayTreeWrapper* wrapper = static_cast<NSplayTreeWrapper*>(handle);
+    if (!wrapper->tree) return NSPLAYTREE_BATCH_INVALID_ARGUMENT;
+    
+    const unsigned char* bytes = static_cast<const unsigned char*>(values);
+    if (!BatchRecords::validate(bytes, valuesSize, static_cast<size_t>(count))) {
+        return NSPLAYTREE_BATCH_INVALID_ARGUMENT;
+    }
+    if (wrapper->trace.active()) {
+        size_t cursor = 0;
+        wrapper->trace.recordBatch(TraceOp::INSERT, keys, static_cast<size_t>(count),
+                                   [&](size_t) { return BatchRecords::skip(bytes, cursor); });
+    }
+    
+    // valueAt is called for i = 0, 1, ... in turn, so one cursor walks the records
+    size_t offset = 0;
+    wrapper->tree->insertBatch(keys, static_cast<size_t>(count),
+        [&](size_t) { return BatchRecords::take(bytes, offset); },
+        results);
+    return NSPLAYTREE_BATCH_OK;
+}
+
 void nsplaytree_start_threads(NSplayTreeHandle handle, int numThreads) {
     if (!handle) return;
     NSplayTreeWrapper* wrapper = static_cast<NSplayTreeWrapper*>(handle);
@@ -242,8 +302,94 @@ double nsplaytree_average_depth(NSplayTreeHandle handle) {
     return 0.0;
 }
 
+static NSplayTreeStats toBridgeStats(const TreeStatsReport& report) {
+    NSplayTreeStats stats;
+    std::memset(&stats, 0, sizeof(stats));
+    stats.enabled = report.enabled ? 1 : 0;
+    stats.lookups = report[TreeCounter::LOOKUPS];
+    stats.nodesVisited = report[TreeCounter::NODES_VISITED];
+    stats.rotations = report[TreeCounter::ROTATIONS];
+    stats.splits = report[TreeCounter::SPLITS];
+    stats.merges = report[TreeCounter::MERGES];
+    stats.lockAcquisitions = report[TreeCounter::LOCK_ACQUISITIONS];
+    stats.lockContended = report[TreeCounter::LOCK_CONTENDED];
+    stats.lockWaitNs = report[TreeCounter::LOCK_WAIT_NS];
+    stats.queueDepth = report.queueDepth;
+    stats.executorQueued = report.executorQueued;
+    static_assert(TreeStatsReport::kBuckets == NSPLAYTREE_STATS_BUCKETS, "bucket count mismatch");
+    std::copy(report.lockWaitNs, report.lockWaitNs + NSPLAYTREE_STATS_BUCKETS, stats.lockWaitHistogram);
+    std::copy(report.nodesPerLookup, report.nodesPerLookup + NSPLAYTREE_STATS_BUCKETS, stats.nodesPerLookupHistogram);
+    return stats;
+}
+
+int nsplaytree_trace_start(NSplayTreeHandle handle, const char* path) {
+    if (!handle || !path) return 0;
+    NSplayTreeWrapper* wrapper = static_cast<NSplayTreeWrapper*>(handle);
+    return wrapper->trace.start(path, TraceSource::NSPLAYTREE) ? 1 : 0;
+}
+
+int nsplaytree_trace_stop(NSplayTreeHandle handle) {
+    if (!handle) return 0;
+    NSplayTreeWrapper* wrapper = static_cast<NSplayTreeWrapper*>(handle);
+    return wrapper->trace.stop() ? 1 : 0;
+}
+
+int nsplaytree_save_access_stats(NSplayTreeHandle handle, const char* path) {
+    if (!handle || !path) return 0;
+    NSplayTreeWrapper* wrapper = static_cast<NSplayTreeWrapper*>(handle);
+    if (wrapper->tree) {
+        return saveAccessStats(path, wrapper->tree->accessStats()) ? 1 : 0;
+    }
+    if (wrapper->rsyncTree) {
+        return saveAccessStats(path, wrapper->rsyncTree->accessStats()) ? 1 : 0;
+    }
+    return 0;
+}
+
+int nsplaytree_load_access_stats(NSplayTreeHandle handle, const char* path) {
+    if (!handle || !path) return -1;
+    NSplayTreeWrapper* wrapper = static_cast<NSplayTreeWrapper*>(handle);
+    if (wrapper->tree) {
+        std::vector<AccessStat<int>> stats;
+        if (!loadAccessStats(path, stats)) return -1;
+        return static_cast<int>(wrapper->tree->applyAccessStats(stats));
+    }
+    if (wrapper->rsyncTree) {
+        std::vector<AccessStat<RollingChecksum>> stats;
+        if (!loadAccessStats(path, stats)) return -1;
+        return static_cast<int>(wrapper->rsyncTree->applyAccessStats(stats));
+    }
+    return -1;
+}
+
+NSplayTreeStats nsplaytree_get_stats(NSplayTreeHandle handle) {
+    if (!handle) return toBridgeStats(TreeStatsReport());
+    NSplayTreeWrapper* wrapper = static_cast<NSplayTreeWrapper*>(handle);
+    if (wrapper->tree) {
+        return toBridgeStats(wrapper->tree->getStats());
+    }
+    if (wrapper->rsyncTree) {
+        return toBridgeStats(wrapper->rsyncTree->getStats());
+    }
+    return toBridgeStats(TreeStatsReport());
+}
+
+void nsplaytree_reset_stats(NSplayTreeHandle handle) {
+    if (!handle) return;
+    NSplayTreeWrapper* wrapper = static_cast<NSplayTreeWrapper*>(handle);
+    if (wrapper->tree) wrapper->tree->resetStats();
+    if (wrapper->rsyncTree) wrapper->rsyncTree->resetStats();
+}
+
+void nsplaytree_enable_stats_histograms(NSplayTreeHandle handle, int enable) {
+    if (!handle) return;
+    NSplayTreeWrapper* wrapper = static_cast<NSplayTreeWrapper*>(handle);
+    if (wrapper->tree) wrapper->tree->enableStatsHistograms(enable != 0);
+    if (wrapper->rsyncTree) wrapper->rsyncTree->enableStatsHistograms(enable != 0);
+}
+
 NSplayTreeSnapshot nsplaytree_get_snapshot(NSplayTreeHandle handle) {
-    NSplayTreeSnapshot snapshot = {0};
+    NSplayTreeSnapshot snapshot = {};
     if (!handle) return snapshot;
     
     NSplayTreeWrapper* wrapper = static_cast<NSplayTreeWrapper*>(handle);
@@ -309,4 +455,73 @@ void nsplaytree_free_snapshot(NSplayTreeSnapshot snapshot) {
     delete[] snapshot.edges;
 }
 
+NSplayTreeSnapshotDelta nsplaytree_get_snapshot_since(NSplayTreeHandle handle, uint64_t version) {
+    NSplayTreeSnapshotDelta delta = {};
+    if (!handle) return delta;
+    
+    NSplayTreeWrapper* wrapper = static_cast<NSplayTreeWrapper*>(handle);
+    if (!wrapper->tree) return delta;
+    
+    auto treeDelta = wrapper->tree->getSnapshotSince(version);
+    
+    delta.fromVersion = treeDelta.fromVersion;
+    delta.version = treeDelta.version;
+    delta.isFull = treeDelta.full ? 1 : 0;
+    delta.rootId = treeDelta.rootId;
+    delta.nodeCount = static_cast<int>(treeDelta.nodes.size());
+    delta.removedCount = static_cast<int>(treeDelta.removedIds.size());
+    
+    if (delta.removedCount > 0) {
+        delta.removedIds = new uint64_t[delta.removedCount];
+        std::copy(treeDelta.removedIds.begin(), treeDelta.removedIds.end(), delta.removedIds);
+    }
+    if (delta.nodeCount == 0) return delta;
+    
+    delta.nodeIds = new uint64_t[delta.nodeCount];
+    delta.keys = new int[delta.nodeCount];
+    delta.values = new char*[delta.nodeCount];
+    delta.childIds = new uint64_t*[delta.nodeCount];
+    delta.childCounts = new int[delta.nodeCount];
+    delta.accessCounts = new int[delta.nodeCount];
+    delta.subtreeSizes = new int[delta.nodeCount];
+    delta.maxChildren = new int[delta.nodeCount];
+    
+    for (int i = 0; i < delta.nodeCount; i++) {
+        const auto& node = treeDelta.nodes[i];
+        delta.nodeIds[i] = node.id;
+        delta.keys[i] = node.key;
+        delta.values[i] = new char[node.value.length() + 1];
+        strcpy(delta.values[i], node.value.c_str());
+        
+        delta.childCounts[i] = static_cast<int>(node.childIds.size());
+        delta.childIds[i] = new uint64_t[delta.childCounts[i]];
+        std::copy(node.childIds.begin(), node.childIds.end(), delta.childIds[i]);
+        
+        delta.accessCounts[i] = node.accessCount;
+        delta.subtreeSizes[i] = node.subtreeSize;
+        delta.maxChildren[i] = node.maxChildren;
+    }
+    
+    return delta;
+}
+
+void nsplaytree_free_snapshot_delta(NSplayTreeSnapshotDelta delta) {
+    delete[] delta.removedIds;
+    if (delta.nodeCount == 0) return;
+    
+    for (int i = 0; i < delta.nodeCount; i++) {
+        delete[] delta.values[i];
+        delete[] delta.childIds[i];
+    }
+    
+    delete[] delta.nodeIds;
+    delete[] delta.keys;
+    delete[] delta.values;
+    delete[] delta.childIds;
+    delete[] delta.childCounts;
+    delete[] delta.accessCounts;
+    delete[] delta.subtreeSizes;
+    delete[] delta.maxChildren;
+}
+
 } // extern "C"
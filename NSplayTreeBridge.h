@@ -37,8 +37,32 @@ void nsplaytree_destroy(NSplayTreeHandle handle);
 // Basic operations
 int nsplaytree_insert(NSplayTreeHandle handle, int key, const char* value);
 int nsplaytree_remove(NSplayTreeHandle handle, int key);
+// The returned string is the calling thread's own copy and stays valid
+// until that thread's next nsplaytree_search
 const char* nsplaytree_search(NSplayTreeHandle handle, int key);
 
+// Batched operations: one lock acquisition per batch, no allocation per
+// call beyond stored values. Values are length-prefixed records packed
+// back to back (uint32_t byte count in native byte order, then the
+// bytes); a missing key is a record of length NSPLAYTREE_BATCH_NOT_FOUND.
+#define NSPLAYTREE_BATCH_OK                0
+#define NSPLAYTREE_BATCH_BUFFER_TOO_SMALL  (-1)
+#define NSPLAYTREE_BATCH_INVALID_ARGUMENT  (-2)
+#define NSPLAYTREE_BATCH_NOT_FOUND         0xFFFFFFFFu
+
+// One record per key into out; on BUFFER_TOO_SMALL *outSize is the
+// capacity needed (the records that fit are written), otherwise the
+// bytes written
+int nsplaytree_search_batch(NSplayTreeHandle handle, const int* keys, int count,
+                            void* out, size_t outCapacity, size_t* outSize);
+
+// keys[i] gets the i-th of exactly count records in values (an existing
+// key takes the new value); results, if not NULL, receives 1 per newly
+// inserted key and 0 per existing one. The records are validated before
+// the tree is touched.
+int nsplaytree_insert_batch(NSplayTreeHandle handle, const int* keys, int count,
+                            const void* values, size_t valuesSize, int* results);
+
 // Rsync operations
 int nsplaytree_insert_block(NSplayTreeHandle handle, const BlockMetadataC* block);
 BlockMetadataC* nsplaytree_find_block(NSplayTreeHandle handle, const RollingChecksumC* checksum);
@@ -61,6 +85,49 @@ int nsplaytree_size(NSplayTreeHandle handle);
 int nsplaytree_height(NSplayTreeHandle handle);
 double nsplaytree_average_depth(NSplayTreeHandle handle);
 
+// Hot-path counters; zero (and enabled 0) unless built with
+// TREE_ENABLE_STATS. Histogram bucket i counts values in [2^(i-1), 2^i),
+// bucket 0 zeros, and fills only after
+// nsplaytree_enable_stats_histograms. Covers whichever tree the handle
+// holds (int or rsync).
+#define NSPLAYTREE_STATS_BUCKETS 32
+
+typedef struct {
+    int enabled;
+    uint64_t lookups;
+    uint64_t nodesVisited;
+    uint64_t rotations;
+    uint64_t splits;             // splitNode hand-downs
+    uint64_t merges;             // Root joins on remove
+    uint64_t lockAcquisitions;
+    uint64_t lockContended;
+    uint64_t lockWaitNs;
+    uint64_t queueDepth;         // This tree's queued or running async tasks
+    uint64_t executorQueued;     // Tasks queued on the shared executor
+    uint64_t lockWaitHistogram[NSPLAYTREE_STATS_BUCKETS];      // ns, contended only
+    uint64_t nodesPerLookupHistogram[NSPLAYTREE_STATS_BUCKETS];
+} NSplayTreeStats;
+
+NSplayTreeStats nsplaytree_get_stats(NSplayTreeHandle handle);
+void nsplaytree_reset_stats(NSplayTreeHandle handle);
+void nsplaytree_enable_stats_histograms(NSplayTreeHandle handle, int enable);
+
+// Operation tracing for tree_replay (TraceLog.h): while running, the int
+// tree's inserts, removes and searches (batched or not) are appended to
+// path. The rsync calls are not traced. Returns 0 if the file cannot be
+// created / if any part of the trace failed to write.
+int nsplaytree_trace_start(NSplayTreeHandle handle, const char* path);
+int nsplaytree_trace_stop(NSplayTreeHandle handle);
+
+// Warm start (AccessStats.h): save writes every key's access count and
+// branching to path; load reads such a file and applies it to the keys
+// now in the tree, rebuilding it with the hot ones near the root. Works
+// for the int and the rsync tree alike. save returns 0 if the file cannot
+// be written; load returns how many keys matched, or -1 if the file
+// cannot be read.
+int nsplaytree_save_access_stats(NSplayTreeHandle handle, const char* path);
+int nsplaytree_load_access_stats(NSplayTreeHandle handle, const char* path);
+
 // Snapshot for visualization
 typedef struct {
     int* keys;
@@ -78,6 +145,31 @@ typedef struct {
 NSplayTreeSnapshot nsplaytree_get_snapshot(NSplayTreeHandle handle);
 void nsplaytree_free_snapshot(NSplayTreeSnapshot snapshot);
 
+// Incremental snapshot: nodes added or modified since a version plus the
+// ids of removed nodes. Start with version 0 and pass back the returned
+// version. A listed node's childIds replace its previous children; with
+// isFull set, nodes holds the whole tree and earlier state is stale.
+typedef struct {
+    uint64_t fromVersion;
+    uint64_t version;
+    int isFull;
+    uint64_t rootId;       // 0 when the tree is empty
+    uint64_t* nodeIds;
+    int* keys;
+    char** values;
+    uint64_t** childIds;
+    int* childCounts;
+    int* accessCounts;
+    int* subtreeSizes;
+    int* maxChildren;
+    int nodeCount;
+    uint64_t* removedIds;
+    int removedCount;
+} NSplayTreeSnapshotDelta;
+
+NSplayTreeSnapshotDelta nsplaytree_get_snapshot_since(NSplayTreeHandle handle, uint64_t version);
+void nsplaytree_free_snapshot_delta(NSplayTreeSnapshotDelta delta);
+
 #ifdef __cplusplus
 }
 #endif
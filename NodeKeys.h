@@ -0,0 +1,249 @@
+/*
+ * Node Keys
+ * Copyright (C) 2025, Shyamal Suhana Chandra
+ * All rights reserved.
+ */
+
+#ifndef NODE_KEYS_H
+#define NODE_KEYS_H
+
+#include <vector>
+#include <string>
+#include <string_view>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+// The sorted keys of one B-Tree node. The tree only reaches them through
+// positions and comparisons, so key types can choose their own layout;
+// the general case is a plain vector.
+template<typename Key>
+class NodeKeys {
+public:
+    size_t size() const { return keys_.size(); }
+    bool empty() const { return keys_.empty(); }
+    void reserve(size_t count) { keys_.reserve(count); }
+
+    const Key& get(size_t i) const { return keys_[i]; }
+    std::vector<Key> toVector() const { return keys_; }
+
+    // Index of the first key not less than key
+    size_t lowerBound(const Key& key) const {
+        return std::lower_bound(keys_.begin(), keys_.end(), key) - keys_.begin();
+    }
+    bool equals(size_t i, const Key& key) const { return keys_[i] == key; }
+    bool less(size_t i, const Key& key) const { return keys_[i] < key; }
+
+    // Callers keep the keys sorted
+    void insert(size_t i, const Key& key) { keys_.insert(keys_.begin() + i, key); }
+    void set(size_t i, const Key& key) { keys_[i] = key; }
+    void erase(size_t i) { keys_.erase(keys_.begin() + i); }
+    void truncate(size_t count) { keys_.erase(keys_.begin() + count, keys_.end()); }
+
+    // Appends other's keys [from, to)
+    void append(const NodeKeys& other, size_t from, size_t to) {
+        keys_.insert(keys_.end(), other.keys_.begin() + from, other.keys_.begin() + to);
+    }
+
+private:
+    std::vector<Key> keys_;
+};
+
+// String keys: the prefix every key in the node shares is stored once,
+// the remaining suffixes are packed back to back in one byte arena, and
+// the first 8 bytes of each suffix are kept as a big-endian integer
+// ("head"). A lookup strips the prefix once, then binary-searches the
+// heads array and only touches the arena when two heads are equal. Keys
+// are compared bytewise, as std::string does.
+template<>
+class NodeKeys<std::string> {
+public:
+    size_t size() const { return heads_.size(); }
+    bool empty() const { return heads_.empty(); }
+    void reserve(size_t count) {
+        heads_.reserve(count);
+        offsets_.reserve(count + 1);
+    }
+
+    std::string get(size_t i) const {
+        std::string key;
+        key.reserve(prefix_.size() + suffix(i).size());
+        key.append(prefix_).append(suffix(i));
+        return key;
+    }
+    std::vector<std::string> toVector() const {
+        std::vector<std::string> keys;
+        keys.reserve(size());
+        for (size_t i = 0; i < size(); i++) {
+            keys.push_back(get(i));
+        }
+        return keys;
+    }
+
+    size_t lowerBound(const std::string& key) const {
+        int outside = compareToPrefix(key);
+        if (outside != 0) {
+            return outside < 0 ? 0 : size();
+        }
+        std::string_view rest = std::string_view(key).substr(prefix_.size());
+        uint64_t head = headOf(rest);
+        size_t lo = 0, hi = size();
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            if (compareAt(mid, rest, head) < 0) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        return lo;
+    }
+    bool equals(size_t i, const std::string& key) const { return compare(i, key) == 0; }
+    bool less(size_t i, const std::string& key) const { return compare(i, key) < 0; }
+
+    void insert(size_t i, const std::string& key) {
+        if (empty()) {
+            prefix_ = key;
+        } else if (compareToPrefix(key) != 0) {
+            shrinkPrefix(commonLength(prefix_, key));
+        }
+        insertSuffix(i, std::string_view(key).substr(prefix_.size()));
+    }
+    void set(size_t i, const std::string& key) {
+        eraseSuffix(i);
+        insert(i, key);
+    }
+    void erase(size_t i) {
+        eraseSuffix(i);
+        if (i == 0 || i == size()) {
+            growPrefix();
+        }
+    }
+    void truncate(size_t count) {
+        if (count >= size()) return;
+        arena_.resize(offsets_[count]);
+        offsets_.resize(count + 1);
+        heads_.resize(count);
+        growPrefix();
+    }
+
+    // Splits and merges only; rebuilding each key keeps this simple
+    void append(const NodeKeys& other, size_t from, size_t to) {
+        std::string key;
+        for (size_t i = from; i < to; i++) {
+            key.assign(other.prefix_).append(other.suffix(i));
+            insert(size(), key);
+        }
+        growPrefix();
+    }
+
+private:
+    std::string prefix_;             // Shared by every key in the node
+    std::string arena_;              // Suffixes in key order
+    std::vector<uint32_t> offsets_{0};  // Suffix i is arena_[offsets_[i], offsets_[i + 1])
+    std::vector<uint64_t> heads_;    // First 8 suffix bytes, zero padded
+
+    std::string_view suffix(size_t i) const {
+        return std::string_view(arena_).substr(offsets_[i], offsets_[i + 1] - offsets_[i]);
+    }
+
+    // Zero padding can make a short suffix's head equal a longer one's,
+    // but never reverses their order, so equal heads just mean "look closer"
+    static uint64_t headOf(std::string_view bytes) {
+        uint64_t head = 0;
+        for (size_t i = 0; i < 8; i++) {
+            head = (head << 8) | (i < bytes.size() ? static_cast<unsigned char>(bytes[i]) : 0);
+        }
+        return head;
+    }
+
+    static size_t commonLength(std::string_view a, std::string_view b) {
+        size_t length = std::min(a.size(), b.size());
+        return std::mismatch(a.begin(), a.begin() + length, b.begin()).first - a.begin();
+    }
+
+    // < 0 / > 0 if key sorts before / after every key that starts with
+    // prefix_, 0 if key starts with prefix_ itself
+    int compareToPrefix(std::string_view key) const {
+        size_t common = commonLength(prefix_, key);
+        if (common == prefix_.size()) return 0;
+        if (common == key.size()) return -1;
+        return static_cast<unsigned char>(key[common]) <
+               static_cast<unsigned char>(prefix_[common]) ? -1 : 1;
+    }
+
+    // Key i against a key whose suffix (past prefix_) is rest
+    int compareAt(size_t i, std::string_view rest, uint64_t head) const {
+        if (heads_[i] != head) {
+            return heads_[i] < head ? -1 : 1;
+        }
+        return suffix(i).compare(rest);
+    }
+
+    int compare(size_t i, const std::string& key) const {
+        int outside = compareToPrefix(key);
+        if (outside != 0) {
+            return -outside;
+        }
+        std::string_view rest = std::string_view(key).substr(prefix_.size());
+        return compareAt(i, rest, headOf(rest));
+    }
+
+    void insertSuffix(size_t i, std::string_view rest) {
+        uint32_t length = static_cast<uint32_t>(rest.size());
+        arena_.insert(offsets_[i], rest.data(), rest.size());
+        offsets_.insert(offsets_.begin() + i + 1, offsets_[i] + length);
+        for (size_t j = i + 2; j < offsets_.size(); j++) {
+            offsets_[j] += length;
+        }
+        heads_.insert(heads_.begin() + i, headOf(rest));
+    }
+
+    void eraseSuffix(size_t i) {
+        uint32_t length = offsets_[i + 1] - offsets_[i];
+        arena_.erase(offsets_[i], length);
+        offsets_.erase(offsets_.begin() + i + 1);
+        for (size_t j = i + 1; j < offsets_.size(); j++) {
+            offsets_[j] -= length;
+        }
+        heads_.erase(heads_.begin() + i);
+    }
+
+    // Keep only prefix_[0, length), moving the rest into every suffix
+    void shrinkPrefix(size_t length) {
+        std::string_view moved = std::string_view(prefix_).substr(length);
+        rebuild(moved, 0);
+        prefix_.resize(length);
+    }
+
+    // Keys are sorted, so the first and last share what all of them share
+    void growPrefix() {
+        if (empty()) return;
+        size_t length = size() == 1 ? suffix(0).size()
+                                    : commonLength(suffix(0), suffix(size() - 1));
+        if (length == 0) return;
+        std::string grown = prefix_;
+        grown.append(suffix(0).substr(0, length));
+        rebuild(std::string_view(), length);
+        prefix_ = std::move(grown);
+    }
+
+    // Every suffix becomes lead + suffix.substr(drop)
+    void rebuild(std::string_view lead, size_t drop) {
+        std::string arena;
+        arena.reserve(arena_.size() + size() * lead.size());
+        for (size_t i = 0; i < size(); i++) {
+            arena.append(lead).append(suffix(i).substr(drop));
+            offsets_[i] = static_cast<uint32_t>(arena.size());
+        }
+        // offsets_[i] held the end of suffix i; shift into place
+        offsets_.insert(offsets_.begin(), 0);
+        offsets_.pop_back();
+        arena_ = std::move(arena);
+        for (size_t i = 0; i < size(); i++) {
+            heads_[i] = headOf(suffix(i));
+        }
+    }
+};
+
+#endif // NODE_KEYS_H
@@ -0,0 +1,157 @@
+/*
+ * Node Pool
+ * Copyright (C) 2025, Shyamal Suhana Chandra
+ * All rights reserved.
+ */
+
+#ifndef NODE_POOL_H
+#define NODE_POOL_H
+
+#include <vector>
+#include <memory>
+#include <utility>
+#include <algorithm>
+#include <cstring>
+#include <cstddef>
+#include <cstdint>
+
+// Storage for pointer-linked tree nodes: NodePool hands out fixed-size
+// slots carved from chunks, and ChildArray keeps a node's child pointers
+// inline until they outgrow it. Neither is thread-safe; the owning tree
+// calls them under its lock.
+
+// Slots are reused through a free list and the chunks are only returned
+// when the pool is destroyed, so create/destroy cost no malloc once the
+// pool has grown to the tree's size. Destroying the pool does not run
+// the destructors of objects still in it; the owner destroys those first.
+template<typename T>
+class NodePool {
+public:
+    NodePool() = default;
+    NodePool(const NodePool&) = delete;
+    NodePool& operator=(const NodePool&) = delete;
+
+    template<typename... Args>
+    T* create(Args&&... args) {
+        if (!free_) grow();
+        Slot* slot = free_;
+        free_ = slot->next;
+        live_++;
+        return new (slot->storage) T(std::forward<Args>(args)...);
+    }
+
+    void destroy(T* object) {
+        object->~T();
+        Slot* slot = reinterpret_cast<Slot*>(object);
+        slot->next = free_;
+        free_ = slot;
+        live_--;
+    }
+
+    size_t live() const { return live_; }
+    size_t capacity() const { return capacity_; }
+
+private:
+    union Slot {
+        Slot* next;
+        alignas(T) unsigned char storage[sizeof(T)];
+    };
+
+    // Chunks double from 64 slots up to 4096, so small trees stay small
+    static constexpr size_t kFirstChunk = 64;
+    static constexpr size_t kMaxChunk = 4096;
+
+    std::vector<std::unique_ptr<Slot[]>> chunks_;
+    Slot* free_ = nullptr;
+    size_t live_ = 0;
+    size_t capacity_ = 0;
+
+    void grow() {
+        size_t count = std::min(std::max(capacity_, kFirstChunk), kMaxChunk);
+        chunks_.emplace_back(new Slot[count]);
+        Slot* chunk = chunks_.back().get();
+        for (size_t i = count; i-- > 0;) {
+            chunk[i].next = free_;
+            free_ = &chunk[i];
+        }
+        capacity_ += count;
+    }
+};
+
+// A node's child pointers: up to Inline of them are stored in the node
+// itself, more move to a heap array that doubles as needed. Indexes and
+// raw pointers keep the interface to what the trees use.
+template<typename T, size_t Inline>
+class ChildArray {
+public:
+    ChildArray() = default;
+    ~ChildArray() {
+        if (spilled()) delete[] heap_;
+    }
+    ChildArray(const ChildArray&) = delete;
+    ChildArray& operator=(const ChildArray&) = delete;
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+    T* const* begin() const { return data(); }
+    T* const* end() const { return data() + size_; }
+    T** begin() { return data(); }
+    T** end() { return data() + size_; }
+
+    T*& operator[](size_t i) { return data()[i]; }
+    T* operator[](size_t i) const { return data()[i]; }
+    T* back() const { return data()[size_ - 1]; }
+
+    void insert(size_t index, T* child) {
+        reserve(size_ + 1);
+        T** items = data();
+        std::memmove(items + index + 1, items + index, (size_ - index) * sizeof(T*));
+        items[index] = child;
+        size_++;
+    }
+
+    void push_back(T* child) { insert(size_, child); }
+
+    // Removes [first, last)
+    void erase(size_t first, size_t last) {
+        T** items = data();
+        std::memmove(items + first, items + last, (size_ - last) * sizeof(T*));
+        size_ -= static_cast<uint32_t>(last - first);
+    }
+
+    void assign(T* const* first, T* const* last) {
+        size_t count = static_cast<size_t>(last - first);
+        size_ = 0;
+        reserve(count);
+        std::memmove(data(), first, count * sizeof(T*));
+        size_ = static_cast<uint32_t>(count);
+    }
+
+    void clear() { size_ = 0; }
+
+private:
+    uint32_t size_ = 0;
+    uint32_t capacity_ = Inline;
+    union {
+        T* inline_[Inline];
+        T** heap_;
+    };
+
+    bool spilled() const { return capacity_ > Inline; }
+    T** data() { return spilled() ? heap_ : inline_; }
+    T* const* data() const { return spilled() ? heap_ : inline_; }
+
+    void reserve(size_t count) {
+        if (count <= capacity_) return;
+        size_t capacity = capacity_;
+        while (capacity < count) capacity *= 2;
+        T** grown = new T*[capacity];
+        std::memcpy(grown, data(), size_ * sizeof(T*));
+        if (spilled()) delete[] heap_;
+        heap_ = grown;
+        capacity_ = static_cast<uint32_t>(capacity);
+    }
+};
+
+#endif // NODE_POOL_H
@@ -0,0 +1,69 @@
+/*
+ * Parallel Export
+ * Copyright (C) 2025, Shyamal Suhana Chandra
+ * All rights reserved.
+ */
+
+#ifndef PARALLEL_EXPORT_H
+#define PARALLEL_EXPORT_H
+
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+#include "TreeExecutor.h"
+
+// Shared part of the trees' parallel in-order exports (sortParallel,
+// inOrderTraversalParallel). The tree sizes the output up front and walks
+// only its upper levels serially, writing the entries found there in
+// place and cutting off each subtree of at most exportGrain() entries as
+// an ExportPiece; the subtree's size is where the next entry goes. The
+// pieces are then written concurrently by exportPieces, each into its own
+// slice of the output, so nothing is reallocated or moved twice.
+
+template<typename Handle>
+struct ExportPiece {
+    Handle subtree;
+    size_t offset;       // First output slot
+    size_t size;         // Slots reserved: the subtree's entry count
+    size_t written = 0;  // Entries the fill produced; fewer if it skipped some
+};
+
+// Small subtrees are not worth a task; larger trees are cut into about
+// eight pieces per thread so that uneven subtrees still balance out
+inline size_t exportGrain(size_t total, const TreeExecutor& executor) {
+    constexpr size_t kMinPiece = 8192;
+    return std::max(kMinPiece, total / ((executor.workerCount() + 1) * 8));
+}
+
+// Calls fill(piece.subtree, output) for every piece on the executor (and
+// the calling thread); fill writes the subtree's entries from output on
+// and returns how many it wrote. used is the number of slots the tree
+// handed out. Slots left empty by a short fill are closed up afterwards
+// and the result trimmed, so the output ends up dense either way.
+template<typename Entry, typename Handle, typename Fill>
+void exportPieces(TreeExecutor& executor, std::vector<Entry>& result, size_t used,
+                  std::vector<ExportPiece<Handle>>& pieces, Fill fill) {
+    executor.parallelFor(pieces.size(), [&](size_t i) {
+        ExportPiece<Handle>& piece = pieces[i];
+        piece.written = fill(piece.subtree, result.data() + piece.offset);
+    });
+
+    // Pieces are in output order; entries between them came from the walk
+    auto moveDown = [&result](size_t first, size_t last, size_t to) {
+        if (to != first) {
+            std::move(result.begin() + first, result.begin() + last, result.begin() + to);
+        }
+        return to + (last - first);
+    };
+    size_t out = 0;
+    size_t next = 0;
+    for (const ExportPiece<Handle>& piece : pieces) {
+        out = moveDown(next, piece.offset, out);
+        out = moveDown(piece.offset, piece.offset + piece.written, out);
+        next = piece.offset + piece.size;
+    }
+    out = moveDown(next, used, out);
+    result.resize(out);
+}
+
+#endif // PARALLEL_EXPORT_H
@@ -0,0 +1,133 @@
+/*
+ * Snapshot Journal
+ * Copyright (C) 2025, Shyamal Suhana Chandra
+ * All rights reserved.
+ */
+
+#ifndef SNAPSHOT_JOURNAL_H
+#define SNAPSHOT_JOURNAL_H
+
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+// Change log behind the trees' getSnapshotSince(). Every node carries a
+// stable id and the version of its last visible change; the tree's
+// version advances with each change. Once a snapshot has been taken the
+// journal also records (version, id) per change and keeps an id -> node
+// map, so the nodes changed since any recent version can be listed
+// without walking the tree. Before that, trees pay only for the stamps.
+//
+// Node must have `uint64_t id` and `uint64_t version` members. All calls
+// happen under the owning tree's lock.
+template<typename Node>
+class SnapshotJournal {
+public:
+    uint64_t version() const { return version_; }
+    bool tracking() const { return tracking_; }
+
+    // A node entered the tree
+    void added(Node& node) {
+        node.id = ++lastId_;
+        if (tracking_) {
+            nodes_[node.id] = &node;
+        }
+        changed(node);
+    }
+
+    // Something a snapshot shows about node changed: its keys, values,
+    // access count or child list
+    void changed(Node& node) {
+        node.version = ++version_;
+        if (tracking_) {
+            record(node.version, node.id, false);
+        }
+    }
+
+    // copy took old's place in the tree (copy-on-write) and stands for the
+    // same node, so it keeps old's id and stamp
+    void replaced(const Node& old, Node& copy) {
+        copy.id = old.id;
+        copy.version = old.version;
+        if (tracking_) {
+            nodes_[copy.id] = &copy;
+        }
+    }
+
+    // node left the tree (it may still be referenced, but not reachable)
+    void removed(Node& node) {
+        ++version_;
+        if (tracking_) {
+            nodes_.erase(node.id);
+            record(version_, node.id, true);
+        }
+    }
+
+    // Start journaling from the current version. nodes must be every node
+    // currently in the tree; called while building a full snapshot.
+    void startTracking(const std::vector<Node*>& nodes) {
+        if (tracking_) return;
+        tracking_ = true;
+        floor_ = version_;
+        nodes_.reserve(nodes.size());
+        for (Node* node : nodes) {
+            nodes_[node->id] = node;
+        }
+    }
+
+    // Nodes changed and ids removed after version `since`, each listed
+    // once. False if the journal no longer reaches back that far (or never
+    // did); the caller then falls back to a full snapshot. An id in
+    // removed may belong to a node added after `since`; consumers simply
+    // ignore ids they do not know.
+    bool changesSince(uint64_t since, std::vector<Node*>& changed,
+                      std::vector<uint64_t>& removed) const {
+        if (!tracking_ || since < floor_ || since > version_) {
+            return false;
+        }
+        auto it = std::upper_bound(entries_.begin(), entries_.end(), since,
+            [](uint64_t v, const Entry& e) { return v < e.version; });
+        for (; it != entries_.end(); ++it) {
+            if (it->removed) {
+                removed.push_back(it->id);
+                continue;
+            }
+            // Only a node's latest change matches its stamp
+            auto found = nodes_.find(it->id);
+            if (found != nodes_.end() && found->second->version == it->version) {
+                changed.push_back(found->second);
+            }
+        }
+        return true;
+    }
+
+private:
+    struct Entry {
+        uint64_t version;
+        uint64_t id;
+        bool removed;
+    };
+
+    uint64_t version_ = 0;
+    uint64_t lastId_ = 0;
+    uint64_t floor_ = 0;  // Oldest version changesSince can answer for
+    bool tracking_ = false;
+    std::vector<Entry> entries_;
+    std::unordered_map<uint64_t, Node*> nodes_;
+
+    void record(uint64_t version, uint64_t id, bool removed) {
+        // Bounded at a few entries per node: past that, the oldest half is
+        // dropped and deltas from before it fall back to full snapshots
+        size_t limit = std::max<size_t>(4096, nodes_.size() * 4);
+        if (entries_.size() >= limit) {
+            size_t drop = entries_.size() / 2;
+            floor_ = entries_[drop - 1].version;
+            entries_.erase(entries_.begin(), entries_.begin() + drop);
+        }
+        entries_.push_back({version, id, removed});
+    }
+};
+
+#endif // SNAPSHOT_JOURNAL_H
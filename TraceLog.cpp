@@ -0,0 +1,146 @@
+/*
+ * Trace Log
+ * Copyright (C) 2025, Shyamal Suhana Chandra
+ * All rights reserved.
+ */
+
+#include "TraceLog.h"
+#include "BinaryIO.h"
+#include <cstring>
+
+namespace {
+
+constexpr char kMagic[4] = {'M', 'G', 'R', 'T'};
+constexpr size_t kHeaderSize = 16;
+constexpr size_t kFlushSize = 64 * 1024;
+
+uint64_t zigzag(int64_t value) {
+    return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+int64_t unzigzag(uint64_t value) {
+    return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+} // namespace
+
+using binary_io::getVarint;
+using binary_io::putVarint;
+
+bool TraceRecorder::start(const std::string& path, TraceSource source) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    close();
+
+    file_ = std::fopen(path.c_str(), "wb");
+    if (!file_) return false;
+    failed_ = false;
+    threads_.clear();
+    lastNs_ = 0;
+    start_ = Clock::now();
+
+    uint64_t startUnixNs = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
+    buffer_.assign(kMagic, kMagic + 4);
+    buffer_.push_back(TraceLog::kVersion);
+    buffer_.push_back(static_cast<unsigned char>(source));
+    buffer_.push_back(0);
+    buffer_.push_back(0);
+    for (int i = 0; i < 8; i++) {
+        buffer_.push_back(static_cast<unsigned char>(startUnixNs >> (8 * i)));
+    }
+    active_.store(true, std::memory_order_relaxed);
+    return true;
+}
+
+bool TraceRecorder::stop() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return close();
+}
+
+bool TraceRecorder::close() {
+    if (!file_) return true;
+    active_.store(false, std::memory_order_relaxed);
+    flush();
+    if (std::fclose(file_) != 0) failed_ = true;
+    file_ = nullptr;
+    buffer_.clear();
+    buffer_.shrink_to_fit();
+    return !failed_;
+}
+
+void TraceRecorder::append(TraceOp op, int64_t key, uint32_t valueLength, uint64_t nowNs) {
+    if (!file_) return;
+
+    auto inserted = threads_.emplace(std::this_thread::get_id(), static_cast<uint32_t>(threads_.size()));
+    uint32_t thread = inserted.first->second;
+
+    putVarint(buffer_, static_cast<uint64_t>(thread) << 2 | static_cast<uint64_t>(op));
+    putVarint(buffer_, zigzag(key));
+    // Timestamps are taken under mutex_, so they never go backwards
+    putVarint(buffer_, nowNs - lastNs_);
+    lastNs_ = nowNs;
+    if (op == TraceOp::INSERT) putVarint(buffer_, valueLength);
+
+    if (buffer_.size() >= kFlushSize) flush();
+}
+
+void TraceRecorder::flush() {
+    if (buffer_.empty() || !file_) return;
+    if (std::fwrite(buffer_.data(), 1, buffer_.size(), file_) != buffer_.size()) {
+        failed_ = true;
+    }
+    buffer_.clear();
+}
+
+bool TraceLog::load(const std::string& path, TraceLog& log, std::string& error) {
+    log = TraceLog();
+    std::vector<unsigned char> data;
+    if (!binary_io::readFile(path, data)) {
+        error = "cannot read " + path;
+        return false;
+    }
+
+    if (data.size() < kHeaderSize || std::memcmp(data.data(), kMagic, 4) != 0) {
+        error = path + " is not a trace";
+        return false;
+    }
+    log.version = data[4];
+    if (log.version != kVersion) {
+        error = path + " has unsupported trace version " + std::to_string(log.version);
+        return false;
+    }
+    log.source = static_cast<TraceSource>(data[5]);
+    for (int i = 0; i < 8; i++) {
+        log.startUnixNs |= static_cast<uint64_t>(data[8 + i]) << (8 * i);
+    }
+
+    size_t offset = kHeaderSize;
+    uint64_t timestamp = 0;
+    while (offset < data.size()) {
+        uint64_t head, key, delta, length = 0;
+        if (!getVarint(data, offset, head) || !getVarint(data, offset, key) ||
+            !getVarint(data, offset, delta)) {
+            log.truncated = true;
+            break;
+        }
+        TraceOp op = static_cast<TraceOp>(head & 3);
+        if (op != TraceOp::SEARCH && op != TraceOp::INSERT && op != TraceOp::REMOVE) {
+            error = path + " holds an unknown operation";
+            return false;
+        }
+        if (op == TraceOp::INSERT && !getVarint(data, offset, length)) {
+            log.truncated = true;
+            break;
+        }
+        timestamp += delta;
+        TraceRecord record;
+        record.op = op;
+        record.thread = static_cast<uint32_t>(head >> 2);
+        record.key = unzigzag(key);
+        record.timestampNs = timestamp;
+        record.valueLength = static_cast<uint32_t>(length);
+        log.records.push_back(record);
+        if (record.thread >= log.threads) log.threads = record.thread + 1;
+    }
+    return true;
+}
@@ -0,0 +1,126 @@
+/*
+ * Trace Log
+ * Copyright (C) 2025, Shyamal Suhana Chandra
+ * All rights reserved.
+ */
+
+#ifndef TRACE_LOG_H
+#define TRACE_LOG_H
+
+#include <vector>
+#include <string>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <unordered_map>
+#include <cstdio>
+#include <cstddef>
+#include <cstdint>
+
+// Operation traces captured at the C bridges and replayed by tree_replay.
+//
+// File layout: a 16-byte header ("MGRT", format version, source tree,
+// two reserved bytes, wall-clock start in ns since the epoch as a
+// little-endian uint64), then one record per operation, each a run of
+// LEB128 varints:
+//
+//   thread << 2 | op   thread ids are dense, in order of first appearance
+//   key                zigzag encoded
+//   delta ns           since the previous record (steady clock)
+//   value length       INSERT only
+//
+// Records are in the order calls entered the bridge, which is also the
+// order they were timestamped; two calls racing for the tree lock may
+// have been applied the other way round.
+
+enum class TraceOp : uint8_t { SEARCH = 0, INSERT = 1, REMOVE = 2 };
+
+enum class TraceSource : uint8_t { UNKNOWN = 0, BTREE = 1, NSPLAYTREE = 2 };
+
+struct TraceRecord {
+    TraceOp op;
+    uint32_t thread;
+    int64_t key;
+    uint64_t timestampNs;   // Since recording started
+    uint32_t valueLength;   // INSERT only
+};
+
+struct TraceLog {
+    static constexpr uint8_t kVersion = 1;
+
+    uint8_t version = kVersion;
+    TraceSource source = TraceSource::UNKNOWN;
+    uint64_t startUnixNs = 0;
+    uint32_t threads = 0;        // Highest thread id + 1
+    bool truncated = false;      // The file ended inside a record
+    std::vector<TraceRecord> records;
+
+    // Reads a whole trace; on failure returns false and sets error. A
+    // truncated final record (the recorder was killed mid-write) is
+    // dropped and reported through truncated rather than as an error.
+    static bool load(const std::string& path, TraceLog& log, std::string& error);
+};
+
+// Appends records to a trace file. Recording is off until start(), and
+// costs one relaxed load per operation while off. Safe to call from any
+// thread; records are buffered and written in 64 KB blocks.
+class TraceRecorder {
+public:
+    TraceRecorder() = default;
+    ~TraceRecorder() { stop(); }
+
+    TraceRecorder(const TraceRecorder&) = delete;
+    TraceRecorder& operator=(const TraceRecorder&) = delete;
+
+    // Starts a new trace at path, ending any current one. False if the
+    // file could not be created.
+    bool start(const std::string& path, TraceSource source);
+
+    // Ends the trace; false if any part of it failed to write
+    bool stop();
+
+    bool active() const { return active_.load(std::memory_order_relaxed); }
+
+    void record(TraceOp op, int64_t key, uint32_t valueLength = 0) {
+        if (!active()) return;
+        std::lock_guard<std::mutex> lock(mutex_);
+        append(op, key, valueLength, elapsedNs());
+    }
+
+    // A batch call: one record per key, all under one timestamp.
+    // lengthAt(i) gives the i-th value length for INSERT.
+    template<typename Key, typename LengthAt>
+    void recordBatch(TraceOp op, const Key* keys, size_t count, LengthAt lengthAt) {
+        if (!active()) return;
+        std::lock_guard<std::mutex> lock(mutex_);
+        uint64_t now = elapsedNs();
+        for (size_t i = 0; i < count; i++) {
+            append(op, static_cast<int64_t>(keys[i]), op == TraceOp::INSERT ? lengthAt(i) : 0, now);
+        }
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    std::mutex mutex_;
+    std::atomic<bool> active_{false};
+    std::FILE* file_ = nullptr;              // Guarded by mutex_, as is the rest
+    bool failed_ = false;
+    std::vector<unsigned char> buffer_;
+    Clock::time_point start_;
+    uint64_t lastNs_ = 0;
+    std::unordered_map<std::thread::id, uint32_t> threads_;
+
+    // Called with mutex_ held. append drops the record if the trace was
+    // stopped between the active() check and taking the lock.
+    uint64_t elapsedNs() const {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            Clock::now() - start_).count());
+    }
+    void append(TraceOp op, int64_t key, uint32_t valueLength, uint64_t nowNs);
+    void flush();
+    bool close();
+};
+
+#endif // TRACE_LOG_H
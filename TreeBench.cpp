@@ -0,0 +1,366 @@
+/*
+ * Tree Benchmark
+ * Copyright (C) 2025, Shyamal Suhana Chandra
+ * All rights reserved.
+ */
+
+// Throughput, latency and memory of BTree, NSplayTree and
+// CircularBufferSplayTree under a set of common workloads. Each run
+// preloads `size` keys, then `threads` threads issue `ops` operations in
+// total; one JSON object per run is written to stdout (JSON Lines).
+//
+//   uniform     searches, keys uniform over the loaded range
+//   zipf        searches, Zipf(0.99) popularity, hot keys scattered
+//   sequential  searches, ascending keys (each thread its own stretch)
+//   mixed       50% search, 25% insert, 25% remove over twice the range
+//
+// Every run happens in a forked child, so peakRssKb is that run's own
+// peak. Latencies go into log-linear histograms (within ~6%), which keeps
+// the recording itself out of the memory figures.
+
+#include "BTree.h"
+#include "NSplayTree.h"
+#include "CircularBufferSplayTree.h"
+#include <vector>
+#include <string>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <functional>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    std::vector<std::string> trees{"btree", "nsplay", "circular"};
+    std::vector<std::string> workloads{"uniform", "zipf", "sequential", "mixed"};
+    std::vector<size_t> sizes{10000, 100000};
+    std::vector<size_t> threads{1, 2, 4};
+    size_t ops = 100000;
+    uint64_t seed = 1;
+};
+
+// Latency histogram: values below 16 ns exact, above that 16 buckets per
+// power of two
+class Histogram {
+public:
+    void record(uint64_t ns) { counts_[bucket(ns)]++; }
+
+    void merge(const Histogram& other) {
+        for (size_t i = 0; i < kBuckets; i++) counts_[i] += other.counts_[i];
+    }
+
+    // Midpoint of the bucket holding the q-th quantile
+    uint64_t quantile(double q) const {
+        uint64_t total = 0;
+        for (uint64_t count : counts_) total += count;
+        if (total == 0) return 0;
+        uint64_t rank = static_cast<uint64_t>(std::ceil(q * total));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < kBuckets; i++) {
+            seen += counts_[i];
+            if (seen >= std::max<uint64_t>(rank, 1)) {
+                return (lowerBound(i) + lowerBound(i + 1)) / 2;
+            }
+        }
+        return lowerBound(kBuckets - 1);
+    }
+
+    uint64_t max() const {
+        for (size_t i = kBuckets; i-- > 0;) {
+            if (counts_[i]) return lowerBound(i + 1) - 1;
+        }
+        return 0;
+    }
+
+private:
+    static constexpr size_t kBuckets = 61 * 16;
+    uint64_t counts_[kBuckets] = {};
+
+    static size_t bucket(uint64_t ns) {
+        if (ns < 16) return static_cast<size_t>(ns);
+        int msb = 63 - __builtin_clzll(ns);
+        return static_cast<size_t>((msb - 3) * 16 + ((ns >> (msb - 4)) & 15));
+    }
+    static uint64_t lowerBound(size_t index) {
+        if (index < 16) return index;
+        int msb = static_cast<int>(index / 16) + 3;
+        return (uint64_t(16 + index % 16)) << (msb - 4);
+    }
+};
+
+// Ranks drawn by inverting a precomputed CDF; shared read-only by threads
+class ZipfTable {
+public:
+    ZipfTable(size_t n, double s) : cdf_(n) {
+        double sum = 0;
+        for (size_t i = 0; i < n; i++) {
+            sum += 1.0 / std::pow(static_cast<double>(i + 1), s);
+            cdf_[i] = sum;
+        }
+        for (double& c : cdf_) c /= sum;
+    }
+
+    size_t sample(std::mt19937_64& rng) const {
+        double u = std::uniform_real_distribution<double>(0.0, 1.0)(rng);
+        size_t rank = std::lower_bound(cdf_.begin(), cdf_.end(), u) - cdf_.begin();
+        return std::min(rank, cdf_.size() - 1);
+    }
+
+private:
+    std::vector<double> cdf_;
+};
+
+enum class OpKind { SEARCH, INSERT, REMOVE };
+
+struct Op {
+    OpKind kind;
+    int key;
+};
+
+// One thread's operation stream for a workload
+class OpStream {
+public:
+    OpStream(const std::string& workload, size_t size, const ZipfTable* zipf,
+             size_t thread, size_t threads, uint64_t seed)
+        : workload_(workload), size_(size), zipf_(zipf),
+          next_(size * thread / threads), rng_(seed * 1000003 + thread) {}
+
+    Op next() {
+        if (workload_ == "zipf") {
+            // Multiplying by a prime coprime to size spreads the hot ranks
+            // over the key range instead of clustering them at the start
+            uint64_t rank = zipf_->sample(rng_);
+            return {OpKind::SEARCH, static_cast<int>((rank * 2654435761ull) % size_)};
+        }
+        if (workload_ == "sequential") {
+            int key = static_cast<int>(next_);
+            next_ = (next_ + 1) % size_;
+            return {OpKind::SEARCH, key};
+        }
+        if (workload_ == "mixed") {
+            uint64_t r = rng_();
+            int key = static_cast<int>((r >> 2) % (2 * size_));
+            OpKind kind = (r & 3) < 2 ? OpKind::SEARCH : (r & 3) == 2 ? OpKind::INSERT : OpKind::REMOVE;
+            return {kind, key};
+        }
+        return {OpKind::SEARCH, static_cast<int>(rng_() % size_)};
+    }
+
+private:
+    const std::string& workload_;
+    size_t size_;
+    const ZipfTable* zipf_;
+    size_t next_;
+    std::mt19937_64 rng_;
+};
+
+long currentRssKb() {
+#ifdef __linux__
+    long pages = 0, resident = 0;
+    if (FILE* f = std::fopen("/proc/self/statm", "r")) {
+        if (std::fscanf(f, "%ld %ld", &pages, &resident) != 2) resident = 0;
+        std::fclose(f);
+    }
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+#else
+    return 0;  // Not available without platform APIs; peakRssKb still is
+#endif
+}
+
+long peakRssKb() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024;  // Bytes on macOS
+#else
+    return usage.ru_maxrss;
+#endif
+}
+
+// The three trees share insert/search/remove(int); only construction
+// differs. rssBefore is taken before the tree was constructed.
+template<typename Tree>
+void runWorkload(Tree& tree, long rssBefore, const std::string& name, const std::string& workload,
+                 size_t size, size_t threads, const Options& options) {
+    std::vector<int> keys(size);
+    for (size_t i = 0; i < size; i++) keys[i] = static_cast<int>(i);
+    std::mt19937_64 rng(options.seed);
+    std::shuffle(keys.begin(), keys.end(), rng);
+    for (int key : keys) tree.insert(key, key);
+    std::vector<int>().swap(keys);
+    long treeRss = currentRssKb() - rssBefore;
+
+    std::unique_ptr<ZipfTable> zipf;
+    if (workload == "zipf") zipf = std::make_unique<ZipfTable>(size, 0.99);
+
+    std::vector<Histogram> histograms(threads);
+    std::atomic<size_t> ready{0};
+    std::atomic<bool> go{false};
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < threads; t++) {
+        workers.emplace_back([&, t]() {
+            OpStream stream(workload, size, zipf.get(), t, threads, options.seed);
+            size_t count = options.ops / threads + (t < options.ops % threads ? 1 : 0);
+            Histogram& histogram = histograms[t];
+            ready++;
+            while (!go.load(std::memory_order_acquire)) std::this_thread::yield();
+
+            for (size_t i = 0; i < count; i++) {
+                Op op = stream.next();
+                auto start = Clock::now();
+                switch (op.kind) {
+                    case OpKind::SEARCH: tree.search(op.key); break;
+                    case OpKind::INSERT: tree.insert(op.key, op.key); break;
+                    case OpKind::REMOVE: tree.remove(op.key); break;
+                }
+                histogram.record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    Clock::now() - start).count());
+            }
+        });
+    }
+    while (ready.load() < threads) std::this_thread::yield();
+    auto start = Clock::now();
+    go.store(true, std::memory_order_release);
+    for (auto& worker : workers) worker.join();
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    Histogram all;
+    for (auto& histogram : histograms) all.merge(histogram);
+    std::printf("{\"tree\":\"%s\",\"workload\":\"%s\",\"size\":%zu,\"threads\":%zu,"
+                "\"ops\":%zu,\"seconds\":%.6f,\"opsPerSec\":%.0f,"
+                "\"p50Ns\":%llu,\"p99Ns\":%llu,\"maxNs\":%llu,"
+                "\"treeRssKb\":%ld,\"peakRssKb\":%ld}\n",
+                name.c_str(), workload.c_str(), size, threads, options.ops, seconds,
+                seconds > 0 ? options.ops / seconds : 0.0,
+                static_cast<unsigned long long>(all.quantile(0.50)),
+                static_cast<unsigned long long>(all.quantile(0.99)),
+                static_cast<unsigned long long>(all.max()),
+                treeRss, peakRssKb());
+}
+
+void runOne(const std::string& tree, const std::string& workload, size_t size,
+            size_t threads, const Options& options) {
+    long rssBefore = currentRssKb();
+    if (tree == "btree") {
+        BTree<int, int> instance(32);
+        runWorkload(instance, rssBefore, tree, workload, size, threads, options);
+    } else if (tree == "nsplay") {
+        NSplayTree<int, int> instance;
+        runWorkload(instance, rssBefore, tree, workload, size, threads, options);
+    } else {
+        // Sized to hold the loaded keys; mixed-workload inserts evict the oldest
+        CircularBufferSplayTree<int, int> instance(size);
+        runWorkload(instance, rssBefore, tree, workload, size, threads, options);
+    }
+}
+
+std::vector<std::string> splitList(const std::string& text) {
+    std::vector<std::string> items;
+    size_t start = 0;
+    while (start <= text.size()) {
+        size_t comma = text.find(',', start);
+        if (comma == std::string::npos) comma = text.size();
+        if (comma > start) items.push_back(text.substr(start, comma - start));
+        start = comma + 1;
+    }
+    return items;
+}
+
+std::vector<size_t> splitNumbers(const std::string& text) {
+    std::vector<size_t> numbers;
+    for (auto& item : splitList(text)) {
+        numbers.push_back(std::strtoull(item.c_str(), nullptr, 10));
+    }
+    return numbers;
+}
+
+bool contains(const std::vector<std::string>& list, const std::string& item) {
+    return std::find(list.begin(), list.end(), item) != list.end();
+}
+
+void usage(const char* program) {
+    std::fprintf(stderr,
+        "usage: %s [--trees=btree,nsplay,circular] [--workloads=uniform,zipf,sequential,mixed]\n"
+        "          [--sizes=10000,100000] [--threads=1,2,4] [--ops=100000] [--seed=1]\n",
+        program);
+}
+
+bool parse(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        size_t eq = arg.find('=');
+        std::string name = arg.substr(0, eq);
+        std::string value = eq == std::string::npos ? "" : arg.substr(eq + 1);
+        if (name == "--trees") options.trees = splitList(value);
+        else if (name == "--workloads") options.workloads = splitList(value);
+        else if (name == "--sizes") options.sizes = splitNumbers(value);
+        else if (name == "--threads") options.threads = splitNumbers(value);
+        else if (name == "--ops") options.ops = std::strtoull(value.c_str(), nullptr, 10);
+        else if (name == "--seed") options.seed = std::strtoull(value.c_str(), nullptr, 10);
+        else return false;
+    }
+
+    const std::vector<std::string> trees{"btree", "nsplay", "circular"};
+    const std::vector<std::string> workloads{"uniform", "zipf", "sequential", "mixed"};
+    for (auto& tree : options.trees) {
+        if (!contains(trees, tree)) return false;
+    }
+    for (auto& workload : options.workloads) {
+        if (!contains(workloads, workload)) return false;
+    }
+    for (size_t size : options.sizes) {
+        if (size == 0 || size > static_cast<size_t>(INT32_MAX / 2)) return false;
+    }
+    for (size_t threads : options.threads) {
+        if (threads == 0) return false;
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parse(argc, argv, options)) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    int failures = 0;
+    for (auto& tree : options.trees) {
+        for (auto& workload : options.workloads) {
+            for (size_t size : options.sizes) {
+                for (size_t threads : options.threads) {
+                    std::fflush(stdout);
+                    pid_t child = fork();
+                    if (child == 0) {
+                        runOne(tree, workload, size, threads, options);
+                        std::fflush(stdout);
+                        _exit(0);
+                    }
+                    int status = 0;
+                    if (child < 0 || waitpid(child, &status, 0) < 0 ||
+                        !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                        std::fprintf(stderr, "run failed: %s %s size=%zu threads=%zu\n",
+                                     tree.c_str(), workload.c_str(), size, threads);
+                        failures++;
+                    }
+                }
+            }
+        }
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,265 @@
+/*
+ * Tree Executor
+ * Copyright (C) 2025, Shyamal Suhana Chandra
+ * All rights reserved.
+ */
+
+#include "TreeExecutor.h"
+#include <algorithm>
+
+namespace {
+
+// Identifies the executor (and deque) owned by the current thread
+thread_local const TreeExecutor* currentExecutor = nullptr;
+thread_local size_t currentWorker = 0;
+
+} // namespace
+
+TreeExecutor::TreeExecutor(size_t numThreads, size_t capacity, OverflowPolicy policy)
+    : capacity_(std::max<size_t>(capacity, 1)), policy_(policy), running_(true),
+      pending_(0), nextWorker_(0), rejected_(0), stolen_(0),
+      sleepingWorkers_(0), blockedSubmitters_(0) {
+    if (numThreads == 0) {
+        numThreads = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+    }
+
+    // All deques exist before any worker can try to steal from them
+    for (size_t i = 0; i < numThreads; i++) {
+        workers_.push_back(std::make_unique<Worker>());
+    }
+    for (size_t i = 0; i < numThreads; i++) {
+        workers_[i]->thread = std::thread(&TreeExecutor::workerLoop, this, i);
+    }
+}
+
+TreeExecutor::~TreeExecutor() {
+    // Workers drain everything already queued before exiting
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex_);
+        running_ = false;
+    }
+    workAvailable_.notify_all();
+    spaceAvailable_.notify_all();
+
+    for (auto& worker : workers_) {
+        if (worker->thread.joinable()) {
+            worker->thread.join();
+        }
+    }
+}
+
+TreeExecutor& TreeExecutor::shared(size_t numThreads) {
+    static TreeExecutor instance(numThreads);
+    return instance;
+}
+
+bool TreeExecutor::onWorkerThread() const {
+    return currentExecutor == this;
+}
+
+bool TreeExecutor::submit(std::function<void()> task) {
+    if (!running_) {
+        return false;
+    }
+    bool local = onWorkerThread();
+
+    // Reserve a queue slot
+    size_t current = pending_.load();
+    while (true) {
+        if (current < capacity_) {
+            if (pending_.compare_exchange_weak(current, current + 1)) break;
+            continue;
+        }
+
+        if (policy_.load() == OverflowPolicy::REJECT) {
+            rejected_++;
+            return false;
+        }
+        if (local) {
+            // A worker blocking on its own pool could wait forever; run the
+            // task here instead
+            task();
+            return true;
+        }
+
+        std::unique_lock<std::mutex> lock(sleepMutex_);
+        blockedSubmitters_++;
+        spaceAvailable_.wait(lock, [this] {
+            return pending_.load() < capacity_ || !running_;
+        });
+        blockedSubmitters_--;
+        if (!running_) {
+            return false;
+        }
+        current = pending_.load();
+    }
+
+    dispatch(std::move(task));
+    return true;
+}
+
+bool TreeExecutor::trySubmit(std::function<void()> task) {
+    // submit() without the overflow policy: a full queue just says no
+    if (!running_) {
+        return false;
+    }
+    size_t current = pending_.load();
+    do {
+        if (current >= capacity_) return false;
+    } while (!pending_.compare_exchange_weak(current, current + 1));
+
+    dispatch(std::move(task));
+    return true;
+}
+
+void TreeExecutor::dispatch(std::function<void()> task) {
+    // The queue slot is already reserved
+    if (onWorkerThread()) {
+        push(currentWorker, std::move(task), true);
+    } else {
+        push(nextWorker_++ % workers_.size(), std::move(task), false);
+    }
+
+    if (sleepingWorkers_.load() > 0) {
+        std::lock_guard<std::mutex> lock(sleepMutex_);
+        workAvailable_.notify_one();
+    }
+}
+
+void TreeExecutor::parallelFor(size_t count, const std::function<void(size_t)>& body) {
+    if (count == 0) {
+        return;
+    }
+
+    // Helpers can start after the loop is over (they then find no index
+    // left), so the state they share outlives this call
+    struct Loop {
+        const std::function<void(size_t)>* body;
+        size_t count;
+        std::atomic<size_t> next{0};
+        std::atomic<size_t> done{0};
+        std::mutex mutex;
+        std::condition_variable finished;
+    };
+    auto loop = std::make_shared<Loop>();
+    loop->body = &body;
+    loop->count = count;
+
+    auto work = [](Loop& l) {
+        for (size_t i = l.next++; i < l.count; i = l.next++) {
+            (*l.body)(i);
+            if (++l.done == l.count) {
+                std::lock_guard<std::mutex> lock(l.mutex);
+                l.finished.notify_all();
+            }
+        }
+    };
+
+    size_t helpers = std::min(count - 1, workers_.size());
+    for (size_t i = 0; i < helpers; i++) {
+        if (!trySubmit([loop, work]() { work(*loop); })) break;
+    }
+    work(*loop);
+
+    // Only indices other threads have already claimed can be left
+    std::unique_lock<std::mutex> lock(loop->mutex);
+    loop->finished.wait(lock, [&loop] { return loop->done.load() == loop->count; });
+}
+
+void TreeExecutor::push(size_t index, std::function<void()> task, bool back) {
+    // The owner pops from the back: local tasks go there (LIFO, cache-warm)
+    // and external ones at the front so the owner still sees them oldest
+    // first once its local work runs out.
+    Worker& worker = *workers_[index];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    if (back) {
+        worker.tasks.push_back(std::move(task));
+    } else {
+        worker.tasks.push_front(std::move(task));
+    }
+}
+
+bool TreeExecutor::popLocal(size_t index, std::function<void()>& task) {
+    Worker& worker = *workers_[index];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    if (worker.tasks.empty()) {
+        return false;
+    }
+    task = std::move(worker.tasks.back());
+    worker.tasks.pop_back();
+    return true;
+}
+
+bool TreeExecutor::steal(size_t thief, std::function<void()>& task) {
+    for (size_t offset = 1; offset < workers_.size(); offset++) {
+        Worker& victim = *workers_[(thief + offset) % workers_.size()];
+        std::unique_lock<std::mutex> lock(victim.mutex, std::try_to_lock);
+        if (!lock.owns_lock() || victim.tasks.empty()) {
+            continue;
+        }
+        task = std::move(victim.tasks.front());
+        victim.tasks.pop_front();
+        stolen_++;
+        return true;
+    }
+    return false;
+}
+
+void TreeExecutor::taskTaken() {
+    pending_--;
+    if (blockedSubmitters_.load() > 0) {
+        std::lock_guard<std::mutex> lock(sleepMutex_);
+        spaceAvailable_.notify_one();
+    }
+}
+
+void TreeExecutor::workerLoop(size_t index) {
+    currentExecutor = this;
+    currentWorker = index;
+
+    while (true) {
+        std::function<void()> task;
+        if (popLocal(index, task) || steal(index, task)) {
+            taskTaken();
+            task();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleepMutex_);
+        sleepingWorkers_++;
+        workAvailable_.wait(lock, [this] {
+            return pending_.load() > 0 || !running_;
+        });
+        sleepingWorkers_--;
+        if (!running_ && pending_.load() == 0) {
+            break;
+        }
+    }
+}
+
+// TaskGroup
+
+bool TreeExecutor::TaskGroup::submit(std::function<void()> task) {
+    pending_++;
+    bool queued = executor_.submit([this, task = std::move(task)]() {
+        task();
+        // Decrement under the lock so wait() cannot return (and the group
+        // be destroyed) between the decrement and the notify
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (--pending_ == 0) {
+            done_.notify_all();
+        }
+    });
+    if (!queued) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (--pending_ == 0) {
+            done_.notify_all();
+        }
+    }
+    return queued;
+}
+
+void TreeExecutor::TaskGroup::wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this] { return pending_.load() == 0; });
+}
@@ -0,0 +1,122 @@
+/*
+ * Tree Executor
+ * Copyright (C) 2025, Shyamal Suhana Chandra
+ * All rights reserved.
+ */
+
+#ifndef TREE_EXECUTOR_H
+#define TREE_EXECUTOR_H
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <functional>
+#include <condition_variable>
+#include <cstddef>
+
+// Process-wide pool shared by the async APIs of every tree.
+//
+// Each worker owns a deque: it pops its own work LIFO (tasks submitted
+// from inside a task stay on the worker that created them) and, when
+// empty, steals FIFO from the other workers. Submissions from outside the
+// pool are spread round-robin across the deques. The number of queued
+// tasks is bounded; when full, submit() either blocks until a worker
+// frees a slot or rejects the task, depending on the overflow policy.
+class TreeExecutor {
+public:
+    enum class OverflowPolicy {
+        BLOCK,   // Wait for space (runs the task inline on a worker thread)
+        REJECT   // Return false without queuing
+    };
+
+    // Tracks the tasks one owner (e.g. a tree) has in flight so that it
+    // can wait for them before tearing down state they reference.
+    class TaskGroup {
+    public:
+        explicit TaskGroup(TreeExecutor& executor) : executor_(executor), pending_(0) {}
+        ~TaskGroup() { wait(); }
+
+        bool submit(std::function<void()> task);
+        void wait();
+        size_t pending() const { return pending_.load(); }
+        TreeExecutor& executor() const { return executor_; }
+
+    private:
+        TreeExecutor& executor_;
+        std::atomic<size_t> pending_;
+        std::mutex mutex_;
+        std::condition_variable done_;
+    };
+
+    explicit TreeExecutor(size_t numThreads = 0, size_t capacity = 4096,
+                          OverflowPolicy policy = OverflowPolicy::BLOCK);
+    ~TreeExecutor();
+
+    TreeExecutor(const TreeExecutor&) = delete;
+    TreeExecutor& operator=(const TreeExecutor&) = delete;
+
+    // The shared instance, created on first use. Its configuration is
+    // fixed by the first call; numThreads == 0 means one per core.
+    static TreeExecutor& shared(size_t numThreads = 0);
+
+    // Queue a task; false if it was rejected
+    bool submit(std::function<void()> task);
+
+    // Runs body(0) .. body(count - 1) and returns when all have finished.
+    // The caller works through the indices itself alongside up to one
+    // helper task per worker, queued only where there is room, so it makes
+    // progress from inside a task or when every worker is busy. body must
+    // not throw.
+    void parallelFor(size_t count, const std::function<void(size_t)>& body);
+
+    // Configuration and statistics
+    size_t workerCount() const { return workers_.size(); }
+    size_t capacity() const { return capacity_; }
+    size_t pendingTasks() const { return pending_.load(); }
+    size_t rejectedTasks() const { return rejected_.load(); }
+    size_t stolenTasks() const { return stolen_.load(); }
+    OverflowPolicy getOverflowPolicy() const { return policy_.load(); }
+    void setOverflowPolicy(OverflowPolicy policy) { policy_ = policy; }
+
+    // True when called from one of this executor's workers
+    bool onWorkerThread() const;
+
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+        std::thread thread;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    size_t capacity_;
+    std::atomic<OverflowPolicy> policy_;
+    std::atomic<bool> running_;
+
+    // Queued (not yet started) tasks across all deques
+    std::atomic<size_t> pending_;
+    std::atomic<size_t> nextWorker_;
+    std::atomic<size_t> rejected_;
+    std::atomic<size_t> stolen_;
+
+    // Idle workers and blocked submitters park here; the counters let the
+    // fast paths skip the mutex when nobody is waiting.
+    std::mutex sleepMutex_;
+    std::condition_variable workAvailable_;
+    std::condition_variable spaceAvailable_;
+    std::atomic<size_t> sleepingWorkers_;
+    std::atomic<size_t> blockedSubmitters_;
+
+    void workerLoop(size_t index);
+    bool popLocal(size_t index, std::function<void()>& task);
+    bool steal(size_t thief, std::function<void()>& task);
+    bool trySubmit(std::function<void()> task);
+    void dispatch(std::function<void()> task);
+    void push(size_t index, std::function<void()> task, bool back);
+    void taskTaken();
+};
+
+#endif // TREE_EXECUTOR_H
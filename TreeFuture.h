@@ -0,0 +1,195 @@
+/*
+ * Tree Future
+ * Copyright (C) 2025, Shyamal Suhana Chandra
+ * All rights reserved.
+ */
+
+#ifndef TREE_FUTURE_H
+#define TREE_FUTURE_H
+
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <optional>
+#include <exception>
+#include <stdexcept>
+#include <utility>
+#include "TreeExecutor.h"
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#include <coroutine>
+#define TREE_FUTURE_COROUTINES 1
+#endif
+
+template<typename T> class TreePromise;
+
+// Result of an async tree operation, holding its value by value (no
+// pointers into the tree). Unlike std::future it runs a continuation
+// inline on the completing thread, and in C++20 it can be co_await-ed;
+// a coroutine awaiting tree operations from an executor worker never
+// suspends, because those operations run inline there (see runAsFuture).
+//
+// Move-only; get() (or co_await) consumes the value and may be used once.
+template<typename T>
+class TreeFuture {
+public:
+    TreeFuture() = default;
+    TreeFuture(TreeFuture&&) = default;
+    TreeFuture& operator=(TreeFuture&&) = default;
+    TreeFuture(const TreeFuture&) = delete;
+    TreeFuture& operator=(const TreeFuture&) = delete;
+
+    bool valid() const { return state_ != nullptr; }
+
+    bool isReady() const {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        return state_->done;
+    }
+
+    void wait() const {
+        std::unique_lock<std::mutex> lock(state_->mutex);
+        state_->ready.wait(lock, [this] { return state_->done; });
+    }
+
+    // Blocks until ready; rethrows if the operation failed or was rejected
+    T get() {
+        wait();
+        if (state_->error) {
+            std::rethrow_exception(state_->error);
+        }
+        return std::move(*state_->value);
+    }
+
+    // Runs f(value) once the result is available: immediately if it
+    // already is, otherwise on the thread that completes it. f is skipped
+    // if the operation failed; get() still reports the error.
+    template<typename F>
+    void then(F f) {
+        auto state = state_;
+        if (!setContinuation([state, f = std::move(f)]() mutable {
+                if (!state->error) f(std::move(*state->value));
+            })) {
+            if (!state->error) f(std::move(*state->value));
+        }
+    }
+
+#ifdef TREE_FUTURE_COROUTINES
+    // Awaitable
+    bool await_ready() const { return isReady(); }
+    bool await_suspend(std::coroutine_handle<> handle) {
+        // Not suspending when the result arrived in the meantime
+        return setContinuation([handle]() { handle.resume(); });
+    }
+    T await_resume() { return get(); }
+
+    // Also usable as a coroutine's return type
+    struct promise_type {
+        TreePromise<T> promise;
+        TreeFuture get_return_object() { return promise.future(); }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_value(T value) { promise.setValue(std::move(value)); }
+        void unhandled_exception() { promise.setException(std::current_exception()); }
+    };
+#endif
+
+private:
+    friend class TreePromise<T>;
+
+    struct State {
+        std::mutex mutex;
+        std::condition_variable ready;
+        bool done = false;
+        std::optional<T> value;
+        std::exception_ptr error;
+        std::function<void()> continuation;
+    };
+
+    explicit TreeFuture(std::shared_ptr<State> state) : state_(std::move(state)) {}
+
+    // false (and nothing stored) if the result is already available
+    bool setContinuation(std::function<void()> continuation) {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        if (state_->done) {
+            return false;
+        }
+        state_->continuation = std::move(continuation);
+        return true;
+    }
+
+    std::shared_ptr<State> state_;
+};
+
+// Producer side. Copyable so it can be captured in std::function tasks;
+// all copies complete the same future.
+template<typename T>
+class TreePromise {
+public:
+    TreePromise() : state_(std::make_shared<State>()) {}
+
+    TreeFuture<T> future() const { return TreeFuture<T>(state_); }
+
+    void setValue(T value) {
+        complete([&](State& state) { state.value.emplace(std::move(value)); });
+    }
+
+    void setException(std::exception_ptr error) {
+        complete([&](State& state) { state.error = error; });
+    }
+
+private:
+    using State = typename TreeFuture<T>::State;
+
+    template<typename Store>
+    void complete(Store store) {
+        // Keep the state alive even if a woken waiter drops the last
+        // other reference (including this promise) before we return
+        std::shared_ptr<State> state = state_;
+        std::function<void()> continuation;
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            store(*state);
+            state->done = true;
+            continuation = std::move(state->continuation);
+        }
+        state->ready.notify_all();
+        // Outside the lock: the continuation may resume a coroutine that
+        // goes on to issue more operations
+        if (continuation) {
+            continuation();
+        }
+    }
+
+    std::shared_ptr<State> state_;
+};
+
+// Runs op() for a tree and returns its result as a future. On one of the
+// executor's own workers the operation runs inline, so chains of awaited
+// operations stay on that thread instead of bouncing through the queue.
+// A rejected submission yields a future holding std::runtime_error.
+template<typename T, typename Op>
+TreeFuture<T> runAsFuture(TreeExecutor::TaskGroup& group, Op op) {
+    TreePromise<T> promise;
+    TreeFuture<T> future = promise.future();
+    auto task = [promise, op]() mutable {
+        std::optional<T> result;
+        try {
+            result.emplace(op());
+        } catch (...) {
+            promise.setException(std::current_exception());
+            return;
+        }
+        promise.setValue(std::move(*result));
+    };
+
+    if (group.executor().onWorkerThread()) {
+        task();
+    } else if (!group.submit(task)) {
+        promise.setException(std::make_exception_ptr(
+            std::runtime_error("TreeExecutor rejected the operation")));
+    }
+    return future;
+}
+
+#endif // TREE_FUTURE_H
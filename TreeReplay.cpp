@@ -0,0 +1,271 @@
+/*
+ * Tree Replay
+ * Copyright (C) 2025, Shyamal Suhana Chandra
+ * All rights reserved.
+ */
+
+// Replays a trace captured with btree_trace_start / nsplaytree_trace_start
+// against BTree, NSplayTree and CircularBufferSplayTree, so one recorded
+// access sequence can be compared across trees and configurations. Each
+// tree starts empty and gets exactly the recorded operations, with values
+// of the recorded lengths; one JSON object per tree is written to stdout.
+//
+//   serial   one thread applies the records in file order
+//   threads  one thread per recorded thread, each applying its own
+//            records, handing off so the global order is the file's
+//
+// Both modes give every tree the same sequence, so hit and insert counts
+// depend only on the tree's semantics (the circular tree also evicts once
+// full). Structural counters are filled in when the trees were built with
+// TREE_ENABLE_STATS.
+
+#include "BTree.h"
+#include "NSplayTree.h"
+#include "CircularBufferSplayTree.h"
+#include "TraceLog.h"
+#include <vector>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    std::vector<std::string> trees{"btree", "nsplay", "circular"};
+    std::string mode = "serial";
+    int degree = 32;
+    int initialBranching = 2;
+    int maxBranching = 16;
+    size_t capacity = 0;  // 0: one slot per recorded insert
+    std::string path;
+};
+
+struct Counts {
+    uint64_t searches = 0;
+    uint64_t hits = 0;
+    uint64_t inserts = 0;
+    uint64_t inserted = 0;
+    uint64_t removes = 0;
+    uint64_t removed = 0;
+
+    void merge(const Counts& other) {
+        searches += other.searches;
+        hits += other.hits;
+        inserts += other.inserts;
+        inserted += other.inserted;
+        removes += other.removes;
+        removed += other.removed;
+    }
+};
+
+template<typename Tree>
+void apply(Tree& tree, const TraceRecord& record, Counts& counts) {
+    int key = static_cast<int>(record.key);
+    switch (record.op) {
+        case TraceOp::SEARCH:
+            counts.searches++;
+            if (tree.search(key)) counts.hits++;
+            break;
+        case TraceOp::INSERT:
+            counts.inserts++;
+            if (tree.insert(key, std::string(record.valueLength, 'v'))) counts.inserted++;
+            break;
+        case TraceOp::REMOVE:
+            counts.removes++;
+            if (tree.remove(key)) counts.removed++;
+            break;
+    }
+}
+
+template<typename Tree>
+double replaySerial(Tree& tree, const TraceLog& log, Counts& counts) {
+    auto start = Clock::now();
+    for (const TraceRecord& record : log.records) {
+        apply(tree, record, counts);
+    }
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Each thread waits for the turn of its next record; the hand-off cost is
+// part of the measured time
+template<typename Tree>
+double replayThreads(Tree& tree, const TraceLog& log, Counts& counts) {
+    std::vector<std::vector<size_t>> mine(std::max<uint32_t>(log.threads, 1));
+    for (size_t i = 0; i < log.records.size(); i++) {
+        mine[log.records[i].thread].push_back(i);
+    }
+
+    std::vector<Counts> perThread(mine.size());
+    std::atomic<size_t> turn{0};
+    std::atomic<size_t> ready{0};
+    std::atomic<bool> go{false};
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < mine.size(); t++) {
+        workers.emplace_back([&, t]() {
+            ready++;
+            while (!go.load(std::memory_order_acquire)) std::this_thread::yield();
+            for (size_t index : mine[t]) {
+                while (turn.load(std::memory_order_acquire) != index) std::this_thread::yield();
+                apply(tree, log.records[index], perThread[t]);
+                turn.store(index + 1, std::memory_order_release);
+            }
+        });
+    }
+    while (ready.load() < workers.size()) std::this_thread::yield();
+    auto start = Clock::now();
+    go.store(true, std::memory_order_release);
+    for (auto& worker : workers) worker.join();
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    for (auto& c : perThread) counts.merge(c);
+    return seconds;
+}
+
+template<typename Tree>
+void runTree(Tree& tree, const std::string& name, const TraceLog& log, const Options& options) {
+    Counts counts;
+    double seconds = options.mode == "threads" ? replayThreads(tree, log, counts)
+                                               : replaySerial(tree, log, counts);
+    TreeStatsReport stats = tree.getStats();
+    size_t ops = log.records.size();
+    std::printf("{\"tree\":\"%s\",\"mode\":\"%s\",\"ops\":%zu,\"threads\":%u,"
+                "\"seconds\":%.6f,\"opsPerSec\":%.0f,"
+                "\"searches\":%llu,\"hits\":%llu,\"inserts\":%llu,\"inserted\":%llu,"
+                "\"removes\":%llu,\"removed\":%llu,\"size\":%zu,\"height\":%d,"
+                "\"statsEnabled\":%s,\"lookups\":%llu,\"nodesVisited\":%llu,"
+                "\"rotations\":%llu,\"splits\":%llu,\"merges\":%llu,"
+                "\"lockContended\":%llu,\"lockWaitNs\":%llu}\n",
+                name.c_str(), options.mode.c_str(), ops,
+                options.mode == "threads" ? std::max<uint32_t>(log.threads, 1) : 1u,
+                seconds, seconds > 0 ? ops / seconds : 0.0,
+                static_cast<unsigned long long>(counts.searches),
+                static_cast<unsigned long long>(counts.hits),
+                static_cast<unsigned long long>(counts.inserts),
+                static_cast<unsigned long long>(counts.inserted),
+                static_cast<unsigned long long>(counts.removes),
+                static_cast<unsigned long long>(counts.removed),
+                tree.size(), tree.height(),
+                stats.enabled ? "true" : "false",
+                static_cast<unsigned long long>(stats[TreeCounter::LOOKUPS]),
+                static_cast<unsigned long long>(stats[TreeCounter::NODES_VISITED]),
+                static_cast<unsigned long long>(stats[TreeCounter::ROTATIONS]),
+                static_cast<unsigned long long>(stats[TreeCounter::SPLITS]),
+                static_cast<unsigned long long>(stats[TreeCounter::MERGES]),
+                static_cast<unsigned long long>(stats[TreeCounter::LOCK_CONTENDED]),
+                static_cast<unsigned long long>(stats[TreeCounter::LOCK_WAIT_NS]));
+    std::fflush(stdout);
+}
+
+const char* sourceName(TraceSource source) {
+    switch (source) {
+        case TraceSource::BTREE: return "btree";
+        case TraceSource::NSPLAYTREE: return "nsplay";
+        default: return "unknown";
+    }
+}
+
+std::vector<std::string> splitList(const std::string& text) {
+    std::vector<std::string> items;
+    size_t start = 0;
+    while (start <= text.size()) {
+        size_t comma = text.find(',', start);
+        if (comma == std::string::npos) comma = text.size();
+        if (comma > start) items.push_back(text.substr(start, comma - start));
+        start = comma + 1;
+    }
+    return items;
+}
+
+void usage(const char* program) {
+    std::fprintf(stderr,
+        "usage: %s [--trees=btree,nsplay,circular] [--mode=serial|threads]\n"
+        "          [--degree=32] [--branching=2,16] [--capacity=N] trace\n",
+        program);
+}
+
+bool parse(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.compare(0, 2, "--") != 0) {
+            if (!options.path.empty()) return false;
+            options.path = arg;
+            continue;
+        }
+        size_t eq = arg.find('=');
+        std::string name = arg.substr(0, eq);
+        std::string value = eq == std::string::npos ? "" : arg.substr(eq + 1);
+        if (name == "--trees") options.trees = splitList(value);
+        else if (name == "--mode") options.mode = value;
+        else if (name == "--degree") options.degree = std::atoi(value.c_str());
+        else if (name == "--capacity") options.capacity = std::strtoull(value.c_str(), nullptr, 10);
+        else if (name == "--branching") {
+            auto parts = splitList(value);
+            if (parts.size() != 2) return false;
+            options.initialBranching = std::atoi(parts[0].c_str());
+            options.maxBranching = std::atoi(parts[1].c_str());
+        } else {
+            return false;
+        }
+    }
+
+    const std::vector<std::string> trees{"btree", "nsplay", "circular"};
+    for (auto& tree : options.trees) {
+        if (std::find(trees.begin(), trees.end(), tree) == trees.end()) return false;
+    }
+    return !options.path.empty() && (options.mode == "serial" || options.mode == "threads") &&
+           options.degree >= 2 && options.initialBranching >= 2 &&
+           options.maxBranching >= options.initialBranching;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parse(argc, argv, options)) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    TraceLog log;
+    std::string error;
+    if (!TraceLog::load(options.path, log, error)) {
+        std::fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+    if (log.truncated) {
+        std::fprintf(stderr, "warning: %s ends mid-record; replaying the %zu complete records\n",
+                     options.path.c_str(), log.records.size());
+    }
+    std::fprintf(stderr, "trace: %zu ops from %s, %u threads, %.3f s recorded\n",
+                 log.records.size(), sourceName(log.source), log.threads,
+                 log.records.empty() ? 0.0 : log.records.back().timestampNs / 1e9);
+
+    size_t capacity = options.capacity;
+    if (capacity == 0) {
+        for (const TraceRecord& record : log.records) {
+            if (record.op == TraceOp::INSERT) capacity++;
+        }
+        capacity = std::max<size_t>(capacity, 1);
+    }
+
+    for (auto& tree : options.trees) {
+        if (tree == "btree") {
+            BTree<int, std::string> instance(options.degree);
+            runTree(instance, tree, log, options);
+        } else if (tree == "nsplay") {
+            NSplayTree<int, std::string> instance(options.initialBranching, options.maxBranching);
+            runTree(instance, tree, log, options);
+        } else {
+            CircularBufferSplayTree<int, std::string> instance(capacity);
+            runTree(instance, tree, log, options);
+        }
+    }
+    return 0;
+}
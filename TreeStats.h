@@ -0,0 +1,213 @@
+/*
+ * Tree Stats
+ * Copyright (C) 2025, Shyamal Suhana Chandra
+ * All rights reserved.
+ */
+
+#ifndef TREE_STATS_H
+#define TREE_STATS_H
+
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+// Hot-path instrumentation shared by the trees. Compiled in only when
+// TREE_ENABLE_STATS is defined; otherwise every recording call is an
+// empty inline function, TreeStats holds no data and reports come back
+// zeroed with enabled == false.
+#ifdef TREE_ENABLE_STATS
+#define TREE_STATS_ENABLED 1
+#else
+#define TREE_STATS_ENABLED 0
+#endif
+
+enum class TreeCounter : size_t {
+    LOOKUPS,            // Key lookup descents: every search, and the ones
+                        // insert or remove make where the tree does one
+    NODES_VISITED,      // Nodes those descents passed through
+    ROTATIONS,          // Splay rotations; key rotations through the parent in BTree
+    SPLITS,             // BTree splitChild, NSplayTree splitNode hand-downs
+    MERGES,             // BTree mergeChildren, NSplayTree root joins on remove
+    LOCK_ACQUISITIONS,  // Tree lock taken through TreeStats::Lock, or one
+                        // per request under flat combining
+    LOCK_CONTENDED,     // ... of which had to wait
+    LOCK_WAIT_NS,       // Total time spent waiting
+    COUNT
+};
+
+// Point-in-time totals. Histogram bucket 0 counts zeros and bucket i
+// counts values in [2^(i-1), 2^i); the last bucket also takes anything
+// larger.
+struct TreeStatsReport {
+    static constexpr size_t kBuckets = 32;
+
+    bool enabled = false;
+    uint64_t counters[static_cast<size_t>(TreeCounter::COUNT)] = {};
+    uint64_t lockWaitNs[kBuckets] = {};     // Contended acquisitions only
+    uint64_t nodesPerLookup[kBuckets] = {};
+
+    // Gauges, read when the report is made
+    size_t queueDepth = 0;      // The tree's own backlog: queued or running async
+                                // tasks, or unapplied ingest entries
+    size_t executorQueued = 0;  // Tasks queued on the shared executor
+
+    uint64_t operator[](TreeCounter counter) const {
+        return counters[static_cast<size_t>(counter)];
+    }
+};
+
+// Counters are striped: each thread adds to one of kStripes cache-line
+// sized blocks with relaxed atomics, and report() sums them, so
+// recording never contends with other threads on the same line.
+class TreeStats {
+public:
+    static constexpr bool kEnabled = TREE_STATS_ENABLED;
+
+    TreeStats() = default;
+    TreeStats(const TreeStats&) = delete;
+    TreeStats& operator=(const TreeStats&) = delete;
+
+    void add(TreeCounter counter, uint64_t amount = 1) {
+#if TREE_STATS_ENABLED
+        stripe().counters[static_cast<size_t>(counter)].fetch_add(amount, std::memory_order_relaxed);
+#else
+        (void)counter;
+        (void)amount;
+#endif
+    }
+
+    void recordLookup(uint64_t nodesVisited) {
+#if TREE_STATS_ENABLED
+        Stripe& s = stripe();
+        s.counters[static_cast<size_t>(TreeCounter::LOOKUPS)].fetch_add(1, std::memory_order_relaxed);
+        s.counters[static_cast<size_t>(TreeCounter::NODES_VISITED)].fetch_add(nodesVisited, std::memory_order_relaxed);
+        if (histograms_.load(std::memory_order_relaxed)) {
+            s.nodesPerLookup[bucket(nodesVisited)].fetch_add(1, std::memory_order_relaxed);
+        }
+#else
+        (void)nodesVisited;
+#endif
+    }
+
+    // Histograms cost one more add per event; off until enabled
+    void enableHistograms(bool on) {
+#if TREE_STATS_ENABLED
+        histograms_.store(on, std::memory_order_relaxed);
+#else
+        (void)on;
+#endif
+    }
+
+    TreeStatsReport report() const {
+        TreeStatsReport result;
+#if TREE_STATS_ENABLED
+        result.enabled = true;
+        for (const Stripe& s : stripes_) {
+            for (size_t i = 0; i < static_cast<size_t>(TreeCounter::COUNT); i++) {
+                result.counters[i] += s.counters[i].load(std::memory_order_relaxed);
+            }
+            for (size_t i = 0; i < TreeStatsReport::kBuckets; i++) {
+                result.lockWaitNs[i] += s.lockWaitNs[i].load(std::memory_order_relaxed);
+                result.nodesPerLookup[i] += s.nodesPerLookup[i].load(std::memory_order_relaxed);
+            }
+        }
+#endif
+        return result;
+    }
+
+    void reset() {
+#if TREE_STATS_ENABLED
+        for (Stripe& s : stripes_) {
+            for (auto& counter : s.counters) counter.store(0, std::memory_order_relaxed);
+            for (auto& count : s.lockWaitNs) count.store(0, std::memory_order_relaxed);
+            for (auto& count : s.nodesPerLookup) count.store(0, std::memory_order_relaxed);
+        }
+#endif
+    }
+
+    // For a tree lock taken without Lock (flat combining): one
+    // acquisition, which when contended waited since start
+    void recordAcquisition(bool contended, std::chrono::steady_clock::time_point start) {
+#if TREE_STATS_ENABLED
+        if (contended) {
+            recordWait(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start).count()));
+        }
+        add(TreeCounter::LOCK_ACQUISITIONS);
+#else
+        (void)contended;
+        (void)start;
+#endif
+    }
+
+    // std::lock_guard for a tree lock that also records the wait. An
+    // uncontended acquisition costs one try_lock; only a failed one reads
+    // the clock.
+    class Lock {
+    public:
+        Lock(std::mutex& mutex, TreeStats& stats) : mutex_(mutex) {
+#if TREE_STATS_ENABLED
+            if (!mutex_.try_lock()) {
+                auto start = std::chrono::steady_clock::now();
+                mutex_.lock();
+                stats.recordWait(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - start).count()));
+            }
+            stats.add(TreeCounter::LOCK_ACQUISITIONS);
+#else
+            (void)stats;
+            mutex_.lock();
+#endif
+        }
+        ~Lock() { mutex_.unlock(); }
+
+        Lock(const Lock&) = delete;
+        Lock& operator=(const Lock&) = delete;
+
+    private:
+        std::mutex& mutex_;
+    };
+
+private:
+#if TREE_STATS_ENABLED
+    static constexpr size_t kStripes = 16;
+
+    struct alignas(64) Stripe {
+        std::atomic<uint64_t> counters[static_cast<size_t>(TreeCounter::COUNT)] = {};
+        std::atomic<uint64_t> lockWaitNs[TreeStatsReport::kBuckets] = {};
+        std::atomic<uint64_t> nodesPerLookup[TreeStatsReport::kBuckets] = {};
+    };
+
+    Stripe stripes_[kStripes];
+    std::atomic<bool> histograms_{false};
+
+    Stripe& stripe() {
+        // Threads are dealt stripes round-robin on first use
+        static std::atomic<size_t> nextStripe{0};
+        thread_local size_t index = nextStripe.fetch_add(1, std::memory_order_relaxed) % kStripes;
+        return stripes_[index];
+    }
+
+    static size_t bucket(uint64_t value) {
+        size_t bits = 0;
+        while (value != 0 && bits < TreeStatsReport::kBuckets - 1) {
+            value >>= 1;
+            bits++;
+        }
+        return bits;
+    }
+
+    void recordWait(uint64_t ns) {
+        Stripe& s = stripe();
+        s.counters[static_cast<size_t>(TreeCounter::LOCK_CONTENDED)].fetch_add(1, std::memory_order_relaxed);
+        s.counters[static_cast<size_t>(TreeCounter::LOCK_WAIT_NS)].fetch_add(ns, std::memory_order_relaxed);
+        if (histograms_.load(std::memory_order_relaxed)) {
+            s.lockWaitNs[bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+#endif
+};
+
+#endif // TREE_STATS_H